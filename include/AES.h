@@ -3,31 +3,132 @@
 
 #include <string>
 #include <vector>
+#include <span>
 #include <string_view>
 #include <array>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+
+struct evp_cipher_ctx_st;
+
+// 密钥派生方式
+constexpr uint8_t KDF_LEGACY = 0;   // 旧版：固定盐值的PBKDF2，只用于读取已有备份
+constexpr uint8_t KDF_PBKDF2 = 1;   // PBKDF2-HMAC-SHA256，随机盐值
+constexpr uint8_t KDF_SCRYPT = 2;   // scrypt，占用大量内存以抵抗硬件暴力破解
+
+/**
+ * @brief 密钥派生参数，随备份保存，恢复时按相同参数重新派生密钥
+ */
+struct KdfParams {
+    static constexpr size_t SALT_SIZE = 16;
+    static constexpr uint32_t DEFAULT_PBKDF2_ITERATIONS = 100000;
+    static constexpr uint32_t DEFAULT_SCRYPT_COST = 15;  // N = 2^15，约占用32MB内存
+
+    uint8_t algorithm = KDF_LEGACY;
+    uint32_t cost = 0;        // PBKDF2为迭代次数，scrypt为log2(N)
+    std::array<unsigned char, SALT_SIZE> salt{};
+
+    auto operator<=>(const KdfParams&) const = default;
+};
 
 /**
- * @brief AES加密模块类，提供256位AES-CBC加密功能
+ * @brief AES加密模块类，提供256位AES-GCM分块认证加密和AES-CBC加密功能
  */
 class AESModule {
 public:
     static constexpr size_t KEY_SIZE = 32;  // 256位密钥
     static constexpr size_t IV_SIZE = 16;   // 128位IV
+    static constexpr size_t BLOCK_SIZE = 16;  // 分组大小，也是填充的最大长度
+    static constexpr size_t NONCE_SIZE = 12;  // GCM随机数长度
+    static constexpr size_t TAG_SIZE = 16;    // GCM认证标签长度
     using KeyType = std::array<unsigned char, KEY_SIZE>;
     using IVType = std::array<unsigned char, IV_SIZE>;
 
     /**
-     * @brief 构造函数
+     * @brief 流式加解密的公共部分
+     *
+     * 持有一个EVP上下文，数据可以分多次通过update()处理，输出写入调用者提供的缓冲区，
+     * 数据总长度不受限制。finish()之后上下文重置，可以继续处理下一段独立的数据。
+     */
+    class StreamCipher {
+    public:
+        ~StreamCipher();
+        StreamCipher(const StreamCipher&) = delete;
+        StreamCipher& operator=(const StreamCipher&) = delete;
+
+        /**
+         * @brief 处理一段数据
+         * @param in 输入数据
+         * @param out 输出缓冲区，至少 in.size() + BLOCK_SIZE 字节
+         * @return 写入out的字节数
+         */
+        size_t update(std::span<const char> in, char* out);
+
+        /**
+         * @brief 结束当前数据，输出最后一块
+         * @param out 输出缓冲区，至少 BLOCK_SIZE 字节
+         * @return 写入out的字节数
+         * @throw std::runtime_error 解密时填充无效（密码错误或数据损坏）抛出
+         */
+        size_t finish(char* out);
+
+    protected:
+        StreamCipher(const AESModule& aes, bool encrypt);
+
+    private:
+        void restart();
+
+        evp_cipher_ctx_st* ctx_;
+        KeyType key_;
+        IVType iv_;
+        bool encrypt_;
+    };
+
+    /**
+     * @brief 流式加密器
+     */
+    class Encryptor : public StreamCipher {
+    public:
+        explicit Encryptor(const AESModule& aes) : StreamCipher(aes, true) {}
+    };
+
+    /**
+     * @brief 流式解密器
+     */
+    class Decryptor : public StreamCipher {
+    public:
+        explicit Decryptor(const AESModule& aes) : StreamCipher(aes, false) {}
+    };
+
+    /**
+     * @brief 构造函数，使用旧版固定盐值派生密钥
      * @param password 用于生成密钥和IV的密码
      */
     explicit AESModule(const std::string& password);
 
+    /**
+     * @brief 构造函数，按指定参数派生密钥
+     * @param password 用于生成密钥和IV的密码
+     * @param params 密钥派生参数
+     * @throw std::runtime_error 参数无效时抛出
+     */
+    AESModule(const std::string& password, const KdfParams& params);
+
     /**
      * @brief 加密数据
      * @param data 要加密的数据
      * @return 加密后的数据
      */
-    std::vector<char> encrypt(const std::string_view& data);
+    std::vector<char> encrypt(const std::string_view& data) const;
+
+    /**
+     * @brief 加密数据，密文追加到out之后
+     *
+     * 每个线程复用同一个EVP上下文，可以在多个线程中并发调用。
+     */
+    void encrypt(std::span<const char> data, std::vector<char>& out) const;
 
     /**
      * @brief 解密数据
@@ -35,40 +136,108 @@ public:
      * @param size 数据大小
      * @return 解密后的数据
      */
-    std::vector<char> decrypt(const char* data, size_t size);
+    std::vector<char> decrypt(const char* data, size_t size) const;
+
+    /**
+     * @brief 解密数据，明文追加到out之后
+     *
+     * 每个线程复用同一个EVP上下文，可以在多个线程中并发调用。
+     * @throw std::runtime_error 密码错误或数据损坏时抛出
+     */
+    void decrypt(std::span<const char> data, std::vector<char>& out) const;
+
+    /**
+     * @brief 使用AES-256-GCM加密并认证一个数据块
+     *
+     * 每次调用随机生成nonce，nonce + 密文 + 认证标签 追加到out之后。
+     * 各数据块相互独立，可以在多个线程中并发调用。
+     * @param aad 附加认证数据，不加密也不保存，但参与认证，open时须给出相同的内容
+     */
+    void seal(std::span<const char> data, std::vector<char>& out,
+              std::span<const char> aad = {}) const;
+
+    /**
+     * @brief 验证并解密seal()的输出，明文追加到out之后
+     * @param aad 加密时使用的附加认证数据
+     * @throw std::runtime_error 认证失败（密码错误、数据被篡改或附加数据不符）时抛出
+     */
+    void open(std::span<const char> data, std::vector<char>& out,
+              std::span<const char> aad = {}) const;
+
+    /**
+     * @brief 派生子密钥
+     *
+     * 以本模块的密钥为输入、nonce为盐值做HKDF-SHA256，不同的nonce得到互不相关的密钥和IV。
+     * 派生很快，慢速的密码派生只需做一次。
+     * @param nonce 随机数，随数据一起保存
+     * @throw std::runtime_error 派生失败时抛出
+     */
+    AESModule derive(std::span<const uint8_t> nonce) const;
 
 private:
     KeyType key_;
     IVType iv_;
 
+    AESModule(const KeyType& key, const IVType& iv) : key_(key), iv_(iv) {}
+
     /**
      * @brief 从密码派生密钥和IV
      * @param password 用户密码
+     * @param params 密钥派生参数
      * @return 密钥和IV的pair
      */
-    static std::pair<KeyType, IVType> derive_key_iv(const std::string& password);
+    static std::pair<KeyType, IVType> derive_key_iv(const std::string& password,
+                                                    const KdfParams& params);
+};
+
+/**
+ * @brief 密钥句柄，缓存由同一个密码派生的密钥
+ *
+ * 密钥派生有意设计得很慢，批量任务中同一个句柄可以在多个Packer和多次
+ * 打包、验证、恢复之间共享：新备份使用句柄创建时生成的随机盐值，只派生一次；
+ * 读取备份时按其中记录的参数派生，结果按参数缓存。可以在多个线程中使用。
+ *
+ * 同一批备份的盐值和派生出的主密钥相同，每个备份再用自己的随机key_nonce
+ * 通过AESModule::derive()得到各自的密钥（见ArchiveInfo）。
+ */
+class KeyHandle {
+public:
+    /**
+     * @brief 构造函数，生成随机盐值，此时还不派生密钥
+     * @param password 密码
+     * @param algorithm 新备份使用的派生方式，KDF_PBKDF2或KDF_SCRYPT
+     * @param cost PBKDF2的迭代次数或scrypt的log2(N)，0表示默认值
+     * @throw std::runtime_error 参数无效时抛出
+     */
+    explicit KeyHandle(std::string password, uint8_t algorithm = KDF_PBKDF2, uint32_t cost = 0);
+
+    /**
+     * @brief 判断句柄是否由相同的密码和派生设置创建，相同时可以直接复用
+     */
+    bool matches(const std::string& password, uint8_t algorithm, uint32_t cost) const;
 
     /**
-     * @brief 加密数据的辅助函数
-     * @param plaintext 要加密的数据
-     * @param plaintext_len 数据长度
-     * @param ciphertext 加密后的数据
-     * @param ciphertext_len 加密后的数据长度
-     * @return 是否成功
+     * @brief 新备份使用的派生参数（含随机盐值）
      */
-    bool encryptData(const unsigned char* plaintext, int plaintext_len,
-                    unsigned char* ciphertext, int& ciphertext_len);
+    const KdfParams& params() const { return params_; }
 
     /**
-     * @brief 解密数据的辅助函数
-     * @param ciphertext 要解密的数据
-     * @param ciphertext_len 数据长度
-     * @param plaintext 解密后的数据
-     * @param plaintext_len 解密后的数据长度
-     * @return 是否成功
+     * @brief 取得按指定参数派生的加密模块，首次使用某组参数时派生密钥
+     * @return 加密模块，与句柄的生命周期相同
      */
-    bool decryptData(const unsigned char* ciphertext, int ciphertext_len,
-                    unsigned char* plaintext, int& plaintext_len);
+    const AESModule& module(const KdfParams& params) const;
+
+    /**
+     * @brief 按名称查找派生方式
+     * @throw std::runtime_error 名称未知时抛出
+     */
+    static uint8_t KdfFromName(const std::string& name);
+
+private:
+    std::string password_;
+    KdfParams params_;
+    mutable std::mutex mutex_;
+    mutable std::map<KdfParams, std::unique_ptr<AESModule>> cache_;
 };
 
 #endif // AES_MODULE_H
@@ -0,0 +1,175 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+class AESModule;
+class Codec;
+
+/*
+ * v2 分帧备份格式
+ *
+ *   BackupHeader                 旧格式的头部，mod 中置 MOD_FRAMED 位
+ *   ArchiveInfo                  格式版本、编码方式、帧大小、密钥派生参数
+ *   [FrameHeader + 帧数据] * N    数据帧，每帧独立压缩/加密
+ *   FrameHeader + 索引数据        索引帧，编码方式与数据帧相同
+ *   ArchiveTrailer               索引位置，固定位于文件末尾
+ *
+ * 打包输出的记录流按 frame_size 切分成帧，流中偏移为 off 的字节位于
+ * 第 off / frame_size 帧的 off % frame_size 处。索引记录每个文件所在的帧
+ * 及帧内偏移，读取单个文件时只需解码它所在的帧。
+ *
+ * CIPHER_AES_GCM_AAD加密时每帧的附加认证数据为 uint64帧号 + ArchiveInfo，
+ * 帧被交换、删除或从其他备份拼接进来都无法通过认证。
+ */
+
+constexpr char ARCHIVE_MAGIC[4] = {'B', 'K', 'V', '2'};
+constexpr char TRAILER_MAGIC[8] = {'B', 'K', 'I', 'N', 'D', 'E', 'X', '2'};
+constexpr uint16_t ARCHIVE_VERSION = 2;
+
+// 数据块编码方式
+constexpr uint8_t CODEC_NONE = 0;
+constexpr uint8_t CODEC_LZW = 1;
+constexpr uint8_t CODEC_LZ = 2;        // 快速LZ77
+constexpr uint8_t CODEC_LZH = 3;       // LZ77 + 哈夫曼编码
+
+// 加密方式
+constexpr uint8_t CIPHER_NONE = 0;
+constexpr uint8_t CIPHER_AES_CBC = 1;  // 旧版，帧之间共用IV且没有认证，只用于读取已有备份
+constexpr uint8_t CIPHER_AES_GCM = 2;  // 旧版，每帧单独认证但不绑定位置，只用于读取已有备份
+constexpr uint8_t CIPHER_AES_GCM_AAD = 3;  // 每帧随机nonce和认证标签，帧号和格式信息作为附加认证数据
+
+// 索引帧的帧号：最高位置1，低位为数据帧数量，数据帧被截去时索引帧无法通过认证
+constexpr uint64_t INDEX_FRAME = uint64_t{1} << 63;
+
+#pragma pack(push, 1)
+/**
+ * @brief 格式信息，紧跟在BackupHeader之后
+ */
+struct ArchiveInfo {
+    char magic[4];          // ARCHIVE_MAGIC
+    uint16_t version;       // 格式版本
+    uint16_t info_size;     // 本结构大小，便于以后扩展字段
+    uint8_t codec;          // 编码方式
+    uint8_t cipher;         // 加密方式
+    uint8_t reserved[2];
+    uint32_t frame_size;    // 每帧原始数据大小（最后一帧可能更小）
+    // 以下字段在info_size较小的旧备份中不存在，按0处理（旧版固定盐值派生密钥）
+    uint8_t kdf;            // 密钥派生方式，见AES.h
+    uint8_t reserved2[3];
+    uint32_t kdf_cost;      // PBKDF2迭代次数或scrypt的log2(N)
+    uint8_t salt[16];       // 每个备份随机生成的盐值
+    uint8_t store_id[16];   // 文件数据所在的数据块存储(见ChunkStore.h)，全0表示数据保存在备份中
+    uint8_t key_nonce[16];  // 每个备份随机生成，从密码派生的密钥再经HKDF得到本备份的密钥；
+                            // 全0表示直接使用密码派生的密钥
+};
+
+// 最早版本的ArchiveInfo大小，读取时至少需要这么多字节
+constexpr size_t ARCHIVE_INFO_MIN_SIZE = offsetof(ArchiveInfo, kdf);
+
+/**
+ * @brief 帧头部
+ */
+struct FrameHeader {
+    uint32_t raw_size;      // 解码后的大小
+    uint32_t stored_size;   // 存储的大小
+    uint32_t checksum;      // 存储数据的CRC32
+};
+
+/**
+ * @brief 文件尾部，指向索引帧
+ */
+struct ArchiveTrailer {
+    uint64_t index_offset;  // 索引帧的FrameHeader在文件中的偏移
+    uint64_t frame_count;   // 数据帧数量
+    char magic[8];          // TRAILER_MAGIC
+};
+#pragma pack(pop)
+
+/**
+ * @brief 数据帧在文件中的位置
+ */
+struct FrameInfo {
+    uint64_t offset;        // FrameHeader在文件中的偏移
+    uint32_t stored_size;
+    uint32_t raw_size;
+    uint32_t checksum;
+};
+
+/**
+ * @brief 索引条目，对应备份中的一条文件记录
+ */
+struct IndexEntry {
+    std::string path;
+    struct stat metadata;
+    uint32_t frame;         // 记录起始所在的帧
+    uint32_t offset;        // 记录在帧内的偏移
+    uint64_t size;          // 记录的总长度（文件头+数据）
+};
+
+/**
+ * @brief 备份索引
+ */
+struct ArchiveIndex {
+    std::vector<FrameInfo> frames;
+    std::vector<IndexEntry> entries;
+
+    std::vector<char> serialize() const;
+    static ArchiveIndex deserialize(const char* data, size_t size);
+};
+
+/**
+ * @brief 帧编码器，按ArchiveInfo中的设置对单个帧进行压缩和加密
+ */
+class FrameCodec {
+public:
+    /**
+     * @brief 构造函数
+     * @param info 格式信息
+     * @param aes 加密模块，不加密时可以为空；info.key_nonce非0时从中派生本备份的子密钥
+     * @param level 压缩级别，0表示编码器默认级别，只影响编码
+     */
+    FrameCodec(const ArchiveInfo& info, const AESModule* aes, int level = 0);
+
+    /**
+     * @brief 编码一帧：压缩(可选) -> 加密(可选)
+     * @param number 帧号，索引帧为INDEX_FRAME | 数据帧数量
+     */
+    std::vector<char> encode(const char* data, size_t size, uint64_t number) const;
+
+    /**
+     * @brief 解码一帧：解密(可选) -> 解压(可选)
+     * @param raw_size 帧头中记录的原始大小，用于校验
+     * @param number 帧号，须与编码时相同
+     */
+    std::vector<char> decode(const char* data, size_t size, uint32_t raw_size, uint64_t number) const;
+
+    /**
+     * @brief 帧是否与其帧号和所属备份绑定，此时数据帧之后的索引帧也要通过认证
+     */
+    bool bound() const { return cipher_ == CIPHER_AES_GCM_AAD; }
+
+    /**
+     * @brief 既不压缩也不加密时存储数据就是原始数据，调用方可以跳过编解码直接使用
+     */
+    bool passthrough() const { return !codec_ && cipher_ == CIPHER_NONE; }
+
+private:
+    std::shared_ptr<const Codec> codec_;  // 不压缩时为空
+    uint8_t cipher_;
+    const AESModule* aes_;
+    std::shared_ptr<const AESModule> subkey_;  // 本备份的子密钥，key_nonce全0时为空
+    std::vector<char> info_;  // 附加认证数据中的格式信息，只在bound()时使用
+
+    std::vector<char> associated_data(uint64_t number) const;
+    void encrypt(std::span<const char> data, std::vector<char>& out, uint64_t number) const;
+    void decrypt(std::span<const char> data, std::vector<char>& out, uint64_t number) const;
+};
+
+#endif // ARCHIVE_H
@@ -0,0 +1,162 @@
+#ifndef ARCHIVE_IO_H
+#define ARCHIVE_IO_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <future>
+#include <istream>
+#include <memory>
+#include <streambuf>
+#include <sys/uio.h>
+
+namespace fs = std::filesystem;
+
+class ThreadPool;
+
+constexpr size_t IO_ALIGNMENT = 4096;  // I/O缓冲区的对齐，即常见的页大小
+
+/**
+ * @brief 按IO_ALIGNMENT对齐分配的I/O缓冲区
+ */
+struct AlignedBufferDeleter {
+    void operator()(char* data) const { std::free(data); }
+};
+using AlignedBuffer = std::unique_ptr<char, AlignedBufferDeleter>;
+
+/**
+ * @brief 分配size字节的对齐缓冲区，size须为IO_ALIGNMENT的整数倍
+ */
+AlignedBuffer make_aligned_buffer(size_t size);
+
+/**
+ * @brief 备份文件的写入端
+ *
+ * 直接使用文件描述符写入，不经过文件流。格式信息、帧头等小块数据积累在对齐的缓冲区中，
+ * 大块数据连同缓冲区中已有的内容用一次writev写出，不复制到缓冲区。
+ *
+ * 直接I/O模式下以O_DIRECT打开，数据不经过页缓存：所有数据复制到两个对齐的缓冲区中，
+ * 一个写满后交给后台线程按对齐的偏移写出，同时填充另一个；关闭时末尾的不足一块的部分
+ * 补零写出后截断到实际长度。
+ * 出错时抛出std::system_error，错误码为对应的errno。
+ */
+class ArchiveWriter {
+public:
+    static constexpr size_t BUFFER_SIZE = 1 << 20;
+    static constexpr size_t DIRECT_BUFFER_SIZE = 4 << 20;  // 直接I/O时每次写出的大小
+
+    /**
+     * @brief 创建备份文件，已存在时截断
+     * @param direct 是否使用直接I/O，文件系统不支持时(如tmpfs)使用普通写入，见direct()
+     */
+    explicit ArchiveWriter(const fs::path& path, bool direct = false);
+    ~ArchiveWriter();  // 未关闭时关闭文件，不报告错误
+
+    ArchiveWriter(const ArchiveWriter&) = delete;
+    ArchiveWriter& operator=(const ArchiveWriter&) = delete;
+
+    /**
+     * @brief 在文件末尾追加数据
+     */
+    void write(const char* data, size_t size);
+
+    /**
+     * @brief 追加两段数据，如帧头和帧数据，较大时与缓冲区的内容一起用一次writev写出
+     */
+    void write(const char* head, size_t head_size, const char* data, size_t size);
+
+    /**
+     * @brief 覆盖已写入部分中的数据，用于回填文件头，不改变追加位置
+     */
+    void write_at(uint64_t offset, const char* data, size_t size);
+
+    /**
+     * @brief 写出缓冲区中的数据并关闭文件
+     */
+    void close();
+
+    bool is_open() const { return fd_ >= 0; }
+    bool direct() const { return direct_; }   // 实际是否使用直接I/O
+    uint64_t size() const { return size_; }  // 已追加的总长度
+
+private:
+    fs::path path_;
+    int fd_ = -1;
+    bool direct_ = false;
+    AlignedBuffer buffer_;
+    size_t used_ = 0;
+    uint64_t size_ = 0;
+
+    // 直接I/O模式
+    AlignedBuffer spare_;                 // 正在后台写出或空闲的另一个缓冲区
+    uint64_t buffer_offset_ = 0;          // buffer_开头在文件中的位置
+    std::unique_ptr<ThreadPool> writer_;  // 写出已满缓冲区的后台线程
+    std::future<void> writing_;           // 正在进行的写出
+
+    void append(const char* data, size_t size);
+    void flush();
+    void write_vector(iovec* iov, int count);
+    void write_fully(const char* data, size_t size, uint64_t offset);
+    void append_direct(const char* data, size_t size);
+    void submit_direct();
+    void wait_direct();
+    void write_at_direct(uint64_t offset, const char* data, size_t size);
+};
+
+/**
+ * @brief 备份文件的读取端，作为std::istream的缓冲区使用
+ *
+ * 用pread按BUFFER_SIZE读取到对齐的缓冲区，读取大块数据时直接读入调用方的内存；
+ * 定位到缓冲区内的位置时不重新读取文件。读取出错时抛出std::system_error。
+ */
+class ArchiveReader : public std::streambuf {
+public:
+    static constexpr size_t BUFFER_SIZE = 1 << 20;
+
+    /**
+     * @brief 以只读方式打开备份文件
+     */
+    explicit ArchiveReader(const fs::path& path);
+    ~ArchiveReader() override;
+
+    ArchiveReader(const ArchiveReader&) = delete;
+    ArchiveReader& operator=(const ArchiveReader&) = delete;
+
+    uint64_t size() const { return size_; }  // 文件长度
+
+protected:
+    int_type underflow() override;
+    std::streamsize xsgetn(char* data, std::streamsize count) override;
+    pos_type seekoff(off_type offset, std::ios_base::seekdir dir,
+                     std::ios_base::openmode which) override;
+    pos_type seekpos(pos_type position, std::ios_base::openmode which) override;
+
+private:
+    fs::path path_;
+    int fd_ = -1;
+    uint64_t size_ = 0;
+    AlignedBuffer buffer_;
+    uint64_t buffer_offset_ = 0;  // 缓冲区开头在文件中的位置
+
+    uint64_t position() const { return buffer_offset_ + (gptr() - eback()); }
+    size_t read_at(char* data, size_t size, uint64_t offset);
+};
+
+/**
+ * @brief 读取备份文件的输入流，底层读取出错时抛出异常而不是只设置流状态
+ */
+class ArchiveStream : public std::istream {
+public:
+    explicit ArchiveStream(const fs::path& path) : std::istream(nullptr), reader_(path) {
+        rdbuf(&reader_);
+        exceptions(std::ios::badbit);
+    }
+
+    uint64_t size() const { return reader_.size(); }
+
+private:
+    ArchiveReader reader_;
+};
+
+#endif // ARCHIVE_IO_H
@@ -0,0 +1,46 @@
+#ifndef BIT_WRITER_H
+#define BIT_WRITER_H
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief 低位在前的位流写入器，LZW和LZH编码共用
+ *
+ * 写入的位积累在64位寄存器中，满一个字节就追加到输出末尾。
+ */
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<char>& out) : out_(out) {}
+
+    /**
+     * @brief 写入value的低count位，count不超过32
+     */
+    void put(uint32_t value, unsigned count) {
+        acc_ |= static_cast<uint64_t>(value) << bits_;
+        bits_ += count;
+        while (bits_ >= 8) {
+            out_.push_back(static_cast<char>(acc_ & 0xFF));
+            acc_ >>= 8;
+            bits_ -= 8;
+        }
+    }
+
+    /**
+     * @brief 写出不足一个字节的剩余位，高位补0
+     */
+    void flush() {
+        if (bits_ > 0) {
+            out_.push_back(static_cast<char>(acc_ & 0xFF));
+        }
+        acc_ = 0;
+        bits_ = 0;
+    }
+
+private:
+    std::vector<char>& out_;
+    uint64_t acc_ = 0;
+    unsigned bits_ = 0;
+};
+
+#endif // BIT_WRITER_H
@@ -0,0 +1,51 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief CRC32校验和（多项式0xEDB88320）
+ *
+ * 支持PCLMULQDQ的x86-64处理器上使用折叠算法，其他平台使用slice-by-16查表，
+ * 运行时自动选择，两种实现的结果完全相同。
+ *
+ * 校验和的初始值为INIT，把上一段的结果作为crc传入即可分段计算：
+ * update(b, m, update(a, n)) == update(ab, n + m)。
+ */
+class CRC32 {
+public:
+    static constexpr uint32_t INIT = 0xFFFFFFFF;
+
+    /**
+     * @brief 计算一段数据的校验和
+     * @param data 数据
+     * @param length 数据长度
+     * @param crc 之前数据的校验和，第一段使用INIT
+     * @return 包含本段数据在内的校验和
+     */
+    static uint32_t update(const char* data, size_t length, uint32_t crc = INIT);
+
+    /**
+     * @brief 合并相邻两段数据的校验和
+     *
+     * 各段可以在不同线程中独立计算，再按顺序合并得到整体的校验和。
+     * @param crc1 前一段的校验和
+     * @param crc2 后一段以INIT为初始值计算的校验和
+     * @param length2 后一段的长度
+     * @return 两段连接后的校验和，与update(crc2对应的数据, length2, crc1)相同
+     */
+    static uint32_t combine(uint32_t crc1, uint32_t crc2, uint64_t length2);
+
+    /**
+     * @brief 当前使用的实现名称，用于日志
+     */
+    static const char* implementation();
+
+    /**
+     * @brief 只使用查表实现计算校验和，用于测试各实现结果一致
+     */
+    static uint32_t update_portable(const char* data, size_t length, uint32_t crc = INIT);
+};
+
+#endif // CHECKSUM_H
@@ -0,0 +1,128 @@
+#ifndef CHUNK_STORE_H
+#define CHUNK_STORE_H
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+class FrameCodec;
+
+/**
+ * @brief 去重数据块存储
+ *
+ * 文件内容按Chunker切分后，每个不同的数据块只保存一次，以SHA-256作为标识，
+ * 多个备份可以共用同一个存储。存储目录中有两个文件：
+ *
+ *   chunks.dat   数据块依次追加，每块按存储创建时选择的压缩算法单独压缩
+ *   chunks.idx   StoreHeader + [标识 + 在chunks.dat中的位置 + 校验和] * N
+ *
+ * 两个文件都只追加：新数据块先写入chunks.dat，flush()时才把索引条目追加到chunks.idx，
+ * 中途失败只会在chunks.dat末尾留下未被引用的数据。写入时持有目录的排他锁，
+ * 同一时间只能有一个进程写入。
+ */
+class ChunkStore {
+public:
+    using ChunkId = std::array<unsigned char, 32>;
+    using StoreId = std::array<unsigned char, 16>;
+
+    /**
+     * @brief 打开存储
+     * @param dir 存储目录
+     * @param writable 是否写入，写入时目录不存在则创建新的存储
+     * @param codec 新建存储时使用的压缩算法(见Archive.h)，打开已有存储时忽略
+     * @param level 压缩级别，0表示算法默认级别
+     * @throw std::runtime_error 存储不存在（只读时）、格式错误或无法加锁时抛出
+     */
+    explicit ChunkStore(const fs::path& dir, bool writable = false, uint8_t codec = 0,
+                        int level = 0);
+    ~ChunkStore();
+
+    ChunkStore(const ChunkStore&) = delete;
+    ChunkStore& operator=(const ChunkStore&) = delete;
+
+    /**
+     * @brief 存储的随机标识，备份中记录该值以确认使用的是同一个存储
+     */
+    const StoreId& id() const { return id_; }
+
+    /**
+     * @brief 保存一个数据块，已存在时只返回标识，可以在多个线程中并发调用
+     * @return 数据块标识
+     */
+    ChunkId put(const char* data, size_t size);
+
+    /**
+     * @brief 读取数据块，解压并核对内容哈希，可以在多个线程中并发调用
+     * @param id 数据块标识
+     * @param out 输出数据块内容
+     * @throw std::runtime_error 数据块不存在或已损坏时抛出
+     */
+    void get(const ChunkId& id, std::vector<char>& out) const;
+
+    /**
+     * @brief 把新数据块同步到磁盘并写入索引，之后其他进程才能看到这些数据块
+     */
+    void flush();
+
+    /**
+     * @brief 存储中的数据块数量
+     */
+    size_t size() const;
+
+    /**
+     * @brief 本次打开后put()的统计
+     */
+    struct Stats {
+        uint64_t chunks_added = 0;   // 新保存的数据块数
+        uint64_t bytes_added = 0;    // 新保存的原始字节数
+        uint64_t chunks_reused = 0;  // 已存在而未重复保存的数据块数
+        uint64_t bytes_reused = 0;
+    };
+    Stats stats() const;
+
+private:
+    struct Location {
+        uint64_t offset;        // 在chunks.dat中的偏移
+        uint32_t stored_size;   // 压缩后的大小
+        uint32_t raw_size;      // 原始大小
+        uint32_t checksum;      // 存储数据的CRC32
+    };
+    struct ChunkIdHash {
+        size_t operator()(const ChunkId& id) const {
+            size_t value;
+            std::memcpy(&value, id.data(), sizeof(value));
+            return value;
+        }
+    };
+
+    bool writable_;
+    int index_fd_ = -1;
+    int data_fd_ = -1;
+    StoreId id_{};
+    uint64_t index_size_ = 0;            // chunks.idx中已写入的长度
+    uint64_t data_size_ = 0;             // chunks.dat中已写入的长度
+    std::unique_ptr<FrameCodec> codec_;
+    mutable std::mutex mutex_;
+    std::unordered_map<ChunkId, Location, ChunkIdHash> chunks_;
+    std::vector<std::pair<ChunkId, Location>> pending_;  // 尚未写入索引的数据块
+    Stats stats_;
+
+    void close_files();
+};
+
+/**
+ * @brief 文件引用的一个数据块
+ */
+struct ChunkRef {
+    ChunkStore::ChunkId id;
+    uint32_t size;
+};
+
+#endif // CHUNK_STORE_H
@@ -0,0 +1,29 @@
+#ifndef CHUNKER_H
+#define CHUNKER_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief 基于内容的分块（FastCDC）
+ *
+ * 用Gear滚动哈希在数据中寻找切分点，切分点只取决于附近的内容，
+ * 文件中间插入或删除数据后，其余部分仍然切分出相同的数据块，可以去重。
+ * 块长在MIN_SIZE到MAX_SIZE之间，采用归一化分块使块长集中在AVG_SIZE附近。
+ */
+class Chunker {
+public:
+    static constexpr size_t MIN_SIZE = 4 * 1024;
+    static constexpr size_t AVG_SIZE = 16 * 1024;
+    static constexpr size_t MAX_SIZE = 64 * 1024;
+
+    /**
+     * @brief 找出数据开头第一个块的长度
+     * @param data 数据
+     * @param size 数据长度，不足MAX_SIZE时视为数据在此结束
+     * @return 第一个块的长度，不超过size
+     */
+    static size_t next_boundary(const char* data, size_t size);
+};
+
+#endif // CHUNKER_H
@@ -0,0 +1,65 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @brief 数据块压缩算法接口
+ *
+ * 打包流水线把记录流按窗口切分成帧，每帧独立调用一次encode/decode，
+ * 因此编解码器只需处理单个数据块，内存占用由窗口大小决定。
+ * 编解码器的编号保存在ArchiveInfo::codec中，见Archive.h。
+ */
+class Codec {
+public:
+    virtual ~Codec() = default;
+
+    /**
+     * @brief 编码器编号
+     */
+    virtual uint8_t id() const = 0;
+
+    /**
+     * @brief 编码器名称，与--codec参数的取值一致
+     */
+    virtual const char* name() const = 0;
+
+    /**
+     * @brief 压缩一个数据块
+     * @param data 原始数据
+     * @param size 数据大小
+     * @param out 输出缓冲区，压缩结果追加在其后
+     */
+    virtual void encode(const char* data, size_t size, std::vector<char>& out) const = 0;
+
+    /**
+     * @brief 解压一个数据块
+     * @param data 压缩数据
+     * @param size 压缩数据大小
+     * @param raw_size 原始数据大小
+     * @param out 输出缓冲区，解压结果追加在其后
+     * @throw std::runtime_error 数据损坏时抛出
+     */
+    virtual void decode(const char* data, size_t size, size_t raw_size,
+                        std::vector<char>& out) const = 0;
+
+    /**
+     * @brief 根据编号创建编码器
+     * @param id 编码器编号
+     * @param level 压缩级别(1-9)，0表示使用该编码器的默认级别，解压时无需指定
+     * @throw std::runtime_error 编号未知或级别无效时抛出
+     */
+    static std::unique_ptr<Codec> Create(uint8_t id, int level = 0);
+
+    /**
+     * @brief 根据名称查找编码器编号
+     * @throw std::runtime_error 名称未知时抛出
+     */
+    static uint8_t IdFromName(const std::string& name);
+};
+
+#endif // CODEC_H
@@ -1,6 +1,10 @@
 #ifndef COMPRESSION_H
 #define COMPRESSION_H
 
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
 #include <string>
 #include <vector>
 #include <string_view>
@@ -15,13 +19,74 @@ namespace LZWCompression {
  */
 std::vector<char> compress(const std::string_view& data);
 
+/**
+ * @brief 增量式LZW解码器
+ *
+ * 压缩数据可以分多次通过feed()提供，解压结果分段交给输出回调，
+ * 内存占用固定（字典约0.5MB加输出缓冲区），与数据大小无关。
+ * 每个码字都会与当前字典大小比较，数据损坏时立即抛出异常，不会越界读写。
+ */
+class Decoder {
+public:
+    /**
+     * @brief 输出回调，每次收到一段解压后的数据
+     */
+    using Sink = std::function<void(const char* data, size_t size)>;
+
+    explicit Decoder(Sink sink);
+    ~Decoder();
+
+    Decoder(const Decoder&) = delete;
+    Decoder& operator=(const Decoder&) = delete;
+
+    /**
+     * @brief 提供下一段压缩数据
+     * @throw std::runtime_error 数据损坏或在数据结束后仍有多余输入时抛出
+     */
+    void feed(const char* data, size_t size);
+
+    /**
+     * @brief 结束输入，输出缓冲区中剩余的数据
+     * @throw std::runtime_error 压缩数据不完整时抛出
+     */
+    void finish();
+
+    /**
+     * @brief 是否已解出头部记录的全部数据
+     */
+    bool done() const;
+
+private:
+    struct State;
+    std::unique_ptr<State> state_;
+};
+
+/**
+ * @brief 解压缩数据，结果分段交给输出回调。
+ *
+ * @param data 压缩的数据（包含头部长度信息）
+ * @param sink 输出回调
+ * @throw std::runtime_error 数据损坏或不完整时抛出
+ */
+void decompress(std::span<const char> data, const Decoder::Sink& sink);
+
 /**
  * @brief 解压缩数据。
  * 
  * @param data 压缩的数据（包含头部长度信息）
  * @return std::vector<char> 解压后的数据
+ * @throw std::runtime_error 数据损坏或不完整时抛出
+ */
+std::vector<char> decompress(std::span<const char> data);
+
+/**
+ * @brief 解压旧版本的数据，旧版本的码字按int存储，只用于读取v1格式的备份。
+ *
+ * @param data 压缩的数据
+ * @param size 数据长度
+ * @return std::vector<char> 解压后的数据
  */
-std::vector<char> decompress(const char* data);
+std::vector<char> decompress_legacy(const char* data, size_t size);
 
 } // namespace LZWCompression
 
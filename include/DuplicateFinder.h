@@ -0,0 +1,48 @@
+#ifndef DUPLICATE_FINDER_H
+#define DUPLICATE_FINDER_H
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Manifest.h"
+
+/**
+ * @brief 查找一次备份中内容相同的文件
+ *
+ * 打包时依次登记普通文件，与之前登记的文件逐级比较：先比较大小，大小相同时比较
+ * 开头和结尾各PARTIAL_SIZE字节的CRC32，仍相同时才计算完整的SHA-256。
+ * 大多数文件只在大小上就能排除，不需要读取内容；两级哈希都只在需要时计算并缓存。
+ */
+class DuplicateFinder {
+public:
+    static constexpr uint64_t MIN_SIZE = 256;       // 更小的文件引用记录节省不了多少空间
+    static constexpr size_t PARTIAL_SIZE = 4096;
+
+    /**
+     * @brief 查找与文件内容相同的已登记文件
+     * @param path 文件路径
+     * @param size 文件大小
+     * @return 内容相同的已登记文件的路径；没有时登记该文件并返回空
+     */
+    std::optional<std::string> find_or_add(const std::string& path, uint64_t size);
+
+    uint64_t duplicates() const { return duplicates_; }        // 找到的重复文件数
+    uint64_t duplicate_bytes() const { return duplicate_bytes_; }  // 重复文件的总大小
+
+private:
+    struct Candidate {
+        std::string path;
+        std::optional<uint32_t> partial;            // 开头和结尾的CRC32
+        std::optional<ManifestEntry::Hash> full;    // 完整内容的SHA-256
+    };
+
+    std::unordered_map<uint64_t, std::vector<Candidate>> by_size_;
+    uint64_t duplicates_ = 0;
+    uint64_t duplicate_bytes_ = 0;
+
+    static uint32_t PartialHash(const std::string& path, uint64_t size);
+};
+
+#endif // DUPLICATE_FINDER_H
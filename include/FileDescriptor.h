@@ -0,0 +1,65 @@
+#ifndef FILE_DESCRIPTOR_H
+#define FILE_DESCRIPTOR_H
+
+#include <cstddef>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+/**
+ * @brief 打开的文件描述符，离开作用域时关闭
+ *
+ * 打包时读取源文件、恢复时写入文件都直接使用文件描述符按大块读写，
+ * 不经过文件流的缓冲区。出错时抛出std::runtime_error，消息中带有路径和错误原因。
+ */
+class FileDescriptor {
+public:
+    /**
+     * @brief 以只读方式打开要打包的文件，提示内核按顺序预读
+     */
+    static FileDescriptor OpenForRead(const fs::path& path);
+
+    /**
+     * @brief 创建要还原的文件，已存在时截断
+     */
+    static FileDescriptor Create(const fs::path& path);
+
+    FileDescriptor(FileDescriptor&& other) noexcept : fd_(other.fd_) { other.fd_ = -1; }
+    FileDescriptor(const FileDescriptor&) = delete;
+    FileDescriptor& operator=(const FileDescriptor&) = delete;
+    ~FileDescriptor();  // 未关闭时关闭文件，不报告错误
+
+    int get() const { return fd_; }
+
+    /**
+     * @brief 已读取的内容不再需要，丢弃其页缓存
+     */
+    void DropCache() const;
+
+    /**
+     * @brief 关闭写入的文件并检查错误，延迟的写入错误可能在关闭时才报告
+     */
+    void Close(const fs::path& path);
+
+private:
+    explicit FileDescriptor(int fd) : fd_(fd) {}
+    int fd_;
+};
+
+/**
+ * @brief 从文件描述符读取恰好size字节
+ * @throw std::runtime_error 读取出错，或文件提前结束（打包过程中文件被截短）时抛出
+ */
+void read_exact(int fd, char* data, size_t size, const fs::path& path);
+
+/**
+ * @brief 将数据完整写入文件描述符
+ */
+void write_all(int fd, const char* data, size_t size, const fs::path& path);
+
+/**
+ * @brief 删除已存在的同名文件（不跟随符号链接），不存在或是目录时忽略
+ */
+void remove_existing(const fs::path& path);
+
+#endif // FILE_DESCRIPTOR_H
@@ -1,16 +1,28 @@
 #ifndef FILE_HANDLER_H
 #define FILE_HANDLER_H
 
+#include <array>
 #include <filesystem>
-#include <fstream>
 #include <iostream>
+#include <optional>
 #include <sys/stat.h>
 #include <unordered_map>
+#include <vector>
+#include "ChunkStore.h"
 
 namespace fs = std::filesystem;
 
 constexpr std::size_t MAX_PATH_LEN = 100;
 
+// 删除标记的文件类型，取BSD中whiteout的值，不会与实际的文件类型冲突
+constexpr mode_t MODE_WHITEOUT = 0160000;
+
+// 内容保存在数据块存储中的普通文件，记录中只有数据块列表
+constexpr mode_t MODE_CHUNKED = 0110000;
+
+// 内容与备份中之前某个文件相同的普通文件，记录中只有该文件的路径
+constexpr mode_t MODE_DUPLICATE = 0130000;
+
 /**
  * @brief 文件头部结构，存储文件路径和元数据
  */
@@ -22,7 +34,7 @@ struct FileHeader {
 /**
  * @brief 文件处理基类，提供文件操作的基本接口
  */
-class FileHandler : public std::fstream {
+class FileHandler {
 public:
   // 默认构造函数
   FileHandler() = default;
@@ -36,42 +48,72 @@ public:
   /**
    * @brief 创建适当类型的文件处理器
    * @param path 文件路径
+   * @param store 数据块存储，不为空时普通文件的内容保存到存储中
    * @return 文件处理器的智能指针
    */
-  static std::unique_ptr<FileHandler> Create(const fs::path& path);
-  static std::unique_ptr<FileHandler> Create(const FileHeader &header);
+  static std::unique_ptr<FileHandler> Create(const fs::path& path, ChunkStore* store = nullptr);
+  static std::unique_ptr<FileHandler> Create(const FileHeader &header, ChunkStore* store = nullptr);
 
   /**
    * @brief 打包文件
    * @param backup_file 备份文件流
    * @param inode_table inode表，用于处理硬链接
    */
-  virtual void Pack(std::ofstream &backup_file,
+  virtual void Pack(std::ostream &backup_file,
                     std::unordered_map<ino_t, std::string> &inode_table) = 0;
   /**
    * @brief 解包文件
    * @param backup_file 备份文件流
    * @param restore_metadata 是否恢复元数据
    */
-  virtual void Unpack(std::ifstream &backup_file, bool restore_metadata = false) = 0;
+  virtual void Unpack(std::istream &backup_file, bool restore_metadata = false) = 0;
   virtual ~FileHandler() = default;
 
+  const FileHeader &getFileHeader() const;
+
+  // 读取可能超过MAX_PATH_LEN的路径
+  static std::string ReadLongPath(std::istream &backup_file);
+
+  // 恢复文件的权限、所有者和时间戳
+  static void RestoreMetadata(const fs::path& path, const struct stat& metadata);
+
+  /**
+   * @brief 记录类型对应的 ls -l 类型字符
+   *
+   * 保存在数据块存储中的文件和重复文件还原后都是普通文件，显示为'-'；删除标记为'w'。
+   */
+  static char TypeChar(mode_t mode);
+
+  /**
+   * @brief 打包时读完文件内容后提示内核丢弃其页缓存，避免备份大量数据时挤出其他缓存
+   */
+  void set_drop_cache(bool drop) { drop_cache_ = drop; }
+
+  using ContentHash = std::array<unsigned char, 32>;
+
+  /**
+   * @brief 打包普通文件时在读取内容的同时计算SHA-256，省去为清单再读一遍文件
+   */
+  void set_hash_content(bool hash) { hash_content_ = hash; }
+
+  /**
+   * @brief 打包时计算的内容哈希，未开启或没有读取文件内容（硬链接、重复文件）时为空
+   */
+  const std::optional<ContentHash> &content_hash() const { return content_hash_; }
+
 private:
-  FileHeader fileheader;
+  FileHeader fileheader{};
 
 protected:
+  bool drop_cache_ = false;
+  bool hash_content_ = false;
+  std::optional<ContentHash> content_hash_;
+
   bool IsHardLink() const;
-  bool OpenFile(std::ios_base::openmode mode_ = std::ios_base::in |
-                                                std::ios_base::binary);
-  const FileHeader &getFileHeader() const;
-  void WriteHeader(std::ofstream &backup_file) const;
+  void WriteHeader(std::ostream &backup_file) const;
 
   // 添加一个辅助函数来处理长路径
-  void WriteLongPath(std::ofstream &backup_file, const std::string &path) const;
-  // 读取可能超过MAX_PATH_LEN的路径
-  std::string ReadLongPath(std::ifstream &backup_file) const;
-
-  void RestoreMetadata(const fs::path& path, const struct stat& metadata) const;
+  void WriteLongPath(std::ostream &backup_file, const std::string &path) const;
 };
 
 class RegularFileHandler : public FileHandler {
@@ -80,9 +122,79 @@ public:
   RegularFileHandler(const fs::path &path) : FileHandler(path) {}
   RegularFileHandler(const FileHeader &header) : FileHandler(header) {}
 
-  void Pack(std::ofstream &backup_file,
+  void Pack(std::ostream &backup_file,
             std::unordered_map<ino_t, std::string> &inode_table) override;
-  void Unpack(std::ifstream &backup_file, bool restore_metadata = false) override;
+  void Unpack(std::istream &backup_file, bool restore_metadata = false) override;
+
+protected:
+  // 写入文件头和文件内容，硬链接已在Pack中处理
+  virtual void PackData(std::ostream &backup_file, const FileHeader &header);
+};
+
+/**
+ * @brief 内容保存在数据块存储中的普通文件
+ *
+ * 打包时按Chunker切分文件内容并存入存储，记录中只写入数据块列表：
+ * uint32数量 + [SHA-256 + uint32长度] * N，相同的数据块在各备份间只保存一次。
+ */
+class ChunkedFileHandler : public RegularFileHandler {
+public:
+  ChunkedFileHandler(const fs::path &path, ChunkStore &store)
+      : RegularFileHandler(path), store_(store) {}
+  ChunkedFileHandler(const FileHeader &header, ChunkStore &store)
+      : RegularFileHandler(header), store_(store) {}
+
+  void Unpack(std::istream &backup_file, bool restore_metadata = false) override;
+
+  /**
+   * @brief 读取记录中的数据块列表
+   * @param metadata 记录的元数据，各块长度之和必须等于文件大小
+   */
+  static std::vector<ChunkRef> ReadChunkList(std::istream &backup_file,
+                                             const struct stat &metadata);
+
+  /**
+   * @brief 从存储中读取一个数据块并检查长度
+   */
+  static void ReadChunk(const ChunkStore &store, const ChunkRef &chunk, std::vector<char> &out);
+
+protected:
+  void PackData(std::ostream &backup_file, const FileHeader &header) override;
+
+private:
+  ChunkStore &store_;
+};
+
+/**
+ * @brief 内容与备份中之前某个文件相同的普通文件
+ *
+ * 记录中只写入原文件的路径，格式与硬链接相同；还原时复制原文件的内容，
+ * 两者仍是互不影响的独立文件。
+ */
+class DuplicateFileHandler : public RegularFileHandler {
+public:
+  DuplicateFileHandler(const FileHeader &header, std::string original = {})
+      : RegularFileHandler(header), original_(std::move(original)) {}
+
+  void Unpack(std::istream &backup_file, bool restore_metadata = false) override;
+
+  /**
+   * @brief 复制已还原的文件
+   *
+   * 文件系统支持时共享数据块(reflink)，不占用额外空间；否则复制内容。
+   * @param source 原文件
+   * @param target 新文件，已存在时替换
+   */
+  static void CopyContent(const fs::path &source, const fs::path &target);
+
+  // 打包时内容相同的原文件
+  const std::string &original() const { return original_; }
+
+protected:
+  void PackData(std::ostream &backup_file, const FileHeader &header) override;
+
+private:
+  std::string original_;
 };
 
 class DirectoryHandler : public FileHandler {
@@ -91,9 +203,9 @@ public:
   DirectoryHandler(const fs::path &path) : FileHandler(path) {}
   DirectoryHandler(const FileHeader &header) : FileHandler(header) {}
 
-  void Pack(std::ofstream &backup_file,
+  void Pack(std::ostream &backup_file,
             std::unordered_map<ino_t, std::string> &inode_table) override;
-  void Unpack(std::ifstream &backup_file, bool restore_metadata = false) override;
+  void Unpack(std::istream &backup_file, bool restore_metadata = false) override;
 };
 
 class SymlinkHandler : public FileHandler {
@@ -102,9 +214,9 @@ public:
   SymlinkHandler(const fs::path &path) : FileHandler(path) {}
   SymlinkHandler(const FileHeader &header) : FileHandler(header) {}
 
-  void Pack(std::ofstream &backup_file,
+  void Pack(std::ostream &backup_file,
             std::unordered_map<ino_t, std::string> &inode_table) override;
-  void Unpack(std::ifstream &backup_file, bool restore_metadata = false) override;
+  void Unpack(std::istream &backup_file, bool restore_metadata = false) override;
 };
 
 class FIFOHandler : public FileHandler {
@@ -113,9 +225,26 @@ public:
     FIFOHandler(const fs::path &path) : FileHandler(path) {}
     FIFOHandler(const FileHeader &header) : FileHandler(header) {}
 
-    void Pack(std::ofstream &backup_file,
+    void Pack(std::ostream &backup_file,
+              std::unordered_map<ino_t, std::string> &inode_table) override;
+    void Unpack(std::istream &backup_file, bool restore_metadata = false) override;
+};
+
+/**
+ * @brief 删除标记，增量备份中表示基础备份里的该路径已被删除或改变了类型
+ */
+class WhiteoutHandler : public FileHandler {
+public:
+    WhiteoutHandler(const FileHeader &header) : FileHandler(header) {}
+
+    /**
+     * @brief 生成指定路径的删除标记
+     */
+    static FileHeader MakeHeader(const std::string &path);
+
+    void Pack(std::ostream &backup_file,
               std::unordered_map<ino_t, std::string> &inode_table) override;
-    void Unpack(std::ifstream &backup_file, bool restore_metadata = false) override;
+    void Unpack(std::istream &backup_file, bool restore_metadata = false) override;
 };
 
 #endif // FILE_HANDLER_H
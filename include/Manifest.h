@@ -0,0 +1,87 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <sys/stat.h>
+
+namespace fs = std::filesystem;
+
+/**
+ * @brief 清单中记录的一个文件
+ */
+struct ManifestEntry {
+    using Hash = std::array<unsigned char, 32>;
+
+    std::string path;
+    uint32_t mode = 0;      // 文件类型和权限
+    uint64_t inode = 0;
+    uint64_t size = 0;
+    int64_t mtime_ns = 0;   // 修改时间，纳秒
+    Hash hash{};            // 普通文件内容的SHA-256，其他类型全为0
+
+    /**
+     * @brief 由文件元数据生成条目，不计算内容哈希
+     */
+    static ManifestEntry FromStat(const std::string& path, const struct stat& metadata);
+
+    /**
+     * @brief 元数据是否表明文件未改变：类型和权限、inode、大小和修改时间都相同
+     */
+    bool same_metadata(const ManifestEntry& other) const;
+};
+
+/**
+ * @brief 备份清单，记录一次备份时源目录中每个文件的状态
+ *
+ * 增量备份时与上一次的清单比较，只打包新增或改变的文件，并找出已删除的文件。
+ * 文件格式（各字段按本机字节序）：
+ *
+ *   "BKMF" + uint16版本 + uint16保留 + uint64条目数
+ *   [uint16路径长度 + 路径 + uint32 mode + uint64 inode + uint64 size
+ *    + int64 mtime_ns + 32字节hash] * N
+ *   uint32 CRC32           之前所有字节的校验和
+ */
+class Manifest {
+public:
+    /**
+     * @brief 添加或替换一个条目
+     */
+    void add(ManifestEntry entry);
+
+    /**
+     * @brief 按路径查找条目，不存在时返回nullptr
+     */
+    const ManifestEntry* find(const std::string& path) const;
+
+    /**
+     * @brief 全部条目，按路径排序
+     */
+    const std::map<std::string, ManifestEntry>& entries() const { return entries_; }
+
+    /**
+     * @brief 保存清单，先写入临时文件再替换，中途失败不会破坏已有的清单
+     * @throw std::runtime_error 写入失败时抛出
+     */
+    void Save(const fs::path& path) const;
+
+    /**
+     * @brief 读取清单
+     * @throw std::runtime_error 文件无法读取、格式错误或校验和不一致时抛出
+     */
+    static Manifest Load(const fs::path& path);
+
+    /**
+     * @brief 计算文件内容的SHA-256
+     * @throw std::runtime_error 文件无法读取时抛出
+     */
+    static ManifestEntry::Hash HashFile(const fs::path& path);
+
+private:
+    std::map<std::string, ManifestEntry> entries_;
+};
+
+#endif // MANIFEST_H
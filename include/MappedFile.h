@@ -0,0 +1,50 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <filesystem>
+#include <span>
+
+/**
+ * @brief 只读内存映射的文件
+ *
+ * 整个文件映射到进程地址空间，多个线程可以直接并发读取不同区域，
+ * 由内核按需调页，不需要额外的读缓冲区。
+ */
+class MappedFile {
+public:
+    /**
+     * @brief 打开并映射文件
+     * @param path 文件路径
+     * @throw std::runtime_error 文件无法打开或映射时抛出
+     */
+    explicit MappedFile(const std::filesystem::path& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+    /**
+     * @brief 取文件中的一段，超出文件范围时抛出std::runtime_error
+     */
+    std::span<const char> range(size_t offset, size_t length) const;
+
+    /**
+     * @brief 提示内核将按顺序访问，以便提前预读
+     */
+    void advise_sequential() const;
+
+    /**
+     * @brief 提示内核即将访问[offset, offset + length)，提前读入，超出文件的部分忽略
+     */
+    void advise_willneed(size_t offset, size_t length) const;
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+#endif // MAPPED_FILE_H
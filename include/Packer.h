@@ -5,14 +5,65 @@
 #include <string>
 #include <unordered_map>
 #include <functional>
+#include <optional>
 #include <ctime>
 #include <cstdint>
+#include <thread>
+#include <vector>
 #include "FileHandler.h"
+#include "Archive.h"
+#include "Pipeline.h"
 #include "spdlog/spdlog.h"
 #include "AES.h"
 
 namespace fs = std::filesystem;
 
+class ArchiveStream;
+class MappedFile;
+class Manifest;
+class ChunkStore;
+
+/**
+ * @brief 验证结果
+ */
+struct VerifyReport {
+    /**
+     * @brief 一段损坏的数据
+     */
+    struct Damage {
+        uint64_t offset;                 // 在备份文件中的偏移
+        uint64_t size;                   // 长度
+        int64_t frame;                   // 数据帧编号，等于帧数量时为索引帧
+        std::vector<std::string> files;  // 受影响的文件，无法读取索引时为空
+    };
+
+    /**
+     * @brief 深度验证中发现问题的文件
+     */
+    struct FileError {
+        std::string path;
+        std::string error;
+    };
+
+    bool checksum_ok = false;            // 整体校验和是否与文件头一致
+    std::vector<Damage> damaged;         // 校验失败的数据帧，按偏移排列
+    uint64_t files_checked = 0;          // 深度验证中完好的文件数
+    std::vector<FileError> file_errors;  // 深度验证中发现问题的文件，按备份中的顺序排列
+};
+
+/**
+ * @brief 验证时单独计算校验和的一段数据
+ */
+struct VerifySegment {
+    static constexpr int64_t NO_FRAME = -1;
+    uint64_t offset;
+    uint64_t size;
+    int64_t frame;          // 数据帧编号，NO_FRAME表示帧头、格式信息等其他数据
+    uint32_t expected;      // 帧头中记录的校验和
+    bool consistent;        // 帧头与索引中记录的校验和是否一致
+    uint32_t crc;           // 计算得到的校验和
+};
+
 class Packer {
 private:
     static constexpr size_t COMMENT_SIZE = 256;
@@ -26,12 +77,32 @@ private:
     // 定义标志位
     static constexpr unsigned char MOD_COMPRESSED = 0x01;  // 0000 0001
     static constexpr unsigned char MOD_ENCRYPTED = 0x02;   // 0000 0010
+    static constexpr unsigned char MOD_FRAMED = 0x04;      // 0000 0100 v2分帧格式，见Archive.h
+
+    // 流水线默认窗口大小
+    static constexpr size_t DEFAULT_WINDOW_SIZE = 4 * 1024 * 1024;
+    // 验证时并行计算校验和的单位
+    static constexpr size_t VERIFY_CHUNK_SIZE = 8 * 1024 * 1024;
+    // 线程数上限
+    static constexpr unsigned MAX_THREADS = 1024;
 
     std::unordered_map<ino_t, std::string> inode_table;
     bool restore_metadata_ = false;
-    bool compress_ = false;              // 是否启用压缩
+    uint8_t codec_ = CODEC_NONE;         // 压缩算法，CODEC_NONE表示不压缩
+    int level_ = 0;                      // 压缩级别，0表示算法默认级别
     bool encrypt_ = false;               // 是否启用加密
-    std::unique_ptr<AESModule> aes_;    // AES加密模块
+    size_t window_size_ = DEFAULT_WINDOW_SIZE;  // 流水线窗口大小
+    unsigned threads_ = 1;               // 打包/解包线程数
+    bool deep_verify_ = false;           // 验证时是否解码并检查每个文件
+    uint8_t kdf_ = KDF_PBKDF2;           // 新备份的密钥派生方式
+    uint32_t kdf_cost_ = 0;              // 密钥派生强度，0表示默认值
+    std::shared_ptr<const KeyHandle> key_;  // 密钥句柄，未设置密码时为空
+    fs::path manifest_path_;             // 打包后写入清单的路径，为空表示不写
+    fs::path base_manifest_;             // 增量备份的基础清单，为空表示完整备份
+    fs::path store_path_;                // 数据块存储目录，为空表示文件数据保存在备份中
+    std::shared_ptr<ChunkStore> store_;  // 操作期间打开的数据块存储
+    bool dedup_files_ = false;           // 内容相同的文件是否只保存一次
+    bool direct_io_ = false;             // 备份文件是否以直接I/O写入
     BackupHeader backup_header_;
 
     using FileFilter = std::function<bool(const fs::path&)>;
@@ -39,8 +110,47 @@ private:
 
     // 私有辅助函数
     uint32_t calculateCRC32(const char* data, size_t length, uint32_t crc = 0xFFFFFFFF) const;
-    bool PackToFile(const fs::path& source_path, const fs::path& target_path);
-    bool UnpackFromFile(const fs::path& backup_path, const fs::path& restore_path);
+    bool PackToStream(const fs::path& source_path, std::ostream& backup_file,
+                      std::vector<IndexEntry>& entries, const Manifest* base, Manifest* snapshot);
+    void PackParallel(const fs::path& source_path, std::ostream& backup_file,
+                      std::vector<IndexEntry>& entries, const Manifest* base, Manifest* snapshot);
+    bool SelectForPack(const FileHeader& header, const Manifest* base, Manifest& carried,
+                       bool& replaced) const;
+    void WriteWhiteout(std::ostream& backup_file, const std::string& path,
+                       std::vector<IndexEntry>& entries);
+    void WriteDeletions(std::ostream& backup_file, const Manifest& base, const Manifest& snapshot,
+                        std::vector<IndexEntry>& entries);
+    IndexEntry MakeIndexEntry(const FileHeader& header, uint64_t begin, uint64_t end) const;
+    void AddToSnapshot(Manifest& snapshot, const FileHeader& header,
+                       const std::optional<FileHandler::ContentHash>& hash,
+                       const std::string& original) const;
+    std::unique_ptr<ArchiveStream> OpenBackup(const fs::path& backup_path,
+                                              BackupHeader& header) const;
+    void ReadArchiveInfo(std::istream& backup_file, ArchiveInfo& info, ArchiveTrailer& trailer) const;
+    const AESModule* CipherModule(const ArchiveInfo& info) const;
+    void CheckChunkStore(const ArchiveInfo& info) const;
+    void ReadStoredFrame(std::istream& backup_file, FrameHeader& header,
+                         std::vector<char>& stored) const;
+    std::vector<char> DecodeFrame(const FrameCodec& codec, const FrameHeader& header,
+                                  std::vector<char> stored, uint64_t number) const;
+    void ReadFrame(std::istream& backup_file, const FrameCodec& codec, uint64_t number,
+                   std::vector<char>& frame) const;
+    ArchiveIndex ReadIndex(std::istream& backup_file, const ArchiveTrailer& trailer,
+                           const FrameCodec& codec) const;
+    std::vector<VerifySegment> LocateFrames(const fs::path& backup_path, const MappedFile& archive,
+                                            std::vector<IndexEntry>& entries, uint32_t& frame_size,
+                                            VerifyReport& report) const;
+    void VerifyRecords(const fs::path& backup_path, VerifyReport& report) const;
+    ChunkReader::ChunkSource MakeFrameSource(std::istream& backup_file, const FrameCodec& codec,
+                                             uint64_t first, uint64_t frames) const;
+    ChunkReader::ChunkSource MakeRecordSource(std::istream& backup_file,
+                                              const BackupHeader& header) const;
+    SpanReader::SpanSource MakeMappedSource(const fs::path& backup_path, std::istream& backup_file,
+                                            const BackupHeader& header) const;
+    size_t ExtractFramed(std::istream& backup_file, const std::vector<std::string>& patterns);
+    size_t ExtractFromStream(std::istream& backup_file, const std::vector<std::string>& patterns);
+    bool UnpackFromStream(std::istream& backup_file, const fs::path& project_dir);
+    void UnpackParallel(std::istream& backup_file);
 
 public:
     /**
@@ -78,8 +188,21 @@ public:
      * @param compress true表示启用压缩，false表示不压缩
      */
     void set_compress(bool compress) { 
-        compress_ = compress;
-        if (compress) {
+        set_codec(compress ? CODEC_LZW : CODEC_NONE);
+    }
+
+    /**
+     * @brief 设置压缩算法
+     * @param codec 算法编号(见Archive.h)，CODEC_NONE表示不压缩
+     * @param level 压缩级别(1-9)，0表示使用算法的默认级别
+     */
+    void set_codec(uint8_t codec, int level = 0) {
+        if (level < 0 || level > 9) {
+            throw std::runtime_error("压缩级别必须在0到9之间");
+        }
+        codec_ = codec;
+        level_ = level;
+        if (codec != CODEC_NONE) {
             backup_header_.mod |= MOD_COMPRESSED;
         } else {
             backup_header_.mod &= ~MOD_COMPRESSED;
@@ -88,20 +211,130 @@ public:
 
     /**
      * @brief 设置是否加密备份文件
+     *
+     * 密钥在第一次使用时才派生；密码和派生设置不变时重复调用会保留已派生的密钥。
      * @param encrypt true表示启用加密，false表示不加密
      * @param password 加密密码
      */
     void set_encrypt(bool encrypt, const std::string& password) {
-        encrypt_ = encrypt;
         if (encrypt) {
-            aes_ = std::make_unique<AESModule>(password);
+            if (!key_ || !key_->matches(password, kdf_, kdf_cost_)) {
+                key_ = std::make_shared<KeyHandle>(password, kdf_, kdf_cost_);
+            }
+            set_key(key_);
+        } else {
+            set_key(nullptr);
+        }
+    }
+
+    /**
+     * @brief 使用已有的密钥句柄加密/解密
+     *
+     * 批量任务中多个Packer共享同一个句柄时，密钥只派生一次。
+     * @param key 密钥句柄，为空表示不加密
+     */
+    void set_key(std::shared_ptr<const KeyHandle> key) {
+        key_ = std::move(key);
+        encrypt_ = key_ != nullptr;
+        if (encrypt_) {
             backup_header_.mod |= MOD_ENCRYPTED;
         } else {
-            aes_.reset();
             backup_header_.mod &= ~MOD_ENCRYPTED;
         }
     }
 
+    /**
+     * @brief 设置新备份的密钥派生方式，在set_encrypt之前调用
+     * @param algorithm KDF_PBKDF2或KDF_SCRYPT
+     * @param cost PBKDF2的迭代次数或scrypt的log2(N)，0表示默认值
+     */
+    void set_kdf(uint8_t algorithm, uint32_t cost = 0) {
+        kdf_ = algorithm;
+        kdf_cost_ = cost;
+    }
+
+    /**
+     * @brief 设置流水线窗口大小
+     * @param size 每次压缩/加密处理的数据块大小，决定打包时的内存上限
+     */
+    void set_window_size(size_t size) {
+        if (size == 0) {
+            throw std::runtime_error("窗口大小不能为0");
+        }
+        if (size > UINT32_MAX) {
+            throw std::runtime_error("窗口大小不能超过4GB");
+        }
+        window_size_ = size;
+    }
+
+    /**
+     * @brief 设置打包/解包使用的线程数
+     *
+     * 多线程时文件读写和数据帧的编解码都会并行进行，帧仍按顺序写出，
+     * 因此数据帧与单线程时相同。
+     * @param threads 线程数，0表示使用CPU核心数，1表示单线程，超过MAX_THREADS时按MAX_THREADS
+     */
+    void set_threads(unsigned threads) {
+        threads_ = threads != 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+        threads_ = std::min(threads_, MAX_THREADS);
+    }
+
+    /**
+     * @brief 设置是否进行深度验证
+     *
+     * 深度验证在校验和之外完整解密、解压备份，逐条检查文件记录能否正确解析，
+     * 数据只在内存中流过，不写入磁盘。加密的备份需要先设置密码。
+     * @param deep true表示深度验证
+     */
+    void set_deep_verify(bool deep) { deep_verify_ = deep; }
+
+    /**
+     * @brief 设置打包后写入清单的路径
+     *
+     * 清单记录每个文件的inode、大小、修改时间和内容哈希，供之后的增量备份比较。
+     * @param path 清单路径，为空表示不写清单
+     */
+    void set_manifest(const fs::path& path) { manifest_path_ = path; }
+
+    /**
+     * @brief 设置增量备份的基础清单
+     *
+     * 只打包相对基础清单新增或改变的文件，基础清单中已不存在（包括被过滤器排除）的
+     * 路径写入删除标记。恢复时依次应用基础备份和各次增量备份，即得到本次备份时的状态。
+     * @param base_manifest 上一次备份写出的清单，为空表示完整备份
+     */
+    void set_incremental(const fs::path& base_manifest) { base_manifest_ = base_manifest; }
+
+    /**
+     * @brief 设置数据块存储目录
+     *
+     * 打包时普通文件按内容切分成数据块存入该目录，相同的数据块只保存一次，
+     * 备份中只记录数据块列表；恢复、提取和深度验证这样的备份时需要指定同一个目录。
+     * 存储本身不加密，不能与加密同时使用。
+     * @param dir 存储目录，不存在时打包会创建；为空表示不使用存储
+     */
+    void set_chunk_store(const fs::path& dir) {
+        store_path_ = dir.empty() ? dir : fs::absolute(dir);
+    }
+
+    /**
+     * @brief 设置是否合并内容相同的文件
+     *
+     * 打包时按大小、部分内容的CRC32和完整内容的SHA-256逐级比较，内容与之前打包的
+     * 文件相同时只记录该文件的路径。还原时复制原文件（文件系统支持时使用reflink），
+     * 得到互不影响的独立文件。
+     * @param dedup true表示合并
+     */
+    void set_dedup_files(bool dedup) { dedup_files_ = dedup; }
+
+    /**
+     * @brief 设置备份时是否使用直接I/O
+     *
+     * 启用时备份文件以O_DIRECT写入，不经过页缓存，源文件读完后也丢弃其页缓存，
+     * 备份大量数据时不挤出系统中其他程序的缓存；文件系统不支持时使用普通写入。
+     */
+    void set_direct_io(bool direct) { direct_io_ = direct; }
+
     /**
      * @brief 执行文件备份操作
      * @param source_path 源文件或目录路径
@@ -118,12 +351,51 @@ public:
      */
     bool Unpack(const fs::path& backup_path, const fs::path& restore_path);
 
+    /**
+     * @brief 依次还原基础备份和之后的增量备份
+     *
+     * 所有备份都还原到以基础备份命名的目录中，增量备份中的删除标记会删除之前还原的文件。
+     * @param chain 基础备份在前，增量备份按生成顺序排列
+     * @param restore_path 还原目标路径
+     * @return 还原是否成功
+     */
+    bool Unpack(const std::vector<fs::path>& chain, const fs::path& restore_path);
+
+    /**
+     * @brief 从备份中提取部分文件
+     * @param backup_path 备份文件路径
+     * @param patterns 路径匹配模式(glob)，匹配到目录时提取目录下的所有文件
+     * @param restore_path 还原目标路径
+     * @return 提取是否成功，没有匹配的文件时返回false
+     */
+    bool Extract(const fs::path& backup_path, const std::vector<std::string>& patterns,
+                 const fs::path& restore_path);
+
+    /**
+     * @brief 列出备份中的文件，不解码文件数据
+     * @param backup_path 备份文件路径
+     * @param entries 输出每个文件的路径和元数据，按备份中的顺序排列
+     * @return 读取是否成功
+     */
+    bool List(const fs::path& backup_path, std::vector<IndexEntry>& entries);
+
     /**
      * @brief 验证备份文件的完整性
      * @param backup_path 备份文件路径
      * @return 验证是否通过
      */
     bool Verify(const fs::path& backup_path);
+
+    /**
+     * @brief 验证备份文件的完整性，并报告损坏的位置
+     *
+     * 备份文件映射到内存，按set_threads设置的线程数分段并行计算校验和。
+     * v2格式逐帧校验，设置了密码（或未加密）时还能从索引得出受影响的文件。
+     * @param backup_path 备份文件路径
+     * @param report 输出验证结果
+     * @return 验证是否通过
+     */
+    bool Verify(const fs::path& backup_path, VerifyReport& report);
 };
 
 #endif // PACKER_H
@@ -0,0 +1,126 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <streambuf>
+#include <vector>
+
+/**
+ * @brief 分块输出缓冲区
+ *
+ * 将写入的字节流按固定窗口大小切分成块，每满一块就交给处理函数
+ * （压缩、加密、校验、写盘），内存占用与数据总量无关，只取决于窗口大小。
+ * 除最后一块外，每块大小都恰好等于窗口大小。
+ */
+class ChunkWriter : public std::streambuf {
+public:
+    using ChunkHandler = std::function<void(const char* data, size_t size)>;
+
+    /**
+     * @brief 构造函数
+     * @param chunk_size 窗口大小（字节）
+     * @param handler 每个数据块的处理函数
+     */
+    ChunkWriter(size_t chunk_size, ChunkHandler handler);
+
+    /**
+     * @brief 将缓冲区中剩余的数据作为最后一块交给处理函数
+     */
+    void finish();
+
+    /**
+     * @brief 已写入的总字节数
+     */
+    uint64_t position() const { return emitted_ + (pptr() - pbase()); }
+
+protected:
+    int_type overflow(int_type ch) override;
+    std::streamsize xsputn(const char* s, std::streamsize n) override;
+    // 只支持查询当前位置（tellp）
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                     std::ios_base::openmode which) override;
+
+private:
+    void emit();
+
+    std::vector<char> buffer_;
+    ChunkHandler handler_;
+    uint64_t emitted_ = 0;
+};
+
+/**
+ * @brief 分块输入缓冲区
+ *
+ * 与ChunkWriter相对，按需从数据源拉取下一个已解码的数据块，
+ * 使解包过程可以像读普通文件一样顺序读取，而无需把整个备份读入内存。
+ */
+class ChunkReader : public std::streambuf {
+public:
+    /**
+     * @brief 数据源函数，将下一个数据块写入参数中
+     * @return 没有更多数据时返回false
+     */
+    using ChunkSource = std::function<bool(std::vector<char>& chunk)>;
+
+    explicit ChunkReader(ChunkSource source);
+
+    /**
+     * @brief 已读取的总字节数
+     */
+    uint64_t position() const { return consumed_ + (gptr() - eback()); }
+
+protected:
+    int_type underflow() override;
+    // 只支持查询当前位置（tellg）
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                     std::ios_base::openmode which) override;
+
+private:
+    std::vector<char> buffer_;
+    ChunkSource source_;
+    uint64_t consumed_ = 0;
+};
+
+/**
+ * @brief 内存区域输入缓冲区
+ *
+ * 与ChunkReader相同按需拉取下一段数据，但数据源给出的是已在内存中的区域(如映射的备份文件)，
+ * 读取区直接指向这些内存，不复制到缓冲区。take可以直接取得当前位置的数据，
+ * 写文件时连一次复制也不需要。数据源给出的内存须在读取完之前保持有效。
+ */
+class SpanReader : public std::streambuf {
+public:
+    /**
+     * @brief 数据源函数，将下一段数据的位置写入参数中
+     * @return 没有更多数据时返回false
+     */
+    using SpanSource = std::function<bool(std::span<const char>& span)>;
+
+    explicit SpanReader(SpanSource source);
+
+    /**
+     * @brief 已读取的总字节数
+     */
+    uint64_t position() const { return consumed_ + (gptr() - eback()); }
+
+    /**
+     * @brief 取当前位置开始、不超过size字节的连续数据并越过这些数据
+     * @return 指向数据源内存的区域，已到达末尾时为空
+     */
+    std::span<const char> take(size_t size);
+
+protected:
+    int_type underflow() override;
+    // 只支持查询当前位置（tellg）
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                     std::ios_base::openmode which) override;
+
+private:
+    SpanSource source_;
+    uint64_t consumed_ = 0;
+};
+
+#endif // PIPELINE_H
@@ -3,126 +3,324 @@
 #include <openssl/evp.h>
 #include <openssl/err.h>
 #include <openssl/kdf.h>
+#include <openssl/rand.h>
+#include <algorithm>
+#include <memory>
 #include <stdexcept>
 
-AESModule::AESModule(const std::string& password) {
-    auto [derived_key, derived_iv] = derive_key_iv(password);
+namespace {
+// 旧版备份使用的派生参数
+constexpr unsigned char LEGACY_SALT[] = "BackupManagerSalt";
+constexpr int LEGACY_ITERATIONS = 10000;
+
+// 参数范围，读取备份时同样检查，避免损坏的备份导致长时间计算或耗尽内存
+constexpr uint32_t MIN_PBKDF2_ITERATIONS = 1000;
+constexpr uint32_t MAX_PBKDF2_ITERATIONS = 100000000;
+constexpr uint32_t MIN_SCRYPT_COST = 10;
+constexpr uint32_t MAX_SCRYPT_COST = 20;  // N = 2^20，约占用1GB内存
+constexpr uint64_t SCRYPT_R = 8;
+constexpr uint64_t SCRYPT_P = 1;
+
+void check_kdf_params(const KdfParams& params) {
+    switch (params.algorithm) {
+    case KDF_LEGACY:
+        return;
+    case KDF_PBKDF2:
+        if (params.cost < MIN_PBKDF2_ITERATIONS || params.cost > MAX_PBKDF2_ITERATIONS) {
+            throw std::runtime_error("PBKDF2迭代次数必须在" + std::to_string(MIN_PBKDF2_ITERATIONS) +
+                                     "到" + std::to_string(MAX_PBKDF2_ITERATIONS) + "之间");
+        }
+        return;
+    case KDF_SCRYPT:
+        if (params.cost < MIN_SCRYPT_COST || params.cost > MAX_SCRYPT_COST) {
+            throw std::runtime_error("scrypt强度必须在" + std::to_string(MIN_SCRYPT_COST) + "到" +
+                                     std::to_string(MAX_SCRYPT_COST) + "之间");
+        }
+        return;
+    default:
+        throw std::runtime_error("不支持的密钥派生方式: " + std::to_string(params.algorithm));
+    }
+}
+} // namespace
+
+AESModule::AESModule(const std::string& password) : AESModule(password, KdfParams{}) {}
+
+AESModule::AESModule(const std::string& password, const KdfParams& params) {
+    auto [derived_key, derived_iv] = derive_key_iv(password, params);
     key_ = derived_key;
     iv_ = derived_iv;
 }
 
-std::pair<AESModule::KeyType, AESModule::IVType> 
-AESModule::derive_key_iv(const std::string& password) {
+std::pair<AESModule::KeyType, AESModule::IVType>
+AESModule::derive_key_iv(const std::string& password, const KdfParams& params) {
+    check_kdf_params(params);
     KeyType key;
     IVType iv;
-    
-    // 使用 PBKDF2 从密码派生密钥和IV
-    const unsigned char salt[] = "BackupManagerSalt";  // 固定盐值
-    const int iterations = 10000;  // 迭代次数
-
-    if (!PKCS5_PBKDF2_HMAC(password.c_str(), password.length(),
-                          salt, sizeof(salt) - 1,
-                          iterations,
-                          EVP_sha256(),
-                          KEY_SIZE + IV_SIZE,
-                          key.data())) {
+    std::array<unsigned char, KEY_SIZE + IV_SIZE> derived;
+
+    int result = 0;
+    switch (params.algorithm) {
+    case KDF_LEGACY:
+        result = PKCS5_PBKDF2_HMAC(password.c_str(), password.length(),
+                                   LEGACY_SALT, sizeof(LEGACY_SALT) - 1,
+                                   LEGACY_ITERATIONS, EVP_sha256(),
+                                   derived.size(), derived.data());
+        break;
+    case KDF_PBKDF2:
+        result = PKCS5_PBKDF2_HMAC(password.c_str(), password.length(),
+                                   params.salt.data(), params.salt.size(),
+                                   static_cast<int>(params.cost), EVP_sha256(),
+                                   derived.size(), derived.data());
+        break;
+    case KDF_SCRYPT: {
+        const uint64_t n = uint64_t{1} << params.cost;
+        // 所需内存约为 128 * r * N，留出余量
+        const uint64_t max_memory = 2 * 128 * SCRYPT_R * n;
+        result = EVP_PBE_scrypt(password.c_str(), password.length(),
+                                params.salt.data(), params.salt.size(),
+                                n, SCRYPT_R, SCRYPT_P, max_memory,
+                                derived.data(), derived.size());
+        break;
+    }
+    }
+    if (!result) {
         throw std::runtime_error("密钥派生失败");
     }
 
-    // 复制IV（从密钥数据之后的部分）
-    std::copy_n(key.data() + KEY_SIZE, IV_SIZE, iv.data());
+    // 前半部分为密钥，之后的部分为IV
+    std::copy_n(derived.data(), KEY_SIZE, key.data());
+    std::copy_n(derived.data() + KEY_SIZE, IV_SIZE, iv.data());
 
     return {key, iv};
 }
 
-std::vector<char> AESModule::encrypt(const std::string_view& data) {
-    // 分配加密后的缓冲区
-    std::vector<char> ciphertext(data.size() + EVP_MAX_BLOCK_LENGTH);
-    int ciphertext_len = 0;
+AESModule AESModule::derive(std::span<const uint8_t> nonce) const {
+    static constexpr unsigned char LABEL[] = "BackupManager archive key";
+    std::unique_ptr<EVP_PKEY_CTX, decltype(&EVP_PKEY_CTX_free)> ctx(
+        EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, nullptr), EVP_PKEY_CTX_free);
+    std::array<unsigned char, KEY_SIZE + IV_SIZE> derived;
+    size_t length = derived.size();
+    if (!ctx || EVP_PKEY_derive_init(ctx.get()) <= 0 ||
+        EVP_PKEY_CTX_set_hkdf_md(ctx.get(), EVP_sha256()) <= 0 ||
+        EVP_PKEY_CTX_set1_hkdf_salt(ctx.get(), nonce.data(), nonce.size()) <= 0 ||
+        EVP_PKEY_CTX_set1_hkdf_key(ctx.get(), key_.data(), key_.size()) <= 0 ||
+        EVP_PKEY_CTX_add1_hkdf_info(ctx.get(), LABEL, sizeof(LABEL) - 1) <= 0 ||
+        EVP_PKEY_derive(ctx.get(), derived.data(), &length) <= 0 || length != derived.size()) {
+        throw std::runtime_error("子密钥派生失败");
+    }
 
-    if (!encryptData(reinterpret_cast<const unsigned char*>(data.data()), 
-                    data.size(), 
-                    reinterpret_cast<unsigned char*>(ciphertext.data()), 
-                    ciphertext_len)) {
-        throw std::runtime_error("加密失败");
+    KeyType key;
+    IVType iv;
+    std::copy_n(derived.data(), KEY_SIZE, key.data());
+    std::copy_n(derived.data() + KEY_SIZE, IV_SIZE, iv.data());
+    return AESModule(key, iv);
+}
+
+KeyHandle::KeyHandle(std::string password, uint8_t algorithm, uint32_t cost)
+    : password_(std::move(password)) {
+    if (algorithm != KDF_PBKDF2 && algorithm != KDF_SCRYPT) {
+        throw std::runtime_error("不支持的密钥派生方式: " + std::to_string(algorithm));
     }
+    params_.algorithm = algorithm;
+    if (cost == 0) {
+        cost = algorithm == KDF_SCRYPT ? KdfParams::DEFAULT_SCRYPT_COST
+                                       : KdfParams::DEFAULT_PBKDF2_ITERATIONS;
+    }
+    params_.cost = cost;
+    check_kdf_params(params_);
+    if (1 != RAND_bytes(params_.salt.data(), params_.salt.size())) {
+        throw std::runtime_error("生成随机数失败");
+    }
+}
 
-    // 调整到实际大小
-    ciphertext.resize(ciphertext_len);
-    return ciphertext;
+bool KeyHandle::matches(const std::string& password, uint8_t algorithm, uint32_t cost) const {
+    if (cost == 0) {
+        cost = algorithm == KDF_SCRYPT ? KdfParams::DEFAULT_SCRYPT_COST
+                                       : KdfParams::DEFAULT_PBKDF2_ITERATIONS;
+    }
+    return password == password_ && algorithm == params_.algorithm && cost == params_.cost;
+}
+
+const AESModule& KeyHandle::module(const KdfParams& params) const {
+    // 派生期间持有锁，其他线程请求同一组参数时等待结果而不是重复派生
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& entry = cache_[params];
+    if (!entry) {
+        entry = std::make_unique<AESModule>(password_, params);
+    }
+    return *entry;
 }
 
-std::vector<char> AESModule::decrypt(const char* data, size_t size) {
-    // 分配解密后的缓冲区
-    std::vector<char> plaintext(size);
-    int plaintext_len = 0;
+uint8_t KeyHandle::KdfFromName(const std::string& name) {
+    if (name == "pbkdf2") {
+        return KDF_PBKDF2;
+    }
+    if (name == "scrypt") {
+        return KDF_SCRYPT;
+    }
+    throw std::runtime_error("未知的密钥派生方式: " + name);
+}
 
-    if (!decryptData(reinterpret_cast<const unsigned char*>(data), 
-                    size, 
-                    reinterpret_cast<unsigned char*>(plaintext.data()), 
-                    plaintext_len)) {
-        throw std::runtime_error("解密失败");
+namespace {
+// EVP接口的长度参数是int，超长数据按该大小分段处理（分组大小的整数倍）
+constexpr size_t MAX_UPDATE_SIZE = size_t{1} << 30;
+
+void cipher_init(EVP_CIPHER_CTX* ctx, const EVP_CIPHER* cipher, const unsigned char* key,
+                 const unsigned char* iv, bool encrypt) {
+    if (1 != EVP_CipherInit_ex(ctx, cipher, nullptr, key, iv, encrypt ? 1 : 0)) {
+        throw std::runtime_error(encrypt ? "加密失败" : "解密失败");
     }
+}
 
-    // 调整到实际大小
-    plaintext.resize(plaintext_len);
-    return plaintext;
+size_t cipher_update(EVP_CIPHER_CTX* ctx, std::span<const char> in, char* out, bool encrypt) {
+    size_t written = 0;
+    while (!in.empty()) {
+        const size_t piece = std::min(in.size(), MAX_UPDATE_SIZE);
+        int length = 0;
+        if (1 != EVP_CipherUpdate(ctx, reinterpret_cast<unsigned char*>(out + written), &length,
+                                  reinterpret_cast<const unsigned char*>(in.data()),
+                                  static_cast<int>(piece))) {
+            throw std::runtime_error(encrypt ? "加密失败" : "解密失败");
+        }
+        written += length;
+        in = in.subspan(piece);
+    }
+    return written;
 }
 
-// 加密数据
-bool AESModule::encryptData(const unsigned char* plaintext, int plaintext_len,
-                            unsigned char* ciphertext, int& ciphertext_len) {
-    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
-    if (!ctx) return false;
+size_t cipher_final(EVP_CIPHER_CTX* ctx, char* out, bool encrypt) {
+    int length = 0;
+    if (1 != EVP_CipherFinal_ex(ctx, reinterpret_cast<unsigned char*>(out), &length)) {
+        throw std::runtime_error(encrypt ? "加密失败" : "解密失败");
+    }
+    return length;
+}
 
-    if (1 != EVP_EncryptInit_ex(ctx, EVP_aes_256_cbc(), NULL,
-                               reinterpret_cast<const unsigned char*>(key_.data()),
-                               reinterpret_cast<const unsigned char*>(iv_.data()))) {
-        EVP_CIPHER_CTX_free(ctx);
-        return false;
+// GCM的附加认证数据须在数据之前送入
+void cipher_aad(EVP_CIPHER_CTX* ctx, std::span<const char> aad, bool encrypt) {
+    if (aad.empty()) {
+        return;
+    }
+    int length = 0;
+    if (1 != EVP_CipherUpdate(ctx, nullptr, &length, reinterpret_cast<const unsigned char*>(aad.data()),
+                              static_cast<int>(aad.size()))) {
+        throw std::runtime_error(encrypt ? "加密失败" : "解密失败");
     }
+}
 
-    int len;
-    if (1 != EVP_EncryptUpdate(ctx, ciphertext, &len, plaintext, plaintext_len)) {
-        EVP_CIPHER_CTX_free(ctx);
-        return false;
+// 每个线程复用一个上下文，避免每次加解密都重新分配
+EVP_CIPHER_CTX* thread_context() {
+    thread_local std::unique_ptr<EVP_CIPHER_CTX, decltype(&EVP_CIPHER_CTX_free)> ctx(
+        EVP_CIPHER_CTX_new(), &EVP_CIPHER_CTX_free);
+    if (!ctx) {
+        throw std::runtime_error("创建加密上下文失败");
     }
-    ciphertext_len = len;
+    return ctx.get();
+}
+
+// 用当前线程的上下文处理一整段数据，结果追加到out之后
+void cipher_all(const AESModule::KeyType& key, const AESModule::IVType& iv, bool encrypt,
+                std::span<const char> data, std::vector<char>& out) {
+    EVP_CIPHER_CTX* ctx = thread_context();
+    cipher_init(ctx, EVP_aes_256_cbc(), key.data(), iv.data(), encrypt);
+    const size_t base = out.size();
+    out.resize(base + data.size() + AESModule::BLOCK_SIZE);
+    size_t written = cipher_update(ctx, data, out.data() + base, encrypt);
+    written += cipher_final(ctx, out.data() + base + written, encrypt);
+    out.resize(base + written);
+}
+} // namespace
 
-    if (1 != EVP_EncryptFinal_ex(ctx, ciphertext + len, &len)) {
-        EVP_CIPHER_CTX_free(ctx);
-        return false;
+AESModule::StreamCipher::StreamCipher(const AESModule& aes, bool encrypt)
+    : ctx_(EVP_CIPHER_CTX_new()), key_(aes.key_), iv_(aes.iv_), encrypt_(encrypt) {
+    if (!ctx_) {
+        throw std::runtime_error("创建加密上下文失败");
     }
-    ciphertext_len += len;
-    EVP_CIPHER_CTX_free(ctx);
-    return true;
+    restart();
 }
 
-// 解密数据
-bool AESModule::decryptData(const unsigned char* ciphertext, int ciphertext_len,
-                            unsigned char* plaintext, int& plaintext_len) {
-    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
-    if (!ctx) return false;
+AESModule::StreamCipher::~StreamCipher() {
+    EVP_CIPHER_CTX_free(ctx_);
+}
+
+void AESModule::StreamCipher::restart() {
+    cipher_init(ctx_, EVP_aes_256_cbc(), key_.data(), iv_.data(), encrypt_);
+}
+
+size_t AESModule::StreamCipher::update(std::span<const char> in, char* out) {
+    return cipher_update(ctx_, in, out, encrypt_);
+}
+
+size_t AESModule::StreamCipher::finish(char* out) {
+    const size_t written = cipher_final(ctx_, out, encrypt_);
+    restart();
+    return written;
+}
 
-    if (1 != EVP_DecryptInit_ex(ctx, EVP_aes_256_cbc(), NULL,
-                               reinterpret_cast<const unsigned char*>(key_.data()),
-                               reinterpret_cast<const unsigned char*>(iv_.data()))) {
-        EVP_CIPHER_CTX_free(ctx);
-        return false;
+std::vector<char> AESModule::encrypt(const std::string_view& data) const {
+    std::vector<char> ciphertext;
+    encrypt(data, ciphertext);
+    return ciphertext;
+}
+
+void AESModule::encrypt(std::span<const char> data, std::vector<char>& out) const {
+    cipher_all(key_, iv_, true, data, out);
+}
+
+std::vector<char> AESModule::decrypt(const char* data, size_t size) const {
+    std::vector<char> plaintext;
+    decrypt({data, size}, plaintext);
+    return plaintext;
+}
+
+void AESModule::decrypt(std::span<const char> data, std::vector<char>& out) const {
+    cipher_all(key_, iv_, false, data, out);
+}
+
+// GCM数据块布局：nonce(12字节) + 密文(与明文等长) + 认证标签(16字节)
+void AESModule::seal(std::span<const char> data, std::vector<char>& out,
+                     std::span<const char> aad) const {
+    const size_t base = out.size();
+    out.resize(base + NONCE_SIZE + data.size() + TAG_SIZE);
+    auto* nonce = reinterpret_cast<unsigned char*>(out.data() + base);
+    if (1 != RAND_bytes(nonce, NONCE_SIZE)) {
+        throw std::runtime_error("生成随机数失败");
     }
 
-    int len;
-    if (1 != EVP_DecryptUpdate(ctx, plaintext, &len, ciphertext, ciphertext_len)) {
-        EVP_CIPHER_CTX_free(ctx);
-        return false;
+    EVP_CIPHER_CTX* ctx = thread_context();
+    cipher_init(ctx, EVP_aes_256_gcm(), key_.data(), nonce, true);
+    cipher_aad(ctx, aad, true);
+    char* body = out.data() + base + NONCE_SIZE;
+    size_t written = cipher_update(ctx, data, body, true);
+    written += cipher_final(ctx, body + written, true);
+    if (1 != EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, TAG_SIZE, body + written)) {
+        throw std::runtime_error("加密失败");
+    }
+    out.resize(base + NONCE_SIZE + written + TAG_SIZE);
+}
+
+void AESModule::open(std::span<const char> data, std::vector<char>& out,
+                     std::span<const char> aad) const {
+    if (data.size() < NONCE_SIZE + TAG_SIZE) {
+        throw std::runtime_error("加密数据不完整");
     }
-    plaintext_len = len;
+    const auto* nonce = reinterpret_cast<const unsigned char*>(data.data());
+    const std::span<const char> body = data.subspan(NONCE_SIZE, data.size() - NONCE_SIZE - TAG_SIZE);
+    std::array<char, TAG_SIZE> tag;
+    std::copy_n(data.data() + data.size() - TAG_SIZE, TAG_SIZE, tag.data());
 
-    if (1 != EVP_DecryptFinal_ex(ctx, plaintext + len, &len)) {
-        EVP_CIPHER_CTX_free(ctx);
-        return false;
+    EVP_CIPHER_CTX* ctx = thread_context();
+    cipher_init(ctx, EVP_aes_256_gcm(), key_.data(), nonce, false);
+    cipher_aad(ctx, aad, false);
+    const size_t base = out.size();
+    out.resize(base + body.size() + BLOCK_SIZE);
+    size_t written = cipher_update(ctx, body, out.data() + base, false);
+    int length = 0;
+    if (1 != EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, TAG_SIZE, tag.data()) ||
+        1 != EVP_DecryptFinal_ex(ctx, reinterpret_cast<unsigned char*>(out.data() + base + written),
+                                 &length)) {
+        out.resize(base);
+        throw std::runtime_error("数据认证失败，密码错误或数据被篡改");
     }
-    plaintext_len += len;
-    EVP_CIPHER_CTX_free(ctx);
-    return true;
+    out.resize(base + written + length);
 }
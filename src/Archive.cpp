@@ -0,0 +1,218 @@
+// 实现v2分帧格式的索引序列化和单帧编解码
+
+#include "Archive.h"
+#include "AES.h"
+#include "Codec.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+// 写入已分配好空间的缓冲区，返回写入位置之后的指针
+template <class T>
+char* put(char* out, const T& value) {
+    std::memcpy(out, &value, sizeof(T));
+    return out + sizeof(T);
+}
+
+// 带边界检查的顺序读取
+class IndexReader {
+public:
+    IndexReader(const char* data, size_t size) : data_(data), size_(size) {}
+
+    template <class T>
+    T get() {
+        T value;
+        std::memcpy(&value, take(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    std::string get_string(size_t length) {
+        const char* bytes = take(length);
+        return std::string(bytes, length);
+    }
+
+    size_t remaining() const { return size_ - pos_; }
+
+private:
+    const char* take(size_t length) {
+        if (length > size_ - pos_) {
+            throw std::runtime_error("索引数据不完整");
+        }
+        const char* bytes = data_ + pos_;
+        pos_ += length;
+        return bytes;
+    }
+
+    const char* data_;
+    size_t size_;
+    size_t pos_ = 0;
+};
+} // namespace
+
+// 索引布局：
+//   uint64 帧数量，每帧 {uint64 偏移, uint32 存储大小, uint32 原始大小, uint32 校验和}
+//   uint64 条目数量，每条 {uint32 路径长度, 路径, stat, uint32 帧号, uint32 帧内偏移, uint64 记录长度}
+std::vector<char> ArchiveIndex::serialize() const {
+    // 先算出总长度一次分配，逐项追加会反复扩容
+    constexpr size_t FRAME_SIZE = sizeof(uint64_t) + 3 * sizeof(uint32_t);
+    constexpr size_t ENTRY_SIZE = sizeof(uint32_t) + sizeof(struct stat) + 2 * sizeof(uint32_t) +
+                                  sizeof(uint64_t);
+    size_t size = 2 * sizeof(uint64_t) + frames.size() * FRAME_SIZE + entries.size() * ENTRY_SIZE;
+    for (const auto& entry : entries) {
+        size += entry.path.size();
+    }
+
+    std::vector<char> out(size);
+    char* pos = out.data();
+    pos = put<uint64_t>(pos, frames.size());
+    for (const auto& frame : frames) {
+        pos = put(pos, frame.offset);
+        pos = put(pos, frame.stored_size);
+        pos = put(pos, frame.raw_size);
+        pos = put(pos, frame.checksum);
+    }
+    pos = put<uint64_t>(pos, entries.size());
+    for (const auto& entry : entries) {
+        pos = put<uint32_t>(pos, entry.path.size());
+        std::memcpy(pos, entry.path.data(), entry.path.size());
+        pos += entry.path.size();
+        pos = put(pos, entry.metadata);
+        pos = put(pos, entry.frame);
+        pos = put(pos, entry.offset);
+        pos = put(pos, entry.size);
+    }
+    return out;
+}
+
+ArchiveIndex ArchiveIndex::deserialize(const char* data, size_t size) {
+    IndexReader reader(data, size);
+    ArchiveIndex index;
+
+    uint64_t frame_count = reader.get<uint64_t>();
+    // 每帧至少占20字节，数量不可能超过剩余数据能容纳的上限
+    if (frame_count > reader.remaining() / 20) {
+        throw std::runtime_error("索引帧数量无效");
+    }
+    index.frames.resize(frame_count);
+    for (auto& frame : index.frames) {
+        frame.offset = reader.get<uint64_t>();
+        frame.stored_size = reader.get<uint32_t>();
+        frame.raw_size = reader.get<uint32_t>();
+        frame.checksum = reader.get<uint32_t>();
+    }
+
+    uint64_t entry_count = reader.get<uint64_t>();
+    if (entry_count > reader.remaining() / (sizeof(uint32_t) + sizeof(struct stat))) {
+        throw std::runtime_error("索引条目数量无效");
+    }
+    index.entries.resize(entry_count);
+    for (auto& entry : index.entries) {
+        entry.path = reader.get_string(reader.get<uint32_t>());
+        entry.metadata = reader.get<struct stat>();
+        entry.frame = reader.get<uint32_t>();
+        entry.offset = reader.get<uint32_t>();
+        entry.size = reader.get<uint64_t>();
+        if (entry.frame >= index.frames.size() && entry.size != 0) {
+            throw std::runtime_error("索引条目指向不存在的帧: " + entry.path);
+        }
+    }
+    return index;
+}
+
+FrameCodec::FrameCodec(const ArchiveInfo& info, const AESModule* aes, int level)
+    : cipher_(info.cipher), aes_(aes) {
+    if (info.codec != CODEC_NONE) {
+        codec_ = Codec::Create(info.codec, level);
+    }
+    if (cipher_ != CIPHER_NONE && cipher_ != CIPHER_AES_CBC && cipher_ != CIPHER_AES_GCM &&
+        cipher_ != CIPHER_AES_GCM_AAD) {
+        throw std::runtime_error("不支持的加密方式: " + std::to_string(cipher_));
+    }
+    if (cipher_ != CIPHER_NONE && !aes_) {
+        throw std::runtime_error("需要解密密钥");
+    }
+    if (aes_ && std::any_of(std::begin(info.key_nonce), std::end(info.key_nonce),
+                            [](uint8_t byte) { return byte != 0; })) {
+        subkey_ = std::make_shared<const AESModule>(
+            aes_->derive({info.key_nonce, sizeof(info.key_nonce)}));
+        aes_ = subkey_.get();
+    }
+    if (bound()) {
+        // 只绑定写入时的info_size字节，之后扩展ArchiveInfo不影响旧归档的认证
+        const char* bytes = reinterpret_cast<const char*>(&info);
+        info_.assign(bytes, bytes + std::min<size_t>(info.info_size, sizeof(info)));
+    }
+}
+
+// 附加认证数据：uint64帧号 + ArchiveInfo
+std::vector<char> FrameCodec::associated_data(uint64_t number) const {
+    std::vector<char> aad(sizeof(number) + info_.size());
+    std::memcpy(aad.data(), &number, sizeof(number));
+    std::memcpy(aad.data() + sizeof(number), info_.data(), info_.size());
+    return aad;
+}
+
+void FrameCodec::encrypt(std::span<const char> data, std::vector<char>& out, uint64_t number) const {
+    if (cipher_ == CIPHER_AES_GCM_AAD) {
+        aes_->seal(data, out, associated_data(number));
+    } else if (cipher_ == CIPHER_AES_GCM) {
+        aes_->seal(data, out);
+    } else {
+        aes_->encrypt(data, out);
+    }
+}
+
+void FrameCodec::decrypt(std::span<const char> data, std::vector<char>& out, uint64_t number) const {
+    if (cipher_ == CIPHER_AES_GCM_AAD) {
+        aes_->open(data, out, associated_data(number));
+    } else if (cipher_ == CIPHER_AES_GCM) {
+        aes_->open(data, out);
+    } else {
+        aes_->decrypt(data, out);
+    }
+}
+
+std::vector<char> FrameCodec::encode(const char* data, size_t size, uint64_t number) const {
+    std::vector<char> frame;
+    if (!codec_) {
+        if (cipher_ != CIPHER_NONE) {
+            encrypt({data, size}, frame, number);
+        } else {
+            frame.assign(data, data + size);
+        }
+        return frame;
+    }
+    codec_->encode(data, size, frame);
+    if (cipher_ != CIPHER_NONE) {
+        std::vector<char> encrypted;
+        encrypt(frame, encrypted, number);
+        frame.swap(encrypted);
+    }
+    return frame;
+}
+
+std::vector<char> FrameCodec::decode(const char* data, size_t size, uint32_t raw_size,
+                                     uint64_t number) const {
+    std::vector<char> frame;
+    const char* stored = data;
+    size_t stored_size = size;
+    if (cipher_ != CIPHER_NONE) {
+        frame.reserve(size);
+        decrypt({data, size}, frame, number);
+        stored = frame.data();
+        stored_size = frame.size();
+    }
+    if (codec_) {
+        std::vector<char> raw;
+        raw.reserve(raw_size);
+        codec_->decode(stored, stored_size, raw_size, raw);
+        frame.swap(raw);
+    } else if (cipher_ == CIPHER_NONE) {
+        frame.assign(data, data + size);
+    }
+    if (frame.size() != raw_size) {
+        throw std::runtime_error("数据帧解码后长度不符");
+    }
+    return frame;
+}
@@ -0,0 +1,351 @@
+#include "ArchiveIO.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace {
+[[noreturn]] void throw_errno(const std::string& what, const fs::path& path) {
+    throw std::system_error(errno, std::generic_category(), what + ": " + path.string());
+}
+}  // namespace
+
+AlignedBuffer make_aligned_buffer(size_t size) {
+    char* data = static_cast<char*>(std::aligned_alloc(IO_ALIGNMENT, size));
+    if (!data) {
+        throw std::bad_alloc();
+    }
+    return AlignedBuffer(data);
+}
+
+ArchiveWriter::ArchiveWriter(const fs::path& path, bool direct) : path_(path) {
+    if (direct) {
+        // 回填文件头时需要读出所在的块，以读写方式打开
+        fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC | O_DIRECT, 0644);
+        if (fd_ < 0 && errno != EINVAL) {
+            throw_errno("无法创建备份文件", path_);
+        }
+        direct_ = fd_ >= 0;
+    }
+    if (!direct_) {
+        fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd_ < 0) {
+            throw_errno("无法创建备份文件", path_);
+        }
+    }
+    if (direct_) {
+        buffer_ = make_aligned_buffer(DIRECT_BUFFER_SIZE);
+        spare_ = make_aligned_buffer(DIRECT_BUFFER_SIZE);
+        writer_ = std::make_unique<ThreadPool>(1);
+    } else {
+        buffer_ = make_aligned_buffer(BUFFER_SIZE);
+    }
+}
+
+ArchiveWriter::~ArchiveWriter() {
+    // 后台写出使用文件描述符和缓冲区，先等待其结束
+    if (writing_.valid()) {
+        writing_.wait();
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+}
+
+void ArchiveWriter::write(const char* data, size_t size) {
+    if (direct_) {
+        append_direct(data, size);
+        return;
+    }
+    if (size <= BUFFER_SIZE - used_) {
+        append(data, size);
+        return;
+    }
+    if (size < BUFFER_SIZE) {
+        flush();
+        append(data, size);
+        return;
+    }
+    iovec iov[2] = {{buffer_.get(), used_}, {const_cast<char*>(data), size}};
+    write_vector(iov, 2);
+    used_ = 0;
+    size_ += size;
+}
+
+void ArchiveWriter::write(const char* head, size_t head_size, const char* data, size_t size) {
+    if (direct_) {
+        append_direct(head, head_size);
+        append_direct(data, size);
+        return;
+    }
+    if (head_size + size <= BUFFER_SIZE - used_) {
+        append(head, head_size);
+        append(data, size);
+        return;
+    }
+    iovec iov[3] = {{buffer_.get(), used_},
+                    {const_cast<char*>(head), head_size},
+                    {const_cast<char*>(data), size}};
+    write_vector(iov, 3);
+    used_ = 0;
+    size_ += head_size + size;
+}
+
+void ArchiveWriter::write_at(uint64_t offset, const char* data, size_t size) {
+    if (direct_) {
+        write_at_direct(offset, data, size);
+        return;
+    }
+    flush();
+    write_fully(data, size, offset);
+}
+
+void ArchiveWriter::close() {
+    if (direct_) {
+        wait_direct();
+        // 直接I/O只能写出整块，末尾补零后截断到实际长度
+        if (used_ > 0) {
+            const size_t padded = (used_ + IO_ALIGNMENT - 1) / IO_ALIGNMENT * IO_ALIGNMENT;
+            std::memset(buffer_.get() + used_, 0, padded - used_);
+            write_fully(buffer_.get(), padded, buffer_offset_);
+            used_ = 0;
+            if (::ftruncate(fd_, static_cast<off_t>(size_)) != 0) {
+                throw_errno("写入备份文件失败", path_);
+            }
+        }
+    } else {
+        flush();
+    }
+    const int fd = fd_;
+    fd_ = -1;
+    if (::close(fd) != 0) {
+        throw_errno("关闭备份文件失败", path_);
+    }
+}
+
+void ArchiveWriter::append(const char* data, size_t size) {
+    std::memcpy(buffer_.get() + used_, data, size);
+    used_ += size;
+    size_ += size;
+}
+
+void ArchiveWriter::flush() {
+    if (used_ == 0) {
+        return;
+    }
+    iovec iov[1] = {{buffer_.get(), used_}};
+    write_vector(iov, 1);
+    used_ = 0;
+}
+
+// 写完各段数据，处理部分写入
+void ArchiveWriter::write_vector(iovec* iov, int count) {
+    while (count > 0) {
+        ssize_t written = ::writev(fd_, iov, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw_errno("写入备份文件失败", path_);
+        }
+        while (count > 0 && static_cast<size_t>(written) >= iov->iov_len) {
+            written -= iov->iov_len;
+            ++iov;
+            --count;
+        }
+        if (count > 0) {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + written;
+            iov->iov_len -= written;
+        }
+    }
+}
+
+// 在指定位置写完数据，处理部分写入
+void ArchiveWriter::write_fully(const char* data, size_t size, uint64_t offset) {
+    while (size > 0) {
+        ssize_t written = ::pwrite(fd_, data, size, static_cast<off_t>(offset));
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw_errno("写入备份文件失败", path_);
+        }
+        data += written;
+        size -= written;
+        offset += written;
+    }
+}
+
+void ArchiveWriter::append_direct(const char* data, size_t size) {
+    while (size > 0) {
+        const size_t count = std::min(size, DIRECT_BUFFER_SIZE - used_);
+        std::memcpy(buffer_.get() + used_, data, count);
+        used_ += count;
+        size_ += count;
+        data += count;
+        size -= count;
+        if (used_ == DIRECT_BUFFER_SIZE) {
+            submit_direct();
+        }
+    }
+}
+
+// 已满的缓冲区交给后台线程写出，换用另一个缓冲区继续填充
+void ArchiveWriter::submit_direct() {
+    wait_direct();
+    std::swap(buffer_, spare_);
+    const char* data = spare_.get();
+    const uint64_t offset = buffer_offset_;
+    buffer_offset_ += used_;
+    used_ = 0;
+    writing_ = writer_->submit([this, data, offset] { write_fully(data, DIRECT_BUFFER_SIZE, offset); });
+}
+
+// 等待正在进行的写出，写出失败时在此抛出异常
+void ArchiveWriter::wait_direct() {
+    if (writing_.valid()) {
+        writing_.get();
+    }
+}
+
+// 仍在缓冲区中的部分直接修改；已写出的部分读出所在的整块，修改后写回
+void ArchiveWriter::write_at_direct(uint64_t offset, const char* data, size_t size) {
+    wait_direct();
+    const uint64_t end = offset + size;
+    if (end > buffer_offset_) {
+        const uint64_t begin = std::max(offset, buffer_offset_);
+        std::memcpy(buffer_.get() + (begin - buffer_offset_), data + (begin - offset), end - begin);
+    }
+    if (offset >= buffer_offset_) {
+        return;
+    }
+    // buffer_offset_是缓冲区大小的整数倍，对齐后的范围不会超出已写出的部分
+    const uint64_t written_end = std::min(end, buffer_offset_);
+    const uint64_t block_begin = offset / IO_ALIGNMENT * IO_ALIGNMENT;
+    const uint64_t block_end = (written_end + IO_ALIGNMENT - 1) / IO_ALIGNMENT * IO_ALIGNMENT;
+    const size_t length = block_end - block_begin;
+    AlignedBuffer block = make_aligned_buffer(length);
+    size_t done = 0;
+    while (done < length) {
+        ssize_t count = ::pread(fd_, block.get() + done, length - done,
+                                static_cast<off_t>(block_begin + done));
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw_errno("读取备份文件失败", path_);
+        }
+        if (count == 0) {
+            throw std::system_error(EIO, std::generic_category(), "读取备份文件失败: " + path_.string());
+        }
+        done += count;
+    }
+    std::memcpy(block.get() + (offset - block_begin), data, written_end - offset);
+    write_fully(block.get(), length, block_begin);
+}
+
+ArchiveReader::ArchiveReader(const fs::path& path)
+    : path_(path), buffer_(make_aligned_buffer(BUFFER_SIZE)) {
+    fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0) {
+        throw_errno("无法打开备份文件", path_);
+    }
+    struct stat st;
+    if (fstat(fd_, &st) != 0) {
+        const int error = errno;
+        ::close(fd_);
+        errno = error;
+        throw_errno("无法读取备份文件信息", path_);
+    }
+    size_ = st.st_size;
+    posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+    setg(buffer_.get(), buffer_.get(), buffer_.get());
+}
+
+ArchiveReader::~ArchiveReader() {
+    ::close(fd_);
+}
+
+ArchiveReader::int_type ArchiveReader::underflow() {
+    if (gptr() < egptr()) {
+        return traits_type::to_int_type(*gptr());
+    }
+    const uint64_t offset = position();
+    const size_t count = read_at(buffer_.get(), BUFFER_SIZE, offset);
+    buffer_offset_ = offset;
+    setg(buffer_.get(), buffer_.get(), buffer_.get() + count);
+    if (count == 0) {
+        return traits_type::eof();
+    }
+    return traits_type::to_int_type(*gptr());
+}
+
+// 先交出缓冲区中的数据，剩余部分较大时直接读入调用方的内存
+std::streamsize ArchiveReader::xsgetn(char* data, std::streamsize count) {
+    const std::streamsize buffered = std::min<std::streamsize>(count, egptr() - gptr());
+    std::memcpy(data, gptr(), buffered);
+    gbump(static_cast<int>(buffered));
+    if (static_cast<size_t>(count - buffered) < BUFFER_SIZE) {
+        return buffered + std::streambuf::xsgetn(data + buffered, count - buffered);
+    }
+    const uint64_t offset = position();
+    const size_t read = read_at(data + buffered, count - buffered, offset);
+    buffer_offset_ = offset + read;
+    setg(buffer_.get(), buffer_.get(), buffer_.get());
+    return buffered + read;
+}
+
+ArchiveReader::pos_type ArchiveReader::seekoff(off_type offset, std::ios_base::seekdir dir,
+                                               std::ios_base::openmode which) {
+    if (!(which & std::ios_base::in)) {
+        return pos_type(off_type(-1));
+    }
+    off_type base = 0;
+    if (dir == std::ios_base::cur) {
+        base = position();
+    } else if (dir == std::ios_base::end) {
+        base = size_;
+    }
+    if (offset < -base) {
+        return pos_type(off_type(-1));
+    }
+    const uint64_t target = base + offset;
+    // 目标仍在缓冲区内时只移动读取位置
+    const uint64_t buffered = egptr() - eback();
+    if (target >= buffer_offset_ && target <= buffer_offset_ + buffered) {
+        setg(eback(), eback() + (target - buffer_offset_), egptr());
+    } else {
+        buffer_offset_ = target;
+        setg(buffer_.get(), buffer_.get(), buffer_.get());
+    }
+    return pos_type(off_type(target));
+}
+
+ArchiveReader::pos_type ArchiveReader::seekpos(pos_type position,
+                                               std::ios_base::openmode which) {
+    return seekoff(off_type(position), std::ios_base::beg, which);
+}
+
+// 读取指定位置的数据，返回实际读取的长度，到达文件末尾时可能小于size
+size_t ArchiveReader::read_at(char* data, size_t size, uint64_t offset) {
+    size_t total = 0;
+    while (total < size) {
+        ssize_t count = ::pread(fd_, data + total, size - total, static_cast<off_t>(offset + total));
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw_errno("读取备份文件失败", path_);
+        }
+        if (count == 0) {
+            break;
+        }
+        total += count;
+    }
+    return total;
+}
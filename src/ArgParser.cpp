@@ -68,9 +68,18 @@ void ParserConfig::configure_parser(cmdline::parser& parser) {
 
   // 备份选项
   parser.add("compress", 'c', "备份时压缩文件");
+  parser.add<std::string>("codec", '\0', "压缩算法: lzw, lz(快速), lzh(高压缩率)，指定后自动启用压缩",
+                          false);
+  parser.add<int>("level", '\0', "压缩级别1-9，0表示使用算法的默认级别", false, 0,
+                  cmdline::range(0, 9));
   parser.add("encrypt", 'e', "备份时加密文件");
   parser.add<std::string>("password", 'p', "加密/解密密码", false,
                           std::string(""));
+  parser.add<std::string>("kdf", '\0', "密钥派生方式: pbkdf2(默认), scrypt(占用更多内存)",
+                          false, "pbkdf2");
+  parser.add<int>("kdf-cost", '\0',
+                  "密钥派生强度：pbkdf2为迭代次数，scrypt为log2(N)，0表示默认值", false, 0,
+                  cmdline::range(0, 100000000));
   parser.add<std::string>("path", '\0', "过滤路径：正则表达式", false);
   parser.add<std::string>(
       "type", '\0', "备份文件类型，可组合使用: n普通文件,l符号链接,p管道文件",
@@ -86,18 +95,38 @@ void ParserConfig::configure_parser(cmdline::parser& parser) {
       "ctime", '\0',
       "按状态改变时间过滤，格式: START,END 例如: 202401010000,202401012359",
       false);
+  parser.add("manifest", '\0', "备份时在备份文件旁写入清单(.manifest)，用于之后的增量备份");
+  parser.add("incremental", '\0', "增量备份：只打包相对--base清单新增或修改的文件，并记录删除的文件");
+  parser.add<std::string>("base", '\0', "增量备份所基于的清单文件", false);
+  parser.add("dedup", '\0', "备份时内容相同的文件只保存一次，恢复时复制（支持时使用reflink）");
+  parser.add<std::string>("store", '\0',
+                          "数据块存储目录：备份时文件内容按块去重存入该目录，恢复、提取和深度验证时需指定同一目录",
+                          false);
   // parser.add<std::string>("message", 'm', "添加备注信息", false);
   // 恢复选项
   parser.add("metadata", 'a', "恢复文件的元数据");
+  parser.add<std::string>(
+      "extract", 'x', "只恢复匹配的文件：glob模式，匹配目录时恢复其下所有文件",
+      false);
+  parser.add<std::string>("increments", '\0',
+                          "恢复基础备份后依次应用的增量备份，逗号分隔，按生成顺序排列", false);
 
   // 验证选项
   parser.add("verify", 'l', "验证备份数据");
+  parser.add("deep", '\0', "深度验证：解密、解压并检查每个文件，不写入磁盘");
+  parser.add("list", 't', "列出备份中的文件");
 
   // 添加文件大小过滤选项
   parser.add<std::string>(
       "size", '\0',
       "按文件大小过滤，格式: [<>]N[bkmg]，例如: >1k表示大于1KB, <1m表示小于1MB",
       false);
+  // 性能选项
+  parser.add<int>("threads", '\0', "打包/解包使用的线程数，0表示使用全部CPU核心",
+                  false, 1, cmdline::range(0, 1024));
+  parser.add<int>("window", '\0', "流水线窗口大小(KB)，即每个数据帧的原始大小，决定打包时的内存占用",
+                  false, 4096, cmdline::range(4, 1024 * 1024));
+  parser.add("direct-io", '\0', "备份文件以直接I/O(O_DIRECT)写入，不经过页缓存，源文件读完后丢弃其页缓存");
   // 添加 GUI 选项
   parser.add("gui", 'g', "启动图形界面");
 }
@@ -107,12 +136,27 @@ void ParserConfig::check_conflicts(const cmdline::parser& parser) {
 
   // 添加规则
   rules.emplace_back(
-      new MutuallyExclusiveRule({"backup", "restore", "verify"}));
+      new MutuallyExclusiveRule({"backup", "restore", "verify", "extract", "list"}));
 
   rules.emplace_back(new DependencyRule("backup", {"input", "output"}));
   rules.emplace_back(new DependencyRule("restore", {"input", "output"}));
   rules.emplace_back(new DependencyRule("verify", {"input"}));
+  rules.emplace_back(new DependencyRule("extract", {"input", "output"}));
+  rules.emplace_back(new DependencyRule("list", {"input"}));
   rules.emplace_back(new DependencyRule("encrypt", {"password"}));
+  rules.emplace_back(new DependencyRule("kdf", {"encrypt"}));
+  rules.emplace_back(new DependencyRule("kdf-cost", {"encrypt"}));
+  rules.emplace_back(new DependencyRule("codec", {"backup"}));
+  rules.emplace_back(new DependencyRule("level", {"codec"}));
+  rules.emplace_back(new DependencyRule("deep", {"verify"}));
+  rules.emplace_back(new DependencyRule("manifest", {"backup"}));
+  rules.emplace_back(new DependencyRule("incremental", {"backup", "base"}));
+  rules.emplace_back(new DependencyRule("base", {"incremental"}));
+  rules.emplace_back(new DependencyRule("increments", {"restore"}));
+  rules.emplace_back(new MutuallyExclusiveRule({"store", "encrypt"}));
+  rules.emplace_back(new DependencyRule("dedup", {"backup"}));
+  rules.emplace_back(new DependencyRule("direct-io", {"backup"}));
+  rules.emplace_back(new DependencyRule("window", {"backup"}));
 
   // 检查所有规则
   for (const auto& rule : rules) {
@@ -0,0 +1,214 @@
+#include "Checksum.h"
+#include <array>
+#include <bit>
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define CRC32_HAVE_PCLMUL 1
+#endif
+
+/*
+ * 内部使用CRC寄存器值：update()的crc参数取反即为寄存器，结果再取反输出。
+ * 因此初始值INIT对应寄存器0，与历史备份中的校验和保持一致。
+ */
+
+namespace {
+constexpr uint32_t POLYNOMIAL = 0xEDB88320;
+
+// slice-by-16查找表：tables[k][i]为字节i之后再跟k个0字节的CRC
+using SliceTables = std::array<std::array<uint32_t, 256>, 16>;
+
+constexpr SliceTables make_tables() {
+    SliceTables tables{};
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int j = 0; j < 8; j++) {
+            c = (c >> 1) ^ ((c & 1) ? POLYNOMIAL : 0);
+        }
+        tables[0][i] = c;
+    }
+    for (size_t k = 1; k < tables.size(); k++) {
+        for (uint32_t i = 0; i < 256; i++) {
+            const uint32_t prev = tables[k - 1][i];
+            tables[k][i] = (prev >> 8) ^ tables[0][prev & 0xFF];
+        }
+    }
+    return tables;
+}
+
+constexpr SliceTables TABLES = make_tables();
+
+uint32_t load_le32(const unsigned char* p) {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    if constexpr (std::endian::native == std::endian::big) {
+        value = __builtin_bswap32(value);
+    }
+    return value;
+}
+
+uint32_t crc_bytes(uint32_t reg, const unsigned char* p, size_t length) {
+    while (length--) {
+        reg = (reg >> 8) ^ TABLES[0][(reg ^ *p++) & 0xFF];
+    }
+    return reg;
+}
+
+uint32_t crc_slice16(uint32_t reg, const unsigned char* p, size_t length) {
+    const auto& t = TABLES;
+    while (length >= 16) {
+        const uint32_t a = load_le32(p) ^ reg;
+        const uint32_t b = load_le32(p + 4);
+        const uint32_t c = load_le32(p + 8);
+        const uint32_t d = load_le32(p + 12);
+        reg = t[15][a & 0xFF] ^ t[14][(a >> 8) & 0xFF] ^ t[13][(a >> 16) & 0xFF] ^ t[12][a >> 24] ^
+              t[11][b & 0xFF] ^ t[10][(b >> 8) & 0xFF] ^ t[9][(b >> 16) & 0xFF] ^ t[8][b >> 24] ^
+              t[7][c & 0xFF] ^ t[6][(c >> 8) & 0xFF] ^ t[5][(c >> 16) & 0xFF] ^ t[4][c >> 24] ^
+              t[3][d & 0xFF] ^ t[2][(d >> 8) & 0xFF] ^ t[1][(d >> 16) & 0xFF] ^ t[0][d >> 24];
+        p += 16;
+        length -= 16;
+    }
+    return crc_bytes(reg, p, length);
+}
+
+#ifdef CRC32_HAVE_PCLMUL
+// 折叠算法所需的最小长度，更短的数据直接查表
+constexpr size_t PCLMUL_MIN_LENGTH = 64;
+
+// 把128位累加器向后折叠，与下一块数据合并
+__attribute__((target("pclmul,sse4.1")))
+inline __m128i fold(__m128i acc, __m128i k, __m128i next) {
+    const __m128i lo = _mm_clmulepi64_si128(acc, k, 0x00);
+    const __m128i hi = _mm_clmulepi64_si128(acc, k, 0x11);
+    return _mm_xor_si128(_mm_xor_si128(hi, lo), next);
+}
+
+/*
+ * 按Intel "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ"
+ * 的方法，每次把4个128位累加器向后折叠64字节，最后用Barrett约简得到32位结果。
+ * 常数为位反射域下的 x^(4*128+32) mod P 等，length须为16的倍数且不小于64。
+ */
+__attribute__((target("pclmul,sse4.1")))
+uint32_t crc_pclmul(uint32_t reg, const unsigned char* p, size_t length) {
+    alignas(16) static const uint64_t k1k2[] = {0x0154442bd4, 0x01c6e41596};
+    alignas(16) static const uint64_t k3k4[] = {0x01751997d0, 0x00ccaa009e};
+    alignas(16) static const uint64_t k5k0[] = {0x0163cd6124, 0x0000000000};
+    alignas(16) static const uint64_t poly[] = {0x01db710641, 0x01f7011641};
+
+    auto load = [](const unsigned char* q) {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i*>(q));
+    };
+
+    __m128i x1 = _mm_xor_si128(load(p), _mm_cvtsi32_si128(static_cast<int>(reg)));
+    __m128i x2 = load(p + 16);
+    __m128i x3 = load(p + 32);
+    __m128i x4 = load(p + 48);
+    p += 64;
+    length -= 64;
+
+    // 4路并行折叠
+    __m128i k = _mm_load_si128(reinterpret_cast<const __m128i*>(k1k2));
+    while (length >= 64) {
+        x1 = fold(x1, k, load(p));
+        x2 = fold(x2, k, load(p + 16));
+        x3 = fold(x3, k, load(p + 32));
+        x4 = fold(x4, k, load(p + 48));
+        p += 64;
+        length -= 64;
+    }
+
+    // 合并为一个128位累加器，再逐16字节折叠剩余数据
+    k = _mm_load_si128(reinterpret_cast<const __m128i*>(k3k4));
+    x1 = fold(x1, k, x2);
+    x1 = fold(x1, k, x3);
+    x1 = fold(x1, k, x4);
+    while (length >= 16) {
+        x1 = fold(x1, k, load(p));
+        p += 16;
+        length -= 16;
+    }
+
+    // 128位折叠到64位
+    const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x2 = _mm_clmulepi64_si128(x1, k, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+    k = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(k5k0));
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), k, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrett约简到32位
+    k = _mm_load_si128(reinterpret_cast<const __m128i*>(poly));
+    x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), k, 0x10);
+    x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, mask32), k, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    return static_cast<uint32_t>(_mm_extract_epi32(x1, 1));
+}
+
+bool has_pclmul() {
+    static const bool supported = __builtin_cpu_supports("pclmul") &&
+                                  __builtin_cpu_supports("sse4.1");
+    return supported;
+}
+#endif
+
+// GF(2)上模P的乘法，多项式均为位反射表示（最高位为x^0）
+uint32_t multiply_mod(uint32_t a, uint32_t b) {
+    uint32_t product = 0;
+    for (uint32_t m = 1u << 31; m != 0; m >>= 1) {
+        if (a & m) {
+            product ^= b;
+        }
+        b = (b & 1) ? (b >> 1) ^ POLYNOMIAL : b >> 1;
+    }
+    return product;
+}
+
+// x^(8 * bytes) mod P，即在寄存器后追加bytes个0字节对应的乘数
+uint32_t zero_bytes_operator(uint64_t bytes) {
+    // 从x^8开始反复平方，依次得到 x^(8 * 2^i)
+    uint32_t power = 1u << 23;  // x^8
+    uint32_t result = 1u << 31;  // x^0
+    while (bytes) {
+        if (bytes & 1) {
+            result = multiply_mod(result, power);
+        }
+        power = multiply_mod(power, power);
+        bytes >>= 1;
+    }
+    return result;
+}
+} // namespace
+
+uint32_t CRC32::update(const char* data, size_t length, uint32_t crc) {
+    const auto* p = reinterpret_cast<const unsigned char*>(data);
+    uint32_t reg = ~crc;
+#ifdef CRC32_HAVE_PCLMUL
+    if (length >= PCLMUL_MIN_LENGTH && has_pclmul()) {
+        const size_t folded = length & ~size_t{15};
+        reg = crc_pclmul(reg, p, folded);
+        p += folded;
+        length -= folded;
+    }
+#endif
+    return ~crc_slice16(reg, p, length);
+}
+
+uint32_t CRC32::update_portable(const char* data, size_t length, uint32_t crc) {
+    return ~crc_slice16(~crc, reinterpret_cast<const unsigned char*>(data), length);
+}
+
+uint32_t CRC32::combine(uint32_t crc1, uint32_t crc2, uint64_t length2) {
+    // 寄存器是线性的：处理后一段得到的寄存器 = 前一段的寄存器后移length2字节 ^ 后一段从0开始的寄存器
+    return multiply_mod(zero_bytes_operator(length2), ~crc1) ^ crc2;
+}
+
+const char* CRC32::implementation() {
+#ifdef CRC32_HAVE_PCLMUL
+    if (has_pclmul()) {
+        return "pclmul";
+    }
+#endif
+    return "slice-by-16";
+}
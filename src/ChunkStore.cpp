@@ -0,0 +1,280 @@
+// 实现去重数据块存储的读写
+
+#include "ChunkStore.h"
+#include "Archive.h"
+#include "Checksum.h"
+#include <cerrno>
+#include <stdexcept>
+#include <string>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+
+namespace {
+constexpr char STORE_MAGIC[4] = {'B', 'K', 'C', 'S'};
+constexpr uint16_t STORE_VERSION = 1;
+
+#pragma pack(push, 1)
+// chunks.idx的头部
+struct StoreHeader {
+    char magic[4];
+    uint16_t version;
+    uint8_t codec;              // 数据块的压缩算法
+    uint8_t reserved;
+    unsigned char id[16];       // 存储的随机标识
+};
+
+// chunks.idx中的一个条目
+struct IndexRecord {
+    unsigned char id[32];
+    uint64_t offset;
+    uint32_t stored_size;
+    uint32_t raw_size;
+    uint32_t checksum;
+};
+#pragma pack(pop)
+
+std::string error_text() {
+    return std::string(" (") + strerror(errno) + ")";
+}
+
+void pwrite_all(int fd, const char* data, size_t size, uint64_t offset) {
+    while (size > 0) {
+        ssize_t written = ::pwrite(fd, data, size, static_cast<off_t>(offset));
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("写入数据块存储失败" + error_text());
+        }
+        data += written;
+        size -= written;
+        offset += written;
+    }
+}
+
+// 读取指定位置的数据，文件长度不足时返回false
+bool pread_all(int fd, char* data, size_t size, uint64_t offset) {
+    while (size > 0) {
+        ssize_t count = ::pread(fd, data, size, static_cast<off_t>(offset));
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("读取数据块存储失败" + error_text());
+        }
+        if (count == 0) {
+            return false;
+        }
+        data += count;
+        size -= count;
+        offset += count;
+    }
+    return true;
+}
+
+uint64_t file_size(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        throw std::runtime_error("无法读取数据块存储信息" + error_text());
+    }
+    return st.st_size;
+}
+}  // namespace
+
+ChunkStore::ChunkStore(const fs::path& dir, bool writable, uint8_t codec, int level)
+    : writable_(writable) {
+    if (writable) {
+        fs::create_directories(dir);
+    }
+    const int flags = (writable ? O_RDWR | O_CREAT : O_RDONLY) | O_CLOEXEC;
+    index_fd_ = ::open((dir / "chunks.idx").c_str(), flags, 0644);
+    if (index_fd_ < 0) {
+        throw std::runtime_error("无法打开数据块存储: " + dir.string() + error_text());
+    }
+    try {
+        if (writable && flock(index_fd_, LOCK_EX) != 0) {
+            throw std::runtime_error("无法锁定数据块存储: " + dir.string() + error_text());
+        }
+        data_fd_ = ::open((dir / "chunks.dat").c_str(), flags, 0644);
+        if (data_fd_ < 0) {
+            throw std::runtime_error("无法打开数据块存储: " + dir.string() + error_text());
+        }
+
+        StoreHeader header{};
+        index_size_ = file_size(index_fd_);
+        if (index_size_ == 0 && writable) {
+            // 新建存储
+            std::memcpy(header.magic, STORE_MAGIC, sizeof(header.magic));
+            header.version = STORE_VERSION;
+            header.codec = codec;
+            if (RAND_bytes(header.id, sizeof(header.id)) != 1) {
+                throw std::runtime_error("无法生成数据块存储标识");
+            }
+            pwrite_all(index_fd_, reinterpret_cast<const char*>(&header), sizeof(header), 0);
+            index_size_ = sizeof(header);
+        } else if (index_size_ < sizeof(header) ||
+                   !pread_all(index_fd_, reinterpret_cast<char*>(&header), sizeof(header), 0) ||
+                   std::memcmp(header.magic, STORE_MAGIC, sizeof(header.magic)) != 0) {
+            throw std::runtime_error("不是有效的数据块存储: " + dir.string());
+        } else if (header.version > STORE_VERSION) {
+            throw std::runtime_error("不支持的数据块存储版本: " + std::to_string(header.version));
+        }
+        std::memcpy(id_.data(), header.id, id_.size());
+
+        ArchiveInfo info{};
+        info.codec = header.codec;
+        info.cipher = CIPHER_NONE;
+        codec_ = std::make_unique<FrameCodec>(info, nullptr, level);
+
+        // 末尾不完整的条目是写入中断留下的，忽略并在之后覆盖
+        const size_t count = (index_size_ - sizeof(header)) / sizeof(IndexRecord);
+        std::vector<IndexRecord> records(count);
+        if (!pread_all(index_fd_, reinterpret_cast<char*>(records.data()),
+                       count * sizeof(IndexRecord), sizeof(header))) {
+            throw std::runtime_error("数据块存储的索引不完整: " + dir.string());
+        }
+        index_size_ = sizeof(header) + count * sizeof(IndexRecord);
+        data_size_ = file_size(data_fd_);
+        chunks_.reserve(count);
+        for (const auto& record : records) {
+            if (record.offset > data_size_ || record.stored_size > data_size_ - record.offset) {
+                throw std::runtime_error("数据块存储的索引与数据不一致: " + dir.string());
+            }
+            ChunkId id;
+            std::memcpy(id.data(), record.id, id.size());
+            chunks_.emplace(id, Location{record.offset, record.stored_size, record.raw_size,
+                                         record.checksum});
+        }
+    } catch (...) {
+        close_files();
+        throw;
+    }
+}
+
+ChunkStore::~ChunkStore() {
+    close_files();
+}
+
+void ChunkStore::close_files() {
+    if (data_fd_ >= 0) {
+        ::close(data_fd_);
+        data_fd_ = -1;
+    }
+    // 关闭文件时释放锁
+    if (index_fd_ >= 0) {
+        ::close(index_fd_);
+        index_fd_ = -1;
+    }
+}
+
+ChunkStore::ChunkId ChunkStore::put(const char* data, size_t size) {
+    if (!writable_) {
+        throw std::runtime_error("数据块存储以只读方式打开");
+    }
+    if (size > UINT32_MAX) {
+        throw std::runtime_error("数据块过大");
+    }
+    ChunkId id;
+    if (EVP_Digest(size > 0 ? data : "", size, id.data(), nullptr, EVP_sha256(), nullptr) != 1) {
+        throw std::runtime_error("计算数据块哈希失败");
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (chunks_.count(id)) {
+            stats_.chunks_reused++;
+            stats_.bytes_reused += size;
+            return id;
+        }
+    }
+
+    // 压缩在锁外进行，多个线程可以同时压缩不同的数据块
+    // 数据块不加密，帧编号不参与编码
+    std::vector<char> stored = codec_->encode(data, size, 0);
+    if (stored.size() > UINT32_MAX) {
+        throw std::runtime_error("数据块过大");
+    }
+    const uint32_t checksum = CRC32::update(stored.data(), stored.size());
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (chunks_.count(id)) {
+        // 其他线程同时保存了相同的数据块
+        stats_.chunks_reused++;
+        stats_.bytes_reused += size;
+        return id;
+    }
+    const Location location{data_size_, static_cast<uint32_t>(stored.size()),
+                            static_cast<uint32_t>(size), checksum};
+    pwrite_all(data_fd_, stored.data(), stored.size(), data_size_);
+    data_size_ += stored.size();
+    chunks_.emplace(id, location);
+    pending_.emplace_back(id, location);
+    stats_.chunks_added++;
+    stats_.bytes_added += size;
+    return id;
+}
+
+void ChunkStore::get(const ChunkId& id, std::vector<char>& out) const {
+    Location location;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = chunks_.find(id);
+        if (it == chunks_.end()) {
+            throw std::runtime_error("数据块存储中缺少数据块");
+        }
+        location = it->second;
+    }
+    std::vector<char> stored(location.stored_size);
+    if (!pread_all(data_fd_, stored.data(), stored.size(), location.offset)) {
+        throw std::runtime_error("数据块不完整");
+    }
+    if (CRC32::update(stored.data(), stored.size()) != location.checksum) {
+        throw std::runtime_error("数据块校验失败");
+    }
+    out = codec_->decode(stored.data(), stored.size(), location.raw_size, 0);
+    ChunkId actual;
+    if (EVP_Digest(out.empty() ? "" : out.data(), out.size(), actual.data(), nullptr, EVP_sha256(),
+                   nullptr) != 1 || actual != id) {
+        throw std::runtime_error("数据块内容与标识不符");
+    }
+}
+
+void ChunkStore::flush() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (pending_.empty()) {
+        return;
+    }
+    // 数据先落盘，索引中的条目才不会指向不存在的数据
+    if (fdatasync(data_fd_) != 0) {
+        throw std::runtime_error("同步数据块存储失败" + error_text());
+    }
+    std::vector<IndexRecord> records(pending_.size());
+    for (size_t i = 0; i < pending_.size(); i++) {
+        const auto& [id, location] = pending_[i];
+        std::memcpy(records[i].id, id.data(), id.size());
+        records[i].offset = location.offset;
+        records[i].stored_size = location.stored_size;
+        records[i].raw_size = location.raw_size;
+        records[i].checksum = location.checksum;
+    }
+    pwrite_all(index_fd_, reinterpret_cast<const char*>(records.data()),
+               records.size() * sizeof(IndexRecord), index_size_);
+    if (fdatasync(index_fd_) != 0) {
+        throw std::runtime_error("同步数据块存储失败" + error_text());
+    }
+    index_size_ += records.size() * sizeof(IndexRecord);
+    pending_.clear();
+}
+
+size_t ChunkStore::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return chunks_.size();
+}
+
+ChunkStore::Stats ChunkStore::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
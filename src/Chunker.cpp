@@ -0,0 +1,54 @@
+#include "Chunker.h"
+#include <algorithm>
+#include <array>
+
+namespace {
+// Gear表：每个字节值对应一个固定的64位随机数，由splitmix64生成
+constexpr std::array<uint64_t, 256> make_gear_table() {
+    std::array<uint64_t, 256> table{};
+    uint64_t state = 0x4241434b55504344;  // "BACKUPCD"
+    for (auto& value : table) {
+        state += 0x9e3779b97f4a7c15;
+        uint64_t z = state;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        value = z ^ (z >> 31);
+    }
+    return table;
+}
+
+constexpr std::array<uint64_t, 256> GEAR = make_gear_table();
+
+// 哈希每次左移一位，高位综合了最近64个字节。未达到平均块长前用更多位判断，
+// 切分概率较低；超过之后用较少的位，使块长集中在平均值附近
+constexpr int AVG_BITS = 14;  // log2(AVG_SIZE)
+constexpr uint64_t MASK_SMALL = ~uint64_t{0} << (64 - (AVG_BITS + 2));
+constexpr uint64_t MASK_LARGE = ~uint64_t{0} << (64 - (AVG_BITS - 2));
+static_assert(Chunker::AVG_SIZE == size_t{1} << AVG_BITS);
+}  // namespace
+
+size_t Chunker::next_boundary(const char* data, size_t size) {
+    if (size <= MIN_SIZE) {
+        return size;
+    }
+    const auto* p = reinterpret_cast<const unsigned char*>(data);
+    const size_t end = std::min(size, MAX_SIZE);
+    const size_t normal = std::min(end, AVG_SIZE);
+
+    // 最小块长以内不可能切分，直接跳过
+    uint64_t hash = 0;
+    size_t i = MIN_SIZE;
+    for (; i < normal; i++) {
+        hash = (hash << 1) + GEAR[p[i]];
+        if (!(hash & MASK_SMALL)) {
+            return i + 1;
+        }
+    }
+    for (; i < end; i++) {
+        hash = (hash << 1) + GEAR[p[i]];
+        if (!(hash & MASK_LARGE)) {
+            return i + 1;
+        }
+    }
+    return end;
+}
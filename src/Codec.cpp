@@ -0,0 +1,631 @@
+// 实现数据块编码器：LZW、快速LZ77以及LZ77+哈夫曼编码
+
+#include "Codec.h"
+#include "Archive.h"
+#include "BitWriter.h"
+#include "Compression.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <queue>
+#include <stdexcept>
+
+namespace {
+
+uint32_t read32(const unsigned char* p) {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+// 从已输出的数据中复制匹配串，源和目标可能重叠
+void copy_match(char* dst, size_t offset, size_t length) {
+    const char* src = dst - offset;
+    if (offset >= length) {
+        std::memcpy(dst, src, length);
+    } else {
+        for (size_t i = 0; i < length; ++i) {
+            dst[i] = src[i];
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// LZW：包装LZWCompression，压缩结果自带原始长度
+class LZWCodec : public Codec {
+public:
+    uint8_t id() const override { return CODEC_LZW; }
+    const char* name() const override { return "lzw"; }
+
+    void encode(const char* data, size_t size, std::vector<char>& out) const override {
+        std::vector<char> compressed = LZWCompression::compress({data, size});
+        out.insert(out.end(), compressed.begin(), compressed.end());
+    }
+
+    void decode(const char* data, size_t size, size_t raw_size,
+                std::vector<char>& out) const override {
+        const size_t base = out.size();
+        out.reserve(base + raw_size);
+        LZWCompression::decompress({data, size}, [&](const char* chunk, size_t length) {
+            if (length > raw_size - (out.size() - base)) {
+                throw std::runtime_error("LZW数据解压后长度不符");
+            }
+            out.insert(out.end(), chunk, chunk + length);
+        });
+        if (out.size() - base != raw_size) {
+            throw std::runtime_error("LZW数据解压后长度不符");
+        }
+    }
+};
+
+// ---------------------------------------------------------------------------
+// 快速LZ77，块格式与LZ4类似，每个序列为：
+//   token(高4位字面量长度，低4位匹配长度-4) [扩展字面量长度] 字面量 偏移(2字节) [扩展匹配长度]
+// 长度字段为15时后跟若干扩展字节累加，遇到小于255的字节结束。
+// 最后一个序列只有字面量。级别越高，查找失败时跳过的速度越慢，压缩率越高。
+class LZCodec : public Codec {
+public:
+    explicit LZCodec(int level) : skip_shift_(3 + level) {}
+
+    uint8_t id() const override { return CODEC_LZ; }
+    const char* name() const override { return "lz"; }
+
+    void encode(const char* data, size_t size, std::vector<char>& out) const override {
+        const auto* in = reinterpret_cast<const unsigned char*>(data);
+        std::vector<uint32_t> table(size_t{1} << HASH_BITS, 0);
+        out.reserve(out.size() + size + size / 255 + 16);
+
+        size_t anchor = 0;
+        size_t pos = 0;
+        uint32_t misses = 0;
+        while (pos + MIN_MATCH <= size) {
+            const uint32_t sequence = read32(in + pos);
+            const uint32_t hash = (sequence * 2654435761u) >> (32 - HASH_BITS);
+            size_t candidate = table[hash];
+            table[hash] = static_cast<uint32_t>(pos);
+
+            if (candidate >= pos || pos - candidate > MAX_OFFSET ||
+                read32(in + candidate) != sequence) {
+                // 连续未命中时逐渐加大步长，快速跳过不可压缩的数据
+                pos += 1 + (misses++ >> skip_shift_);
+                continue;
+            }
+
+            size_t length = MIN_MATCH;
+            while (pos + length < size && in[candidate + length] == in[pos + length]) {
+                ++length;
+            }
+            while (pos > anchor && candidate > 0 && in[pos - 1] == in[candidate - 1]) {
+                --pos;
+                --candidate;
+                ++length;
+            }
+            emit(out, in + anchor, pos - anchor, pos - candidate, length);
+            pos += length;
+            anchor = pos;
+            misses = 0;
+        }
+        emit(out, in + anchor, size - anchor, 0, 0);
+    }
+
+    void decode(const char* data, size_t size, size_t raw_size,
+                std::vector<char>& out) const override {
+        const auto* in = reinterpret_cast<const unsigned char*>(data);
+        const size_t base = out.size();
+        out.resize(base + raw_size);
+        char* dst = out.data() + base;
+
+        size_t pos = 0;
+        size_t written = 0;
+        auto read_length = [&](size_t length) {
+            if (length == 15) {
+                unsigned char extra;
+                do {
+                    if (pos >= size) {
+                        throw std::runtime_error("LZ数据不完整");
+                    }
+                    extra = in[pos++];
+                    length += extra;
+                } while (extra == 255);
+            }
+            return length;
+        };
+
+        while (true) {
+            if (pos >= size) {
+                throw std::runtime_error("LZ数据不完整");
+            }
+            const unsigned char token = in[pos++];
+            const size_t literals = read_length(token >> 4);
+            if (literals > size - pos || literals > raw_size - written) {
+                throw std::runtime_error("LZ数据损坏");
+            }
+            if (literals > 0) {
+                std::memcpy(dst + written, in + pos, literals);
+            }
+            pos += literals;
+            written += literals;
+            if (written == raw_size) {
+                break;
+            }
+
+            if (size - pos < 2) {
+                throw std::runtime_error("LZ数据不完整");
+            }
+            const size_t offset = in[pos] | (in[pos + 1] << 8);
+            pos += 2;
+            const size_t length = read_length(token & 0x0F) + MIN_MATCH;
+            if (offset == 0 || offset > written || length > raw_size - written) {
+                throw std::runtime_error("LZ数据损坏");
+            }
+            copy_match(dst + written, offset, length);
+            written += length;
+        }
+        if (pos != size) {
+            throw std::runtime_error("LZ数据损坏");
+        }
+    }
+
+private:
+    static constexpr size_t MIN_MATCH = 4;
+    static constexpr size_t MAX_OFFSET = 65535;
+    static constexpr unsigned HASH_BITS = 16;
+
+    static void put_length(std::vector<char>& out, size_t length) {
+        for (; length >= 255; length -= 255) {
+            out.push_back(static_cast<char>(255));
+        }
+        out.push_back(static_cast<char>(length));
+    }
+
+    // 输出一个序列，match_length为0时只输出字面量（最后一个序列）
+    static void emit(std::vector<char>& out, const unsigned char* literals, size_t literal_length,
+                     size_t offset, size_t match_length) {
+        const size_t match_code = match_length ? match_length - MIN_MATCH : 0;
+        out.push_back(static_cast<char>((std::min<size_t>(literal_length, 15) << 4) |
+                                        std::min<size_t>(match_code, 15)));
+        if (literal_length >= 15) {
+            put_length(out, literal_length - 15);
+        }
+        out.insert(out.end(), literals, literals + literal_length);
+        if (match_length == 0) {
+            return;
+        }
+        out.push_back(static_cast<char>(offset & 0xFF));
+        out.push_back(static_cast<char>(offset >> 8));
+        if (match_code >= 15) {
+            put_length(out, match_code - 15);
+        }
+    }
+
+    unsigned skip_shift_;
+};
+
+// ---------------------------------------------------------------------------
+// LZ77 + 哈夫曼编码
+// 匹配查找使用哈希链，级别决定链的搜索深度，4级以上启用一步惰性匹配。
+// 解析结果按块编码，每块开头是记号数量和两张码表的码长，码长不超过12位。
+// 匹配长度和距离先映射为对数分桶的符号，桶内偏移以额外位直接写出。
+
+// 带边界检查的位流读取器
+class BitReader {
+public:
+    BitReader(const char* data, size_t size)
+        : data_(reinterpret_cast<const unsigned char*>(data)), size_(size) {}
+
+    // 查看接下来的count位，数据末尾不足的部分以0补齐
+    uint32_t peek(unsigned count) {
+        if (bits_ < count) {
+            refill();
+        }
+        return static_cast<uint32_t>(acc_ & ((uint64_t{1} << count) - 1));
+    }
+
+    void skip(unsigned count) {
+        if (bits_ < count) {
+            throw std::runtime_error("LZH数据不完整");
+        }
+        acc_ >>= count;
+        bits_ -= count;
+    }
+
+    uint32_t get(unsigned count) {
+        uint32_t value = peek(count);
+        skip(count);
+        return value;
+    }
+
+private:
+    void refill() {
+        while (bits_ <= 56 && pos_ < size_) {
+            acc_ |= static_cast<uint64_t>(data_[pos_++]) << bits_;
+            bits_ += 8;
+        }
+    }
+
+    const unsigned char* data_;
+    size_t size_;
+    size_t pos_ = 0;
+    uint64_t acc_ = 0;
+    unsigned bits_ = 0;
+};
+
+constexpr unsigned MAX_CODE_BITS = 12;
+constexpr unsigned BUCKET_SYMBOLS = 64;
+constexpr unsigned LITLEN_SYMBOLS = 256 + BUCKET_SYMBOLS;
+constexpr unsigned DIST_SYMBOLS = BUCKET_SYMBOLS;
+
+// 将数值映射为分桶符号：小于4的值直接作为符号，
+// 其余按最高位位置和次高位分桶，剩余低位作为额外位
+struct Bucket {
+    uint32_t symbol;
+    unsigned extra_bits;
+    uint32_t extra;
+};
+
+Bucket to_bucket(uint32_t value) {
+    if (value < 4) {
+        return {value, 0, 0};
+    }
+    const unsigned width = std::bit_width(value);
+    return {2 * width - 2 + ((value >> (width - 2)) & 1), width - 2,
+            value & ((1u << (width - 2)) - 1)};
+}
+
+uint64_t from_bucket(uint32_t symbol, BitReader& reader) {
+    if (symbol < 4) {
+        return symbol;
+    }
+    const unsigned width = (symbol + 2) / 2;
+    const uint64_t high = (uint64_t{2} | (symbol & 1)) << (width - 2);
+    return high | reader.get(width - 2);
+}
+
+// 根据频率计算码长，超过长度上限时把频率减半后重新计算
+void build_lengths(const uint32_t* freq, unsigned symbols, uint8_t* lengths) {
+    std::vector<uint32_t> weights(freq, freq + symbols);
+    std::fill(lengths, lengths + symbols, 0);
+
+    while (true) {
+        struct Node {
+            uint64_t weight;
+            int left;
+            int right;
+        };
+        std::vector<Node> nodes;
+        using Item = std::pair<uint64_t, int>;
+        std::priority_queue<Item, std::vector<Item>, std::greater<Item>> queue;
+        for (unsigned i = 0; i < symbols; ++i) {
+            if (weights[i] > 0) {
+                queue.emplace(weights[i], static_cast<int>(nodes.size()));
+                nodes.push_back({weights[i], -1, static_cast<int>(i)});
+            }
+        }
+        if (nodes.empty()) {
+            return;
+        }
+        if (nodes.size() == 1) {
+            lengths[nodes[0].right] = 1;
+            return;
+        }
+        while (queue.size() > 1) {
+            auto [w1, a] = queue.top();
+            queue.pop();
+            auto [w2, b] = queue.top();
+            queue.pop();
+            queue.emplace(w1 + w2, static_cast<int>(nodes.size()));
+            nodes.push_back({w1 + w2, a, b});
+        }
+
+        // 叶子节点的left为-1，right为符号
+        unsigned max_depth = 0;
+        std::vector<std::pair<int, unsigned>> stack = {{queue.top().second, 0}};
+        while (!stack.empty()) {
+            auto [node, depth] = stack.back();
+            stack.pop_back();
+            if (nodes[node].left < 0) {
+                lengths[nodes[node].right] = static_cast<uint8_t>(depth);
+                max_depth = std::max(max_depth, depth);
+            } else {
+                stack.push_back({nodes[node].left, depth + 1});
+                stack.push_back({nodes[node].right, depth + 1});
+            }
+        }
+        if (max_depth <= MAX_CODE_BITS) {
+            return;
+        }
+        for (auto& weight : weights) {
+            if (weight > 0) {
+                weight = (weight + 1) / 2;
+            }
+        }
+    }
+}
+
+// 由码长生成规范哈夫曼码，码字按位反转以便低位在前写出
+void build_codes(const uint8_t* lengths, unsigned symbols, uint32_t* codes) {
+    uint32_t count[MAX_CODE_BITS + 1] = {};
+    for (unsigned i = 0; i < symbols; ++i) {
+        count[lengths[i]]++;
+    }
+    count[0] = 0;
+    uint32_t next[MAX_CODE_BITS + 1] = {};
+    uint32_t code = 0;
+    for (unsigned bits = 1; bits <= MAX_CODE_BITS; ++bits) {
+        code = (code + count[bits - 1]) << 1;
+        next[bits] = code;
+    }
+    for (unsigned i = 0; i < symbols; ++i) {
+        const unsigned length = lengths[i];
+        if (length == 0) {
+            continue;
+        }
+        uint32_t value = next[length]++;
+        uint32_t reversed = 0;
+        for (unsigned bit = 0; bit < length; ++bit) {
+            reversed = (reversed << 1) | ((value >> bit) & 1);
+        }
+        codes[i] = reversed;
+    }
+}
+
+// 查表解码器，表项为 符号<<4 | 码长，码长为0表示无效码字
+class HuffmanDecoder {
+public:
+    HuffmanDecoder(const uint8_t* lengths, unsigned symbols) : table_(1u << MAX_CODE_BITS, 0) {
+        uint32_t space = 0;
+        for (unsigned i = 0; i < symbols; ++i) {
+            if (lengths[i] > MAX_CODE_BITS) {
+                throw std::runtime_error("LZH码表损坏");
+            }
+            if (lengths[i] > 0) {
+                space += 1u << (MAX_CODE_BITS - lengths[i]);
+            }
+        }
+        if (space > table_.size()) {
+            throw std::runtime_error("LZH码表损坏");
+        }
+        std::vector<uint32_t> codes(symbols);
+        build_codes(lengths, symbols, codes.data());
+        for (unsigned i = 0; i < symbols; ++i) {
+            if (lengths[i] == 0) {
+                continue;
+            }
+            for (uint32_t j = codes[i]; j < table_.size(); j += 1u << lengths[i]) {
+                table_[j] = (i << 4) | lengths[i];
+            }
+        }
+    }
+
+    uint32_t decode(BitReader& reader) const {
+        const uint32_t entry = table_[reader.peek(MAX_CODE_BITS)];
+        if ((entry & 0x0F) == 0) {
+            throw std::runtime_error("LZH数据损坏");
+        }
+        reader.skip(entry & 0x0F);
+        return entry >> 4;
+    }
+
+private:
+    std::vector<uint32_t> table_;
+};
+
+class LZHCodec : public Codec {
+public:
+    explicit LZHCodec(int level) : max_chain_(4u << level), lazy_(level >= 4) {}
+
+    uint8_t id() const override { return CODEC_LZH; }
+    const char* name() const override { return "lzh"; }
+
+    void encode(const char* data, size_t size, std::vector<char>& out) const override {
+        const auto* in = reinterpret_cast<const unsigned char*>(data);
+        BitWriter writer(out);
+        std::vector<Token> tokens;
+        tokens.reserve(std::min<size_t>(size, BLOCK_TOKENS));
+
+        std::vector<uint32_t> head(size_t{1} << HASH_BITS, NIL);
+        std::vector<uint32_t> prev(size);
+        auto insert = [&](size_t pos) {
+            if (pos + MIN_MATCH <= size) {
+                const uint32_t hash = (read32(in + pos) * 2654435761u) >> (32 - HASH_BITS);
+                prev[pos] = head[hash];
+                head[hash] = static_cast<uint32_t>(pos);
+            }
+        };
+        // 沿哈希链查找最长匹配，调用前pos尚未插入
+        auto find = [&](size_t pos) {
+            Token best{0, 0};
+            if (pos + MIN_MATCH > size) {
+                return best;
+            }
+            const size_t max_length = std::min(MAX_MATCH, size - pos);
+            uint32_t candidate = head[(read32(in + pos) * 2654435761u) >> (32 - HASH_BITS)];
+            for (unsigned chain = max_chain_; candidate != NIL && chain > 0;
+                 --chain, candidate = prev[candidate]) {
+                if (in[candidate + best.length] != in[pos + best.length]) {
+                    continue;
+                }
+                size_t length = 0;
+                while (length < max_length && in[candidate + length] == in[pos + length]) {
+                    ++length;
+                }
+                if (length >= MIN_MATCH && length > best.length) {
+                    best = {static_cast<uint32_t>(length), static_cast<uint32_t>(pos - candidate)};
+                    if (length == max_length) {
+                        break;
+                    }
+                }
+            }
+            return best;
+        };
+        auto push = [&](Token token) {
+            tokens.push_back(token);
+            if (tokens.size() == BLOCK_TOKENS) {
+                write_block(tokens, writer);
+                tokens.clear();
+            }
+        };
+
+        size_t pos = 0;
+        Token match = find(pos);
+        insert(pos);
+        while (pos < size) {
+            if (match.length < MIN_MATCH) {
+                push({in[pos], 0});
+                match = find(++pos);
+                insert(pos);
+                continue;
+            }
+            // 惰性匹配：下一个位置有更长的匹配时，当前位置作为字面量输出
+            bool next_inserted = false;
+            if (lazy_ && match.length < MAX_MATCH) {
+                Token next = find(pos + 1);
+                insert(pos + 1);
+                next_inserted = true;
+                if (next.length > match.length) {
+                    push({in[pos], 0});
+                    ++pos;
+                    match = next;
+                    continue;
+                }
+            }
+            push(match);
+            for (size_t i = pos + (next_inserted ? 2 : 1); i < pos + match.length; ++i) {
+                insert(i);
+            }
+            pos += match.length;
+            match = find(pos);
+            insert(pos);
+        }
+        if (!tokens.empty() || size == 0) {
+            write_block(tokens, writer);
+        }
+        writer.flush();
+    }
+
+    void decode(const char* data, size_t size, size_t raw_size,
+                std::vector<char>& out) const override {
+        const size_t base = out.size();
+        out.resize(base + raw_size);
+        char* dst = out.data() + base;
+        BitReader reader(data, size);
+
+        size_t written = 0;
+        do {
+            const uint32_t count = reader.get(BLOCK_COUNT_BITS);
+            if (count > BLOCK_TOKENS) {
+                throw std::runtime_error("LZH数据损坏");
+            }
+            uint8_t lengths[LITLEN_SYMBOLS + DIST_SYMBOLS];
+            for (auto& length : lengths) {
+                length = static_cast<uint8_t>(reader.get(4));
+            }
+            HuffmanDecoder litlen(lengths, LITLEN_SYMBOLS);
+            HuffmanDecoder dist(lengths + LITLEN_SYMBOLS, DIST_SYMBOLS);
+
+            for (uint32_t i = 0; i < count; ++i) {
+                const uint32_t symbol = litlen.decode(reader);
+                if (symbol < 256) {
+                    if (written == raw_size) {
+                        throw std::runtime_error("LZH数据损坏");
+                    }
+                    dst[written++] = static_cast<char>(symbol);
+                    continue;
+                }
+                const uint64_t length = from_bucket(symbol - 256, reader) + MIN_MATCH;
+                const uint64_t offset = from_bucket(dist.decode(reader), reader) + 1;
+                if (offset > written || length > raw_size - written) {
+                    throw std::runtime_error("LZH数据损坏");
+                }
+                copy_match(dst + written, offset, length);
+                written += length;
+            }
+        } while (written < raw_size);
+    }
+
+private:
+    static constexpr size_t MIN_MATCH = 4;
+    static constexpr size_t MAX_MATCH = 65536;
+    static constexpr unsigned HASH_BITS = 16;
+    static constexpr uint32_t NIL = UINT32_MAX;
+    static constexpr unsigned BLOCK_COUNT_BITS = 17;
+    static constexpr size_t BLOCK_TOKENS = 1u << 16;
+
+    // distance为0时length是字面量字节
+    struct Token {
+        uint32_t length;
+        uint32_t distance;
+    };
+
+    static void write_block(const std::vector<Token>& tokens, BitWriter& writer) {
+        uint32_t litlen_freq[LITLEN_SYMBOLS] = {};
+        uint32_t dist_freq[DIST_SYMBOLS] = {};
+        for (const auto& token : tokens) {
+            if (token.distance == 0) {
+                litlen_freq[token.length]++;
+            } else {
+                litlen_freq[256 + to_bucket(token.length - MIN_MATCH).symbol]++;
+                dist_freq[to_bucket(token.distance - 1).symbol]++;
+            }
+        }
+        uint8_t lengths[LITLEN_SYMBOLS + DIST_SYMBOLS];
+        build_lengths(litlen_freq, LITLEN_SYMBOLS, lengths);
+        build_lengths(dist_freq, DIST_SYMBOLS, lengths + LITLEN_SYMBOLS);
+        uint32_t codes[LITLEN_SYMBOLS + DIST_SYMBOLS] = {};
+        build_codes(lengths, LITLEN_SYMBOLS, codes);
+        build_codes(lengths + LITLEN_SYMBOLS, DIST_SYMBOLS, codes + LITLEN_SYMBOLS);
+
+        writer.put(static_cast<uint32_t>(tokens.size()), BLOCK_COUNT_BITS);
+        for (uint8_t length : lengths) {
+            writer.put(length, 4);
+        }
+        for (const auto& token : tokens) {
+            if (token.distance == 0) {
+                writer.put(codes[token.length], lengths[token.length]);
+                continue;
+            }
+            const Bucket length = to_bucket(token.length - MIN_MATCH);
+            const Bucket distance = to_bucket(token.distance - 1);
+            const unsigned length_symbol = 256 + length.symbol;
+            const unsigned distance_symbol = LITLEN_SYMBOLS + distance.symbol;
+            writer.put(codes[length_symbol], lengths[length_symbol]);
+            writer.put(length.extra, length.extra_bits);
+            writer.put(codes[distance_symbol], lengths[distance_symbol]);
+            writer.put(distance.extra, distance.extra_bits);
+        }
+    }
+
+    unsigned max_chain_;
+    bool lazy_;
+};
+
+} // namespace
+
+std::unique_ptr<Codec> Codec::Create(uint8_t id, int level) {
+    if (level < 0 || level > 9) {
+        throw std::runtime_error("压缩级别必须在0到9之间");
+    }
+    switch (id) {
+    case CODEC_LZW:
+        return std::make_unique<LZWCodec>();
+    case CODEC_LZ:
+        return std::make_unique<LZCodec>(level ? level : 1);
+    case CODEC_LZH:
+        return std::make_unique<LZHCodec>(level ? level : 6);
+    default:
+        throw std::runtime_error("不支持的编码方式: " + std::to_string(id));
+    }
+}
+
+uint8_t Codec::IdFromName(const std::string& name) {
+    if (name == "lzw") {
+        return CODEC_LZW;
+    }
+    if (name == "lz") {
+        return CODEC_LZ;
+    }
+    if (name == "lzh") {
+        return CODEC_LZH;
+    }
+    throw std::runtime_error("未知的压缩算法: " + name + "（可选: lzw, lz, lzh）");
+}
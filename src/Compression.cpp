@@ -1,106 +1,322 @@
+// LZW压缩实现
+// 字典以(前缀码, 字节)整数对为键，码字按9到16位变长打包，字典写满后发送CLEAR码重置
+
 #include "Compression.h"
-#include <unordered_map>
+#include "BitWriter.h"
+#include <algorithm>
+#include <bit>
+#include <cstdint>
 #include <cstring>
+#include <memory>
+#include <stdexcept>
 
 namespace LZWCompression {
 
+namespace {
+constexpr uint32_t CLEAR_CODE = 256;       // 重置字典
+constexpr uint32_t FIRST_CODE = 257;       // 第一个可分配的码字
+constexpr unsigned MIN_WIDTH = 9;
+constexpr unsigned MAX_WIDTH = 16;
+constexpr uint32_t MAX_CODES = 1u << MAX_WIDTH;
+
+// 能表示小于next_code的所有码字的最小位宽
+unsigned code_width(uint32_t next_code) {
+    return std::max<unsigned>(MIN_WIDTH, std::bit_width(next_code - 1));
+}
+
+// 压缩字典：开放寻址哈希表，键为 前缀码<<8 | 字节
+// 每个槽位带有代号，重置字典时只需递增代号，不必清空整张表
+class EncoderDictionary {
+public:
+    EncoderDictionary() : slots_(new Slot[TABLE_SIZE]()) {}
+
+    // 查找(prefix, byte)，不存在时返回0（0永远是单字节码，不会作为组合码出现）
+    uint32_t find(uint32_t prefix, uint8_t byte) const {
+        const uint32_t key = tag(prefix, byte);
+        for (uint32_t i = hash(key);; i = (i + 1) & (TABLE_SIZE - 1)) {
+            if (slots_[i].key == key) {
+                return slots_[i].code;
+            }
+            if ((slots_[i].key >> KEY_BITS) != generation_) {
+                return 0;
+            }
+        }
+    }
+
+    void insert(uint32_t prefix, uint8_t byte, uint32_t code) {
+        const uint32_t key = tag(prefix, byte);
+        uint32_t i = hash(key);
+        while ((slots_[i].key >> KEY_BITS) == generation_) {
+            i = (i + 1) & (TABLE_SIZE - 1);
+        }
+        slots_[i].key = key;
+        slots_[i].code = code;
+    }
+
+    void reset() {
+        if (++generation_ == (1u << (32 - KEY_BITS))) {
+            std::fill(slots_.get(), slots_.get() + TABLE_SIZE, Slot{});
+            generation_ = 1;
+        }
+    }
+
+private:
+    static constexpr unsigned KEY_BITS = 24;
+    static constexpr unsigned TABLE_BITS = 17;  // 装载率不超过1/2
+    static constexpr uint32_t TABLE_SIZE = 1u << TABLE_BITS;
+
+    // 键和码字放在一起，一次查找只访问一个缓存行
+    struct Slot {
+        uint32_t key;
+        uint32_t code;
+    };
+
+    uint32_t tag(uint32_t prefix, uint8_t byte) const {
+        return (generation_ << KEY_BITS) | (prefix << 8) | byte;
+    }
+
+    static uint32_t hash(uint32_t key) {
+        return ((key & ((1u << KEY_BITS) - 1)) * 2654435761u) >> (32 - TABLE_BITS);
+    }
+
+    std::unique_ptr<Slot[]> slots_;
+    uint32_t generation_ = 1;
+};
+
+// 解压字典：每个码字记录前缀码、末尾字节、首字节和展开长度
+struct DecoderTable {
+    uint16_t prefix[MAX_CODES];
+    uint8_t suffix[MAX_CODES];
+    uint8_t first[MAX_CODES];
+    uint32_t length[MAX_CODES];
+
+    DecoderTable() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            prefix[i] = 0;
+            suffix[i] = first[i] = static_cast<uint8_t>(i);
+            length[i] = 1;
+        }
+    }
+
+    // 将码字展开写入out，从末尾向前沿前缀链回填
+    void expand(uint32_t code, char* out) const {
+        for (uint32_t i = length[code]; i > 0; --i) {
+            out[i - 1] = static_cast<char>(suffix[code]);
+            code = prefix[code];
+        }
+    }
+};
+}  // namespace
+
+// 压缩格式：uint64 原始长度，随后是低位在前打包的变长码字
 std::vector<char> compress(const std::string_view& data) {
-    // 如果为空
+    std::vector<char> result(sizeof(uint64_t));
+    const uint64_t raw_size = data.size();
+    std::memcpy(result.data(), &raw_size, sizeof(raw_size));
     if (data.empty()) {
-        return {};
+        return result;
     }
-    std::unordered_map<std::string, int> dictionary;
-    std::vector<int> compressed;
-    
-    // 初始化字典（ASCII字符）
-    for (int i = 0; i < 256; i++) {
-        dictionary[std::string(1, static_cast<char>(i))] = i;
-    }
-    
-    std::string current;
-    int next_code = 256;
-    
-    // 压缩数据
-    for (char c : data) {
-        std::string next = current + c;
-        if (dictionary.find(next) != dictionary.end()) {
-            current = next;
-        } else {
-            compressed.push_back(dictionary[current]);
-            dictionary[next] = next_code++;
-            current = std::string(1, c);
+    result.reserve(sizeof(uint64_t) + data.size() / 2);
+
+    BitWriter writer(result);
+    EncoderDictionary dictionary;
+    uint32_t next_code = FIRST_CODE;
+    unsigned width = MIN_WIDTH;
+    uint32_t current = static_cast<uint8_t>(data[0]);
+
+    for (size_t i = 1; i < data.size(); ++i) {
+        const uint8_t byte = static_cast<uint8_t>(data[i]);
+        if (uint32_t code = dictionary.find(current, byte)) {
+            current = code;
+            continue;
         }
+        writer.put(current, width);
+        dictionary.insert(current, byte, next_code++);
+        if (next_code > (1u << width)) {
+            ++width;
+        }
+        if (next_code == MAX_CODES) {
+            writer.put(CLEAR_CODE, width);
+            dictionary.reset();
+            next_code = FIRST_CODE;
+            width = MIN_WIDTH;
+        }
+        current = byte;
     }
-    
-    if (!current.empty()) {
-        compressed.push_back(dictionary[current]);
+    writer.put(current, width);
+    writer.flush();
+    return result;
+}
+
+struct Decoder::State {
+    static constexpr size_t FLUSH_SIZE = 64 * 1024;  // 输出缓冲区积累到该大小时交给回调
+
+    explicit State(Sink output) : sink(std::move(output)) { buffer.reserve(FLUSH_SIZE * 2); }
+
+    void flush() {
+        if (!buffer.empty()) {
+            sink(buffer.data(), buffer.size());
+            buffer.clear();
+        }
+    }
+
+    Sink sink;
+    DecoderTable table;
+    unsigned char header[sizeof(uint64_t)];
+    size_t header_size = 0;
+    uint64_t raw_size = 0;
+    uint64_t out = 0;
+    uint32_t next_code = FIRST_CODE;
+    uint32_t prev = CLEAR_CODE;  // CLEAR_CODE表示字典刚重置，下一个码字没有前缀
+    uint64_t acc = 0;
+    unsigned bits = 0;
+    std::vector<char> buffer;
+};
+
+Decoder::Decoder(Sink sink) : state_(std::make_unique<State>(std::move(sink))) {}
+
+Decoder::~Decoder() = default;
+
+bool Decoder::done() const {
+    return state_->header_size == sizeof(state_->raw_size) && state_->out == state_->raw_size;
+}
+
+void Decoder::feed(const char* data, size_t size) {
+    State& s = *state_;
+    const auto* in = reinterpret_cast<const unsigned char*>(data);
+    size_t pos = 0;
+
+    // 头部：uint64 原始长度
+    while (s.header_size < sizeof(s.raw_size) && pos < size) {
+        s.header[s.header_size++] = in[pos++];
+        if (s.header_size == sizeof(s.raw_size)) {
+            std::memcpy(&s.raw_size, s.header, sizeof(s.raw_size));
+        }
+    }
+
+    while (pos < size) {
+        // 编码端最后只补齐不足一字节的位，数据结束后不应再有完整的字节
+        if (done()) {
+            throw std::runtime_error("LZW数据末尾有多余内容");
+        }
+        s.acc |= static_cast<uint64_t>(in[pos++]) << s.bits;
+        s.bits += 8;
+
+        while (s.out < s.raw_size) {
+            // 编码端在输出码字后才添加字典项，解码端的字典因此总是少一项
+            const unsigned width = code_width(s.next_code + (s.prev != CLEAR_CODE ? 1 : 0));
+            if (s.bits < width) {
+                break;
+            }
+            const uint32_t code = static_cast<uint32_t>(s.acc & ((1u << width) - 1));
+            s.acc >>= width;
+            s.bits -= width;
+
+            if (code == CLEAR_CODE) {
+                s.next_code = FIRST_CODE;
+                s.prev = CLEAR_CODE;
+                continue;
+            }
+            if (code >= MAX_CODES || code > s.next_code ||
+                (code == s.next_code && (s.prev == CLEAR_CODE || s.next_code == MAX_CODES))) {
+                throw std::runtime_error("LZW数据损坏");
+            }
+            DecoderTable& table = s.table;
+            if (s.prev != CLEAR_CODE && s.next_code < MAX_CODES) {
+                // 码字恰好是将要添加的项时(KwKwK)，其末尾字节为前缀的首字节
+                table.prefix[s.next_code] = static_cast<uint16_t>(s.prev);
+                table.suffix[s.next_code] = table.first[code == s.next_code ? s.prev : code];
+                table.first[s.next_code] = table.first[s.prev];
+                table.length[s.next_code] = table.length[s.prev] + 1;
+                ++s.next_code;
+            }
+            const uint32_t length = table.length[code];
+            if (length > s.raw_size - s.out) {
+                throw std::runtime_error("LZW数据损坏");
+            }
+            const size_t at = s.buffer.size();
+            s.buffer.resize(at + length);
+            table.expand(code, s.buffer.data() + at);
+            s.out += length;
+            s.prev = code;
+            if (s.buffer.size() >= State::FLUSH_SIZE) {
+                s.flush();
+            }
+        }
     }
-    
-    // 将压缩后的整数序列转换为字节序列
+    s.flush();
+}
+
+void Decoder::finish() {
+    if (!done()) {
+        throw std::runtime_error("LZW数据不完整");
+    }
+    state_->flush();
+}
+
+void decompress(std::span<const char> data, const Decoder::Sink& sink) {
+    Decoder decoder(sink);
+    decoder.feed(data.data(), data.size());
+    decoder.finish();
+}
+
+std::vector<char> decompress(std::span<const char> data) {
     std::vector<char> result;
-    result.reserve(compressed.size() * sizeof(int));
-    
-    // 写入压缩后的大小
-    size_t comp_size = compressed.size();
-    result.insert(result.end(), 
-                 reinterpret_cast<const char*>(&comp_size),
-                 reinterpret_cast<const char*>(&comp_size) + sizeof(size_t));
-    
-    // 写入压缩数据
-    for (int code : compressed) {
-        result.insert(result.end(),
-                     reinterpret_cast<const char*>(&code),
-                     reinterpret_cast<const char*>(&code) + sizeof(int));
-    }
-    
+    result.reserve(data.size() * 2);
+    decompress(data, [&](const char* chunk, size_t size) {
+        result.insert(result.end(), chunk, chunk + size);
+    });
     return result;
 }
 
-std::vector<char> decompress(const char* data) {
-    // 如果为空
-    if (!data) {
+// 旧格式：size_t 码字数量，随后每个码字按int存储
+std::vector<char> decompress_legacy(const char* data, size_t size) {
+    if (size == 0) {
         return {};
     }
-    // 读取压缩数据大小
     size_t comp_size;
-    std::memcpy(&comp_size, data, sizeof(size_t));
-    data += sizeof(size_t);
-    
-    // 读取压缩数据
-    std::vector<int> compressed;
-    compressed.reserve(comp_size);
-    for (size_t i = 0; i < comp_size; ++i) {
+    if (size < sizeof(comp_size)) {
+        throw std::runtime_error("LZW数据不完整");
+    }
+    std::memcpy(&comp_size, data, sizeof(comp_size));
+    data += sizeof(comp_size);
+    if (comp_size == 0 || comp_size > (size - sizeof(comp_size)) / sizeof(int)) {
+        throw std::runtime_error("LZW数据不完整");
+    }
+
+    auto read_code = [&](size_t i) {
         int code;
         std::memcpy(&code, data + i * sizeof(int), sizeof(int));
-        compressed.push_back(code);
-    }
-    
-    // 初始化字典
+        return code;
+    };
+
     std::vector<std::string> dictionary(256);
     for (int i = 0; i < 256; i++) {
         dictionary[i] = std::string(1, static_cast<char>(i));
     }
-    
+
     std::vector<char> result;
-    std::string w(dictionary[compressed[0]]);
+    int first = read_code(0);
+    if (first < 0 || first >= 256) {
+        throw std::runtime_error("LZW数据损坏");
+    }
+    std::string w(dictionary[first]);
     result.insert(result.end(), w.begin(), w.end());
-    
-    // 解压数据
-    for (size_t i = 1; i < compressed.size(); ++i) {
-        int k = compressed[i];
+
+    for (size_t i = 1; i < comp_size; ++i) {
+        int k = read_code(i);
         std::string entry;
-        
-        if (k < dictionary.size()) {
+        if (k >= 0 && static_cast<size_t>(k) < dictionary.size()) {
             entry = dictionary[k];
-        } else {
+        } else if (static_cast<size_t>(k) == dictionary.size()) {
             entry = w + w[0];
+        } else {
+            throw std::runtime_error("LZW数据损坏");
         }
-        
         result.insert(result.end(), entry.begin(), entry.end());
         dictionary.push_back(w + entry[0]);
         w = entry;
     }
-    
     return result;
 }
 
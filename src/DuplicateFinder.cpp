@@ -0,0 +1,48 @@
+#include "DuplicateFinder.h"
+#include "Checksum.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <stdexcept>
+
+std::optional<std::string> DuplicateFinder::find_or_add(const std::string& path, uint64_t size) {
+    if (size < MIN_SIZE) {
+        return std::nullopt;
+    }
+    std::vector<Candidate>& group = by_size_[size];
+    Candidate current{path, std::nullopt, std::nullopt};
+    for (auto& candidate : group) {
+        if (!current.partial) {
+            current.partial = PartialHash(path, size);
+        }
+        if (!candidate.partial) {
+            candidate.partial = PartialHash(candidate.path, size);
+        }
+        if (*candidate.partial != *current.partial) {
+            continue;
+        }
+        if (!current.full) {
+            current.full = Manifest::HashFile(path);
+        }
+        if (!candidate.full) {
+            candidate.full = Manifest::HashFile(candidate.path);
+        }
+        if (*candidate.full == *current.full) {
+            duplicates_++;
+            duplicate_bytes_ += size;
+            return candidate.path;
+        }
+    }
+    group.push_back(std::move(current));
+    return std::nullopt;
+}
+
+// 计算开头和结尾各PARTIAL_SIZE字节的CRC32，文件较小时两段会重叠
+uint32_t DuplicateFinder::PartialHash(const std::string& path, uint64_t size) {
+    MappedFile file(path);
+    if (file.size() != size) {
+        throw std::runtime_error("文件在打包过程中被修改: " + path);
+    }
+    const size_t length = std::min<uint64_t>(size, PARTIAL_SIZE);
+    const uint32_t head = CRC32::update(file.data(), length);
+    return CRC32::update(file.data() + size - length, length, head);
+}
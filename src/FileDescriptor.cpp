@@ -0,0 +1,87 @@
+// 打包和恢复共用的文件描述符读写辅助函数
+
+#include "FileDescriptor.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+
+namespace {
+[[noreturn]] void throw_errno(const std::string& what, const fs::path& path) {
+    throw std::runtime_error(what + ": " + path.string() + " (" + strerror(errno) + ")");
+}
+}  // namespace
+
+FileDescriptor FileDescriptor::OpenForRead(const fs::path& path) {
+    FileDescriptor file(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (file.fd_ < 0) {
+        throw_errno("无法打开文件", path);
+    }
+    posix_fadvise(file.fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return file;
+}
+
+FileDescriptor FileDescriptor::Create(const fs::path& path) {
+    FileDescriptor file(::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666));
+    if (file.fd_ < 0) {
+        throw_errno("无法创建文件", path);
+    }
+    return file;
+}
+
+FileDescriptor::~FileDescriptor() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+}
+
+void FileDescriptor::DropCache() const {
+    posix_fadvise(fd_, 0, 0, POSIX_FADV_DONTNEED);
+}
+
+void FileDescriptor::Close(const fs::path& path) {
+    const int fd = fd_;
+    fd_ = -1;
+    if (::close(fd) != 0) {
+        throw_errno("关闭文件失败", path);
+    }
+}
+
+void read_exact(int fd, char* data, size_t size, const fs::path& path) {
+    while (size > 0) {
+        ssize_t count = ::read(fd, data, size);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw_errno("读取文件失败", path);
+        }
+        if (count == 0) {
+            throw std::runtime_error("文件在打包过程中被修改: " + path.string());
+        }
+        data += count;
+        size -= count;
+    }
+}
+
+void write_all(int fd, const char* data, size_t size, const fs::path& path) {
+    while (size > 0) {
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw_errno("写入文件失败", path);
+        }
+        data += written;
+        size -= written;
+    }
+}
+
+void remove_existing(const fs::path& path) {
+    if (::unlink(path.c_str()) != 0 && errno != ENOENT && errno != EISDIR) {
+        throw_errno("无法删除已存在的文件", path);
+    }
+}
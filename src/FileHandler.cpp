@@ -3,15 +3,64 @@
 // 支持文件元数据的保存和恢复
 
 #include "FileHandler.h"
+#include "Chunker.h"
+#include "FileDescriptor.h"
+#include "Pipeline.h"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
 #include <cstring>
 #include <filesystem>
+#include <memory>
 #include <stdexcept>
 #include <vector>
+#include <openssl/evp.h>
 #include <spdlog/spdlog.h>
 
+namespace {
+// 复制普通文件内容时的缓冲区大小，大块读写减少系统调用和流操作的次数
+constexpr size_t COPY_BUFFER_SIZE = 1 << 20;
+
+// 边读取文件边计算内容的SHA-256，未开启时不做任何事
+class ContentDigest {
+public:
+  explicit ContentDigest(bool enabled)
+      : ctx_(enabled ? EVP_MD_CTX_new() : nullptr, EVP_MD_CTX_free) {
+    if (enabled && (!ctx_ || EVP_DigestInit_ex(ctx_.get(), EVP_sha256(), nullptr) != 1)) {
+      throw std::runtime_error("初始化哈希计算失败");
+    }
+  }
+
+  void update(const char *data, size_t size) {
+    if (ctx_ && EVP_DigestUpdate(ctx_.get(), data, size) != 1) {
+      throw std::runtime_error("计算文件哈希失败");
+    }
+  }
+
+  // 读完全部内容后取得结果，未开启时为空
+  std::optional<FileHandler::ContentHash> finish() {
+    if (!ctx_) {
+      return std::nullopt;
+    }
+    FileHandler::ContentHash hash;
+    if (EVP_DigestFinal_ex(ctx_.get(), hash.data(), nullptr) != 1) {
+      throw std::runtime_error("计算文件哈希失败");
+    }
+    return hash;
+  }
+
+private:
+  std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> ctx_;
+};
+} // namespace
+
 // 根据文件路径构造处理器
 // 获取文件元数据并初始化文件头
-FileHandler::FileHandler(const fs::path &filepath) : std::fstream() {
+FileHandler::FileHandler(const fs::path &filepath) {
   struct stat file_stat;
   if (lstat(filepath.c_str(), &file_stat) != 0) {
     throw std::runtime_error("无法获取文件信息: " + filepath.string());
@@ -23,12 +72,15 @@ FileHandler::FileHandler(const fs::path &filepath) : std::fstream() {
 
 // 根据文件类型创建对应的处理器
 // 使用 symlink_status 以正确处理符号链接
-std::unique_ptr<FileHandler> FileHandler::Create(const fs::path &path) {
+std::unique_ptr<FileHandler> FileHandler::Create(const fs::path &path, ChunkStore *store) {
   fs::file_type type = fs::symlink_status(path).type();
   switch (type) {
   case fs::file_type::symlink:
     return std::make_unique<SymlinkHandler>(path);
   case fs::file_type::regular:
+    if (store) {
+      return std::make_unique<ChunkedFileHandler>(path, *store);
+    }
     return std::make_unique<RegularFileHandler>(path);
   case fs::file_type::directory:
     return std::make_unique<DirectoryHandler>(path);
@@ -41,7 +93,7 @@ std::unique_ptr<FileHandler> FileHandler::Create(const fs::path &path) {
 
 // 根据文件头信息创建对应的处理器
 // 用于从备份文件还原时创建正确的处理器类型
-std::unique_ptr<FileHandler> FileHandler::Create(const FileHeader &header) {
+std::unique_ptr<FileHandler> FileHandler::Create(const FileHeader &header, ChunkStore *store) {
   auto mode = header.metadata.st_mode;
   switch (mode & S_IFMT) {
   case S_IFLNK:
@@ -52,27 +104,50 @@ std::unique_ptr<FileHandler> FileHandler::Create(const FileHeader &header) {
     return std::make_unique<DirectoryHandler>(header);
   case S_IFIFO:
     return std::make_unique<FIFOHandler>(header);
+  case MODE_WHITEOUT:
+    return std::make_unique<WhiteoutHandler>(header);
+  case MODE_CHUNKED:
+    if (!store) {
+      throw std::runtime_error("文件数据保存在数据块存储中，需要指定存储目录: " +
+                               std::string(header.path));
+    }
+    return std::make_unique<ChunkedFileHandler>(header, *store);
+  case MODE_DUPLICATE:
+    return std::make_unique<DuplicateFileHandler>(header);
   default:
     return nullptr;
   }
 }
 
+char FileHandler::TypeChar(mode_t mode) {
+  switch (mode & S_IFMT) {
+  case S_IFREG:
+  case MODE_CHUNKED:
+  case MODE_DUPLICATE:
+    return '-';
+  case S_IFDIR:
+    return 'd';
+  case S_IFLNK:
+    return 'l';
+  case S_IFIFO:
+    return 'p';
+  case MODE_WHITEOUT:
+    return 'w';
+  default:
+    return '?';
+  }
+}
+
 // 检查文件是否为硬链接
 bool FileHandler::IsHardLink() const {
   return fileheader.metadata.st_nlink > 1;
 }
 
-// 打开文件进行读写操作
-bool FileHandler::OpenFile(std::ios_base::openmode mode_) {
-  this->open(this->fileheader.path, mode_);
-  return is_open();
-}
-
 // 获取文件头信息
 const FileHeader &FileHandler::getFileHeader() const { return fileheader; }
 
 // 将文件头信息写入备份文件
-void FileHandler::WriteHeader(std::ofstream &backup_file) const {
+void FileHandler::WriteHeader(std::ostream &backup_file) const {
   if (!backup_file) {
     throw std::runtime_error("备份文件未打开或无效");
   }
@@ -88,7 +163,7 @@ void FileHandler::WriteHeader(std::ofstream &backup_file) const {
 // 打包普通文件
 // 处理硬链接的特殊情况：对于同一个inode只保存一份数据
 void RegularFileHandler::Pack(
-    std::ofstream &backup_file,
+    std::ostream &backup_file,
     std::unordered_map<ino_t, std::string> &inode_table) {
 
   FileHeader header = this->getFileHeader();
@@ -107,28 +182,44 @@ void RegularFileHandler::Pack(
     }
   }
 
-  // 写入文件头和内容
+  PackData(backup_file, header);
+}
+
+// 写入文件头和内容
+void RegularFileHandler::PackData(std::ostream &backup_file, const FileHeader &header) {
   backup_file.write(reinterpret_cast<const char *>(&header),
                     sizeof(header));
 
-  if (!this->OpenFile()) {
-    throw std::runtime_error("无法打开文件: " + std::string(header.path));
+  // 直接从文件描述符按大块读取，只复制文件头中记录的长度，
+  // 文件在打包过程中变长时也不会写出与文件头不符的数据
+  FileDescriptor file = FileDescriptor::OpenForRead(header.path);
+  ContentDigest digest(hash_content_);
+  uint64_t remaining = header.metadata.st_size;
+  std::vector<char> buffer(std::min<uint64_t>(remaining, COPY_BUFFER_SIZE));
+  while (remaining > 0) {
+    const size_t chunk = std::min<uint64_t>(remaining, buffer.size());
+    read_exact(file.get(), buffer.data(), chunk, header.path);
+    digest.update(buffer.data(), chunk);
+    backup_file.write(buffer.data(), chunk);
+    remaining -= chunk;
+  }
+  if (drop_cache_) {
+    file.DropCache();
   }
-  backup_file << this->rdbuf();
-  this->close();
+  content_hash_ = digest.finish();
 }
 
 // 打包目录
 // 只需保存目录的元数据信息
 void DirectoryHandler::Pack(
-    std::ofstream &backup_file,
+    std::ostream &backup_file,
     std::unordered_map<ino_t, std::string> &inode_table) {
   this->WriteHeader(backup_file);
 }
 
 // 打包符号链接
 // 保存链接本身的元数据和目标路径
-void SymlinkHandler::Pack(std::ofstream &backup_file,
+void SymlinkHandler::Pack(std::ostream &backup_file,
                           std::unordered_map<ino_t, std::string> &inode_table) {
   this->WriteHeader(backup_file);
   FileHeader header = this->getFileHeader();
@@ -138,7 +229,7 @@ void SymlinkHandler::Pack(std::ofstream &backup_file,
 
 // 解包普通文件
 // 处理硬链接和普通文件的还原
-void RegularFileHandler::Unpack(std::ifstream &backup_file, bool restore_metadata) {
+void RegularFileHandler::Unpack(std::istream &backup_file, bool restore_metadata) {
   FileHeader header = this->getFileHeader();
   if (header.metadata.st_nlink > 1) {
     // 处理硬链接
@@ -162,27 +253,36 @@ void RegularFileHandler::Unpack(std::ifstream &backup_file, bool restore_metadat
   fs::path output_path = fs::current_path() / header.path;
   fs::create_directories(output_path.parent_path());
   
-  if(fs::exists(output_path)) {
-    fs::remove(output_path);
-  }
-  
-  std::ofstream output_file(output_path, std::ios::binary);
-  if (!output_file) {
-    throw std::runtime_error("无法创建文件: " + output_path.string());
+  remove_existing(output_path);
+  FileDescriptor output_file = FileDescriptor::Create(output_path);
+
+  uint64_t remaining = header.metadata.st_size;
+  if (auto *mapped = dynamic_cast<SpanReader *>(backup_file.rdbuf())) {
+    // 备份已映射到内存时直接从映射写入，不复制到缓冲区
+    while (remaining > 0) {
+      const std::span<const char> data = mapped->take(remaining);
+      if (data.empty()) {
+        throw std::runtime_error("文件复制失败: " + std::string(header.path));
+      }
+      write_all(output_file.get(), data.data(), data.size(), output_path);
+      remaining -= data.size();
+    }
   }
 
-  // 按块读写文件内容
-  char buffer[4096];
-  std::streamsize remaining = header.metadata.st_size;
+  // 按大块从备份流读取，直接写入文件描述符，不再经过输出文件流的缓冲区
+  std::vector<char> buffer(std::min<uint64_t>(remaining, COPY_BUFFER_SIZE));
   while (remaining > 0) {
-    std::streamsize chunk_size =
-        std::min(remaining, static_cast<std::streamsize>(sizeof(buffer)));
-    backup_file.read(buffer, chunk_size);
-    output_file.write(buffer, backup_file.gcount());
-    remaining -= backup_file.gcount();
+    const size_t chunk = std::min<uint64_t>(remaining, buffer.size());
+    backup_file.read(buffer.data(), chunk);
+    if (static_cast<size_t>(backup_file.gcount()) != chunk) {
+      throw std::runtime_error("文件复制失败: " + std::string(header.path));
+    }
+    write_all(output_file.get(), buffer.data(), chunk, output_path);
+    remaining -= chunk;
   }
+  output_file.Close(output_path);
 
-  if (backup_file.fail() || output_file.fail()) {
+  if (backup_file.fail()) {
     throw std::runtime_error("文件复制失败: " + std::string(header.path));
   }
 
@@ -193,7 +293,7 @@ void RegularFileHandler::Unpack(std::ifstream &backup_file, bool restore_metadat
 
 // 解包目录
 // 创建目录并恢复其元数据
-void DirectoryHandler::Unpack(std::ifstream &backup_file, bool restore_metadata) {
+void DirectoryHandler::Unpack(std::istream &backup_file, bool restore_metadata) {
   FileHeader header = this->getFileHeader();
   fs::path dir_path = fs::current_path() / header.path;
   fs::create_directories(dir_path);
@@ -205,7 +305,7 @@ void DirectoryHandler::Unpack(std::ifstream &backup_file, bool restore_metadata)
 
 // 解包符号链接
 // 创建新的符号链接并恢复其元数据
-void SymlinkHandler::Unpack(std::ifstream &backup_file, bool restore_metadata) {
+void SymlinkHandler::Unpack(std::istream &backup_file, bool restore_metadata) {
   FileHeader header = this->getFileHeader();
   std::string target_path = ReadLongPath(backup_file);
   
@@ -224,7 +324,7 @@ void SymlinkHandler::Unpack(std::ifstream &backup_file, bool restore_metadata) {
 }
 
 // 写入长路径到备份文件
-void FileHandler::WriteLongPath(std::ofstream &backup_file, const std::string &path) const {
+void FileHandler::WriteLongPath(std::ostream &backup_file, const std::string &path) const {
     // 先写入路径总长度
     uint32_t path_length = path.length();
     backup_file.write(reinterpret_cast<const char*>(&path_length), sizeof(path_length));
@@ -234,20 +334,25 @@ void FileHandler::WriteLongPath(std::ofstream &backup_file, const std::string &p
 }
 
 // 从备份文件读取长路径
-std::string FileHandler::ReadLongPath(std::ifstream &backup_file) const {
-    // 读取路径长度
+std::string FileHandler::ReadLongPath(std::istream &backup_file) {
+    // 读取路径长度，超出系统路径长度限制说明数据已损坏
     uint32_t path_length;
     backup_file.read(reinterpret_cast<char*>(&path_length), sizeof(path_length));
+    if (backup_file.gcount() != sizeof(path_length) || path_length > PATH_MAX) {
+        throw std::runtime_error("路径数据无效");
+    }
     
     // 读取实际路径
-    std::vector<char> buffer(path_length + 1, '\0');
-    backup_file.read(buffer.data(), path_length);
-    
-    return std::string(buffer.data(), path_length);
+    std::string path(path_length, '\0');
+    backup_file.read(path.data(), path_length);
+    if (static_cast<uint32_t>(backup_file.gcount()) != path_length) {
+        throw std::runtime_error("路径数据不完整");
+    }
+    return path;
 }
 
 // 恢复文件的元数据
-void FileHandler::RestoreMetadata(const fs::path& path, const struct stat& metadata) const {
+void FileHandler::RestoreMetadata(const fs::path& path, const struct stat& metadata) {
   const char* path_str = path.c_str();
 
     // 还原文件权限信息
@@ -268,14 +373,14 @@ void FileHandler::RestoreMetadata(const fs::path& path, const struct stat& metad
 }
 
 // 打包管道文件
-void FIFOHandler::Pack(std::ofstream &backup_file,
+void FIFOHandler::Pack(std::ostream &backup_file,
                       std::unordered_map<ino_t, std::string> &inode_table) {
     // 管道文件只需要保存文件头信息
     this->WriteHeader(backup_file);
 }
 
 // 解包管道文件
-void FIFOHandler::Unpack(std::ifstream &backup_file, bool restore_metadata) {
+void FIFOHandler::Unpack(std::istream &backup_file, bool restore_metadata) {
     FileHeader header = this->getFileHeader();
     fs::path fifo_path = fs::current_path() / header.path;
     
@@ -298,3 +403,154 @@ void FIFOHandler::Unpack(std::ifstream &backup_file, bool restore_metadata) {
         RestoreMetadata(fifo_path, header.metadata);
     }
 }
+
+// 生成删除标记，只有路径和类型有意义
+FileHeader WhiteoutHandler::MakeHeader(const std::string &path) {
+    FileHeader header{};
+    std::snprintf(header.path, MAX_PATH_LEN, "%s", path.c_str());
+    header.metadata.st_mode = MODE_WHITEOUT;
+    return header;
+}
+
+// 打包删除标记，没有数据
+void WhiteoutHandler::Pack(std::ostream &backup_file,
+                           std::unordered_map<ino_t, std::string> & /*inode_table*/) {
+    this->WriteHeader(backup_file);
+}
+
+// 删除之前还原的文件或目录，不存在时忽略
+void WhiteoutHandler::Unpack(std::istream & /*backup_file*/, bool /*restore_metadata*/) {
+    fs::path path = fs::current_path() / this->getFileHeader().path;
+    fs::remove_all(path);
+}
+
+static_assert(sizeof(ChunkRef) == 36, "数据块列表的条目按36字节写入备份");
+
+// 切分文件内容并存入数据块存储，记录中写入数据块列表
+// 缓冲区中至少保留一个最大块长的数据再寻找切分点，切分结果与一次读入整个文件相同
+void ChunkedFileHandler::PackData(std::ostream &backup_file, const FileHeader &header) {
+  FileDescriptor file = FileDescriptor::OpenForRead(header.path);
+  ContentDigest digest(hash_content_);
+  std::vector<ChunkRef> chunks;
+  std::vector<char> buffer(4 * Chunker::MAX_SIZE);
+  size_t begin = 0;
+  size_t end = 0;
+  uint64_t remaining = header.metadata.st_size;
+  while (remaining > 0 || begin < end) {
+    if (end - begin < Chunker::MAX_SIZE && remaining > 0) {
+      std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+      end -= begin;
+      begin = 0;
+      const size_t count = std::min<uint64_t>(buffer.size() - end, remaining);
+      read_exact(file.get(), buffer.data() + end, count, header.path);
+      digest.update(buffer.data() + end, count);
+      end += count;
+      remaining -= count;
+    }
+    const size_t length = Chunker::next_boundary(buffer.data() + begin, end - begin);
+    chunks.push_back({store_.put(buffer.data() + begin, length), static_cast<uint32_t>(length)});
+    begin += length;
+  }
+  if (drop_cache_) {
+    file.DropCache();
+  }
+  content_hash_ = digest.finish();
+
+  FileHeader chunked = header;
+  chunked.metadata.st_mode = (header.metadata.st_mode & ~S_IFMT) | MODE_CHUNKED;
+  backup_file.write(reinterpret_cast<const char *>(&chunked), sizeof(chunked));
+  const uint32_t count = chunks.size();
+  backup_file.write(reinterpret_cast<const char *>(&count), sizeof(count));
+  backup_file.write(reinterpret_cast<const char *>(chunks.data()), count * sizeof(ChunkRef));
+}
+
+// 读取数据块列表，数量和长度与文件大小不符说明数据已损坏
+std::vector<ChunkRef> ChunkedFileHandler::ReadChunkList(std::istream &backup_file,
+                                                        const struct stat &metadata) {
+  uint32_t count;
+  backup_file.read(reinterpret_cast<char *>(&count), sizeof(count));
+  if (backup_file.gcount() != sizeof(count) || metadata.st_size < 0 ||
+      count > static_cast<uint64_t>(metadata.st_size)) {
+    throw std::runtime_error("数据块列表无效");
+  }
+  std::vector<ChunkRef> chunks;
+  uint64_t total = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    ChunkRef chunk;
+    backup_file.read(reinterpret_cast<char *>(&chunk), sizeof(chunk));
+    if (backup_file.gcount() != sizeof(chunk)) {
+      throw std::runtime_error("数据块列表不完整");
+    }
+    if (chunk.size == 0) {
+      throw std::runtime_error("数据块列表无效");
+    }
+    total += chunk.size;
+    chunks.push_back(chunk);
+  }
+  if (total != static_cast<uint64_t>(metadata.st_size)) {
+    throw std::runtime_error("数据块长度与文件大小不符");
+  }
+  return chunks;
+}
+
+// 读取一个数据块，长度与列表中记录的不同时抛出异常
+void ChunkedFileHandler::ReadChunk(const ChunkStore &store, const ChunkRef &chunk,
+                                   std::vector<char> &out) {
+  store.get(chunk.id, out);
+  if (out.size() != chunk.size) {
+    throw std::runtime_error("数据块长度与列表不符");
+  }
+}
+
+// 解包存储在数据块存储中的文件，按列表依次取出数据块写入
+void ChunkedFileHandler::Unpack(std::istream &backup_file, bool restore_metadata) {
+  const FileHeader &header = this->getFileHeader();
+  const std::vector<ChunkRef> chunks = ReadChunkList(backup_file, header.metadata);
+
+  fs::path output_path = fs::current_path() / header.path;
+  fs::create_directories(output_path.parent_path());
+  remove_existing(output_path);
+  FileDescriptor output_file = FileDescriptor::Create(output_path);
+  std::vector<char> data;
+  for (const auto &chunk : chunks) {
+    ReadChunk(store_, chunk, data);
+    write_all(output_file.get(), data.data(), data.size(), output_path);
+  }
+  output_file.Close(output_path);
+
+  if (restore_metadata) {
+    RestoreMetadata(output_path, header.metadata);
+  }
+}
+
+// 写入文件头和原文件的路径
+void DuplicateFileHandler::PackData(std::ostream &backup_file, const FileHeader &header) {
+  FileHeader duplicate = header;
+  duplicate.metadata.st_mode = (header.metadata.st_mode & ~S_IFMT) | MODE_DUPLICATE;
+  backup_file.write(reinterpret_cast<const char *>(&duplicate), sizeof(duplicate));
+  WriteLongPath(backup_file, original_);
+}
+
+// 复制之前已还原的原文件
+void DuplicateFileHandler::Unpack(std::istream &backup_file, bool restore_metadata) {
+  const FileHeader &header = this->getFileHeader();
+  const std::string original = ReadLongPath(backup_file);
+  fs::path output_path = fs::current_path() / header.path;
+  fs::create_directories(output_path.parent_path());
+  CopyContent(fs::current_path() / original, output_path);
+
+  if (restore_metadata) {
+    RestoreMetadata(output_path, header.metadata);
+  }
+}
+
+void DuplicateFileHandler::CopyContent(const fs::path &source, const fs::path &target) {
+  remove_existing(target);
+  FileDescriptor in = FileDescriptor::OpenForRead(source);
+  FileDescriptor out = FileDescriptor::Create(target);
+  const bool cloned = ioctl(out.get(), FICLONE, in.get()) == 0;
+  out.Close(target);
+  if (!cloned) {
+    fs::copy_file(source, target, fs::copy_options::overwrite_existing);
+  }
+}
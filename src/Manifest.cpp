@@ -0,0 +1,174 @@
+// 实现备份清单的读写和文件内容哈希
+
+#include "Manifest.h"
+#include "Checksum.h"
+#include "MappedFile.h"
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+#include <openssl/evp.h>
+
+namespace {
+constexpr char MANIFEST_MAGIC[4] = {'B', 'K', 'M', 'F'};
+constexpr uint16_t MANIFEST_VERSION = 1;
+
+// 每个条目除路径外的固定长度
+constexpr size_t ENTRY_FIXED_SIZE = sizeof(uint16_t) + sizeof(uint32_t) + 3 * sizeof(uint64_t) +
+                                    sizeof(ManifestEntry::Hash);
+
+template <class T>
+void put(std::vector<char>& out, const T& value) {
+    const char* bytes = reinterpret_cast<const char*>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+// 带边界检查的顺序读取
+class ManifestReader {
+public:
+    ManifestReader(const char* data, size_t size) : data_(data), size_(size) {}
+
+    template <class T>
+    T get() {
+        T value;
+        std::memcpy(&value, take(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    std::string get_string(size_t length) {
+        const char* bytes = take(length);
+        return std::string(bytes, length);
+    }
+
+    size_t remaining() const { return size_ - pos_; }
+
+private:
+    const char* take(size_t length) {
+        if (length > size_ - pos_) {
+            throw std::runtime_error("清单数据不完整");
+        }
+        const char* bytes = data_ + pos_;
+        pos_ += length;
+        return bytes;
+    }
+
+    const char* data_;
+    size_t size_;
+    size_t pos_ = 0;
+};
+} // namespace
+
+ManifestEntry ManifestEntry::FromStat(const std::string& path, const struct stat& metadata) {
+    ManifestEntry entry;
+    entry.path = path;
+    entry.mode = metadata.st_mode;
+    entry.inode = metadata.st_ino;
+    entry.size = metadata.st_size;
+    entry.mtime_ns = static_cast<int64_t>(metadata.st_mtim.tv_sec) * 1000000000 +
+                     metadata.st_mtim.tv_nsec;
+    return entry;
+}
+
+bool ManifestEntry::same_metadata(const ManifestEntry& other) const {
+    return mode == other.mode && inode == other.inode && size == other.size &&
+           mtime_ns == other.mtime_ns;
+}
+
+void Manifest::add(ManifestEntry entry) {
+    std::string path = entry.path;
+    entries_.insert_or_assign(std::move(path), std::move(entry));
+}
+
+const ManifestEntry* Manifest::find(const std::string& path) const {
+    auto it = entries_.find(path);
+    return it != entries_.end() ? &it->second : nullptr;
+}
+
+void Manifest::Save(const fs::path& path) const {
+    std::vector<char> out;
+    out.insert(out.end(), std::begin(MANIFEST_MAGIC), std::end(MANIFEST_MAGIC));
+    put(out, MANIFEST_VERSION);
+    put<uint16_t>(out, 0);
+    put<uint64_t>(out, entries_.size());
+    for (const auto& [name, entry] : entries_) {
+        if (name.size() > UINT16_MAX) {
+            throw std::runtime_error("清单中的路径过长: " + name);
+        }
+        put<uint16_t>(out, name.size());
+        out.insert(out.end(), name.begin(), name.end());
+        put(out, entry.mode);
+        put(out, entry.inode);
+        put(out, entry.size);
+        put(out, entry.mtime_ns);
+        out.insert(out.end(), entry.hash.begin(), entry.hash.end());
+    }
+    put(out, CRC32::update(out.data(), out.size()));
+
+    fs::path temp = path;
+    temp += ".tmp";
+    std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        throw std::runtime_error("无法创建清单文件: " + temp.string());
+    }
+    file.write(out.data(), out.size());
+    file.close();
+    if (!file) {
+        fs::remove(temp);
+        throw std::runtime_error("写入清单文件失败: " + temp.string());
+    }
+    fs::rename(temp, path);
+}
+
+Manifest Manifest::Load(const fs::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("无法打开清单文件: " + path.string());
+    }
+    std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (data.size() < sizeof(MANIFEST_MAGIC) + sizeof(uint32_t) ||
+        std::memcmp(data.data(), MANIFEST_MAGIC, sizeof(MANIFEST_MAGIC)) != 0) {
+        throw std::runtime_error("不是有效的清单文件: " + path.string());
+    }
+    const size_t body = data.size() - sizeof(uint32_t);
+    uint32_t checksum;
+    std::memcpy(&checksum, data.data() + body, sizeof(checksum));
+    if (CRC32::update(data.data(), body) != checksum) {
+        throw std::runtime_error("清单文件校验失败: " + path.string());
+    }
+
+    ManifestReader reader(data.data() + sizeof(MANIFEST_MAGIC), body - sizeof(MANIFEST_MAGIC));
+    if (reader.get<uint16_t>() != MANIFEST_VERSION) {
+        throw std::runtime_error("不支持的清单版本: " + path.string());
+    }
+    reader.get<uint16_t>();
+    const uint64_t count = reader.get<uint64_t>();
+    if (count > reader.remaining() / ENTRY_FIXED_SIZE) {
+        throw std::runtime_error("清单条目数量无效");
+    }
+
+    Manifest manifest;
+    for (uint64_t i = 0; i < count; i++) {
+        ManifestEntry entry;
+        entry.path = reader.get_string(reader.get<uint16_t>());
+        entry.mode = reader.get<uint32_t>();
+        entry.inode = reader.get<uint64_t>();
+        entry.size = reader.get<uint64_t>();
+        entry.mtime_ns = reader.get<int64_t>();
+        entry.hash = reader.get<ManifestEntry::Hash>();
+        manifest.add(std::move(entry));
+    }
+    return manifest;
+}
+
+ManifestEntry::Hash Manifest::HashFile(const fs::path& path) {
+    MappedFile file(path);
+    file.advise_sequential();
+    ManifestEntry::Hash hash{};
+    // 空文件没有映射，data()为空
+    const char* data = file.data() ? file.data() : "";
+    if (EVP_Digest(data, file.size(), hash.data(), nullptr, EVP_sha256(), nullptr) != 1) {
+        throw std::runtime_error("计算文件哈希失败: " + path.string());
+    }
+    return hash;
+}
@@ -0,0 +1,61 @@
+#include "MappedFile.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::filesystem::path& path) {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("无法打开文件: " + path.string());
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw std::runtime_error("无法读取文件信息: " + path.string());
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    // 空文件不能映射，此时data()为空
+    if (size_ > 0) {
+        void* mapped = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED) {
+            ::close(fd);
+            throw std::runtime_error("无法映射文件: " + path.string());
+        }
+        data_ = static_cast<const char*>(mapped);
+    }
+    // 映射建立后即可关闭文件描述符
+    ::close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (data_) {
+        munmap(const_cast<char*>(data_), size_);
+    }
+}
+
+std::span<const char> MappedFile::range(size_t offset, size_t length) const {
+    if (offset > size_ || length > size_ - offset) {
+        throw std::runtime_error("读取位置超出文件范围");
+    }
+    return {data_ + offset, length};
+}
+
+void MappedFile::advise_sequential() const {
+    if (data_) {
+        madvise(const_cast<char*>(data_), size_, MADV_SEQUENTIAL);
+    }
+}
+
+void MappedFile::advise_willneed(size_t offset, size_t length) const {
+    if (offset >= size_) {
+        return;
+    }
+    // madvise的起始地址须按页对齐
+    const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t begin = offset / page * page;
+    const size_t end = offset + std::min(length, size_ - offset);
+    madvise(const_cast<char*>(data_) + begin, end - begin, MADV_WILLNEED);
+}
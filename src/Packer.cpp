@@ -2,123 +2,309 @@
 // 支持文件压缩、加密和完整性校验
 
 #include "Packer.h"
+#include "ArchiveIO.h"
+#include "Checksum.h"
+#include "ChunkStore.h"
+#include "DuplicateFinder.h"
+#include "FileDescriptor.h"
+#include "MappedFile.h"
+#include "Manifest.h"
 #include "Compression.h"
-#include <fstream>
-#include <array>
+#include "Pipeline.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cstring>
 #include <filesystem>
+#include <sstream>
+#include <unordered_set>
+#include <deque>
+#include <optional>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <unistd.h>
+#include <openssl/rand.h>
 #include <spdlog/spdlog.h>
 
-// 计算CRC32校验和
-// 使用查表法提高计算效率
+// 计算CRC32校验和，见Checksum.h
 uint32_t Packer::calculateCRC32(const char* data, size_t length, uint32_t crc) const {
-    // 生成CRC32查找表
-    static const std::array<uint32_t, 256> crc32_table = []() {
-        std::array<uint32_t, 256> table;
-        constexpr uint32_t POLYNOMIAL = 0xEDB88320;
-        for (uint32_t i = 0; i < 256; i++) {
-            uint32_t c = i;
-            for (uint32_t j = 0; j < 8; j++) {
-                c = (c >> 1) ^ ((c & 1) ? POLYNOMIAL : 0);
-            }
-            table[i] = c;
-        }
-        return table;
-    }();
+    return CRC32::update(data, length, crc);
+}
 
-    // 计算CRC32校验和
-    crc = ~crc;
-    while (length--) {
-        crc = (crc >> 8) ^ crc32_table[(crc & 0xFF) ^ static_cast<uint8_t>(*data++)];
+namespace {
+// 在一次操作期间打开数据块存储，结束时关闭，写入时持有的锁随之释放
+class StoreScope {
+public:
+    StoreScope(std::shared_ptr<ChunkStore>& store, const fs::path& dir, bool writable,
+               uint8_t codec = CODEC_NONE, int level = 0)
+        : store_(store) {
+        if (!dir.empty()) {
+            store_ = std::make_shared<ChunkStore>(dir, writable, codec, level);
+        }
     }
-    return ~crc;
-}
+    ~StoreScope() { store_.reset(); }
+
+private:
+    std::shared_ptr<ChunkStore>& store_;
+};
+}  // namespace
 
 // 打包文件的主函数
-// 处理流程：打包 -> 压缩(可选) -> 加密(可选) -> 计算校验和 -> 写入文件
+// 处理流程：打包 -> 按窗口分帧 -> 压缩(可选) -> 加密(可选) -> 计算校验和 -> 写入文件
+// 各阶段以帧为单位流式处理，不产生临时文件，内存占用只取决于窗口大小和线程数。
+// 数据帧之后写入索引帧和文件尾，格式见Archive.h
 bool Packer::Pack(const fs::path& source_path, const fs::path& target_path) {
+    std::unique_ptr<ArchiveWriter> target_file;
     try {
         // 验证源路径存在
         if (!fs::exists(source_path)) {
             throw std::runtime_error("源路径不存在: " + source_path.string());
         }
         spdlog::info("开始打包: {} -> {}", source_path.string(), target_path.string());
-
-        // 创建临时文件用于打包
-        fs::path temp_path = target_path.parent_path() / (target_path.stem().string() + ".tmp");
-        
-        // 先执行基础打包，不包含header和校验和
-        if (!PackToFile(source_path, temp_path)) {
-            throw std::runtime_error("打包到临时文件失败");
+        if (encrypt_ && !store_path_.empty()) {
+            throw std::runtime_error("数据块存储不支持加密");
+        }
+        StoreScope store_scope(store_, store_path_, true, codec_, level_);
+        if (store_) {
+            spdlog::info("使用数据块存储: {} (已有{}个数据块)", store_path_.string(), store_->size());
         }
 
-        // 读取临时文件数据
-        std::ifstream temp_file(temp_path, std::ios::binary);
-        if (!temp_file) {
-            fs::remove(temp_path);
-            throw std::runtime_error("无法打开临时文件");
+        // 增量备份读取基础清单；写清单或增量备份时记录本次各文件的状态。
+        // 打包时会切换工作目录，相对路径需要先解析
+        std::unique_ptr<Manifest> base;
+        std::unique_ptr<Manifest> snapshot;
+        if (!base_manifest_.empty()) {
+            base = std::make_unique<Manifest>(Manifest::Load(base_manifest_));
+            spdlog::info("增量备份，基础清单: {} ({}个文件)", base_manifest_.string(),
+                         base->entries().size());
+        }
+        const fs::path manifest_path = manifest_path_.empty() ? fs::path() : fs::absolute(manifest_path_);
+        if (base || !manifest_path.empty()) {
+            snapshot = std::make_unique<Manifest>();
         }
 
-        // 将临时文件数据读入内存
-        std::vector<char> file_data((std::istreambuf_iterator<char>(temp_file)),
-                                   std::istreambuf_iterator<char>());
-        temp_file.close();
-        fs::remove(temp_path);  // 立即删除临时文件
+        target_file = std::make_unique<ArchiveWriter>(target_path, direct_io_);
+        if (direct_io_ && !target_file->direct()) {
+            spdlog::warn("文件系统不支持直接I/O，使用普通写入: {}", target_path.string());
+        }
 
-        // 处理数据：压缩和加密
-        std::vector<char> final_data;
-        if (compress_) {
+        backup_header_.mod |= MOD_FRAMED;
+        if (codec_ != CODEC_NONE) {
             spdlog::info("压缩数据");
-            final_data = LZWCompression::compress({file_data.data(), file_data.size()});
-        } else {
-            final_data = std::move(file_data);
         }
-
         if (encrypt_) {
             spdlog::info("加密数据");
-            final_data = aes_->encrypt({final_data.data(), final_data.size()});
         }
 
-        // 计算并更新校验和
-        uint32_t checksum = calculateCRC32(final_data.data(), final_data.size());
+        // 先写入占位的header，校验和在数据写完后回填
         backup_header_.timestamp = std::time(nullptr);
-        backup_header_.checksum = checksum;
+        backup_header_.checksum = 0;
+        target_file->write(reinterpret_cast<const char*>(&backup_header_), sizeof(BackupHeader));
+
+        uint32_t checksum = 0xFFFFFFFF;
+        auto write_out = [&](const char* data, size_t size) {
+            checksum = calculateCRC32(data, size, checksum);
+            target_file->write(data, size);
+        };
 
-        // 写入最终文件
-        std::ofstream target_file(target_path, std::ios::binary);
-        if (!target_file) {
-            throw std::runtime_error("无法创建最终备份文件");
+        ArchiveInfo info{};
+        std::memcpy(info.magic, ARCHIVE_MAGIC, sizeof(info.magic));
+        info.version = ARCHIVE_VERSION;
+        info.info_size = sizeof(ArchiveInfo);
+        info.codec = codec_;
+        info.cipher = encrypt_ ? CIPHER_AES_GCM_AAD : CIPHER_NONE;
+        info.frame_size = static_cast<uint32_t>(window_size_);
+        const AESModule* aes = nullptr;
+        if (encrypt_) {
+            const KdfParams& params = key_->params();
+            info.kdf = params.algorithm;
+            info.kdf_cost = params.cost;
+            std::memcpy(info.salt, params.salt.data(), sizeof(info.salt));
+            // 同一个句柄的盐值在整批备份中相同，每个备份另取随机数派生自己的密钥
+            if (1 != RAND_bytes(info.key_nonce, sizeof(info.key_nonce))) {
+                throw std::runtime_error("生成随机数失败");
+            }
+            aes = &key_->module(params);
+        }
+        if (store_) {
+            std::memcpy(info.store_id, store_->id().data(), sizeof(info.store_id));
+        }
+        write_out(reinterpret_cast<const char*>(&info), sizeof(info));
+
+        FrameCodec codec(info, aes, level_);
+        ArchiveIndex index;
+
+        // 编码一帧并计算帧头，多线程时在工作线程中执行
+        struct EncodedFrame {
+            FrameHeader header;
+            std::vector<char> stored;
+        };
+        auto encode_frame = [this, &codec](const char* data, size_t size, uint64_t number) {
+            EncodedFrame frame;
+            frame.stored = codec.encode(data, size, number);
+            if (frame.stored.size() > UINT32_MAX) {
+                throw std::runtime_error("数据帧过大");
+            }
+            frame.header.raw_size = static_cast<uint32_t>(size);
+            frame.header.stored_size = static_cast<uint32_t>(frame.stored.size());
+            frame.header.checksum = calculateCRC32(frame.stored.data(), frame.stored.size());
+            return frame;
+        };
+
+        // 将帧头和存储数据一起写入文件。帧头中已有存储数据的校验和，
+        // 整个文件的校验和由它合并得到，不再逐字节重新计算
+        auto write_frame = [&](const FrameHeader& header, const char* stored) {
+            FrameInfo frame_info{target_file->size(), header.stored_size, header.raw_size,
+                                 header.checksum};
+            checksum = calculateCRC32(reinterpret_cast<const char*>(&header), sizeof(header), checksum);
+            checksum = CRC32::combine(checksum, header.checksum, header.stored_size);
+            target_file->write(reinterpret_cast<const char*>(&header), sizeof(header), stored,
+                               header.stored_size);
+            return frame_info;
+        };
+        auto write_encoded = [&](const EncodedFrame& frame) {
+            return write_frame(frame.header, frame.stored.data());
+        };
+
+        // 多线程时各帧在线程池中并发压缩、加密，调用线程按顺序写出；
+        // 在途的帧数受限，内存占用约为 窗口大小 × 线程数 × 2
+        std::unique_ptr<ThreadPool> encoders;
+        if (threads_ > 1) {
+            encoders = std::make_unique<ThreadPool>(threads_);
         }
+        std::deque<std::future<EncodedFrame>> pending;
+        auto write_pending = [&](size_t limit) {
+            while (pending.size() > limit) {
+                index.frames.push_back(write_encoded(pending.front().get()));
+                pending.pop_front();
+            }
+        };
 
-        // 写入header和数据
-        target_file.write(reinterpret_cast<const char*>(&backup_header_), sizeof(BackupHeader));
-        target_file.write(final_data.data(), final_data.size());
-        target_file.close();
+        uint64_t frame_number = 0;
+        ChunkWriter writer(window_size_, [&](const char* data, size_t size) {
+            const uint64_t number = frame_number++;
+            if (codec.passthrough()) {
+                // 不压缩不加密时窗口中的数据就是存储数据，直接写出，不复制也不经过线程池
+                FrameHeader header;
+                header.raw_size = static_cast<uint32_t>(size);
+                header.stored_size = static_cast<uint32_t>(size);
+                header.checksum = calculateCRC32(data, size);
+                index.frames.push_back(write_frame(header, data));
+                return;
+            }
+            if (!encoders) {
+                index.frames.push_back(write_encoded(encode_frame(data, size, number)));
+                return;
+            }
+            pending.push_back(encoders->submit(
+                [&encode_frame, number, chunk = std::vector<char>(data, data + size)] {
+                    return encode_frame(chunk.data(), chunk.size(), number);
+                }));
+            write_pending(threads_ * 2);
+        });
 
+        std::ostream backup_stream(&writer);
+        // 让流水线中的错误以异常形式传出，而不是只设置流状态
+        backup_stream.exceptions(std::ios::badbit);
+        if (!PackToStream(source_path, backup_stream, index.entries, base.get(), snapshot.get())) {
+            throw std::runtime_error("打包文件失败");
+        }
+        // 备份引用的数据块先写入存储的索引，再写出备份的其余部分
+        if (store_) {
+            store_->flush();
+            const ChunkStore::Stats stats = store_->stats();
+            spdlog::info("数据块存储: 新增{}块({}字节)，复用{}块({}字节)", stats.chunks_added,
+                         stats.bytes_added, stats.chunks_reused, stats.bytes_reused);
+        }
+        writer.finish();
+        write_pending(0);
+
+        // 写入索引帧和文件尾
+        ArchiveTrailer trailer{};
+        trailer.frame_count = index.frames.size();
+        std::vector<char> index_data = index.serialize();
+        trailer.index_offset =
+            write_encoded(encode_frame(index_data.data(), index_data.size(),
+                                       INDEX_FRAME | trailer.frame_count)).offset;
+        std::memcpy(trailer.magic, TRAILER_MAGIC, sizeof(trailer.magic));
+        write_out(reinterpret_cast<const char*>(&trailer), sizeof(trailer));
+
+        // 回填校验和
+        backup_header_.checksum = checksum;
+        target_file->write_at(0, reinterpret_cast<const char*>(&backup_header_), sizeof(BackupHeader));
+        target_file->close();
+
+        if (!manifest_path.empty()) {
+            snapshot->Save(manifest_path);
+            spdlog::info("写入清单: {}", manifest_path.string());
+        }
         return true;
     } catch (const std::exception& e) {
         spdlog::error("打包过程出错: {}", e.what());
+        // 文件已创建就删除，关闭失败或写入清单失败时文件已关闭，同样是不完整的备份
+        if (target_file) {
+            target_file.reset();
+            std::error_code ec;
+            fs::remove(target_path, ec);
+        }
         return false;
     }
 }
 
+// 生成一条索引，记录的起止位置是其在未编码数据流中的偏移
+IndexEntry Packer::MakeIndexEntry(const FileHeader& header, uint64_t begin, uint64_t end) const {
+    IndexEntry entry;
+    entry.path = header.path;
+    entry.metadata = header.metadata;
+    entry.frame = static_cast<uint32_t>(begin / window_size_);
+    entry.offset = static_cast<uint32_t>(begin % window_size_);
+    entry.size = end - begin;
+    return entry;
+}
+
+// 把打包的文件记入清单
+// 普通文件的内容哈希在打包读取内容时已经算出；硬链接和重复文件没有读取内容，
+// 与之前打包的original相同，沿用清单中它的哈希
+void Packer::AddToSnapshot(Manifest& snapshot, const FileHeader& header,
+                           const std::optional<FileHandler::ContentHash>& hash,
+                           const std::string& original) const {
+    ManifestEntry entry = ManifestEntry::FromStat(header.path, header.metadata);
+    if (S_ISREG(header.metadata.st_mode)) {
+        if (hash) {
+            entry.hash = *hash;
+        } else if (const ManifestEntry* previous = snapshot.find(original)) {
+            entry.hash = previous->hash;
+        } else {
+            entry.hash = Manifest::HashFile(header.path);
+        }
+    }
+    snapshot.add(std::move(entry));
+}
+
 // 执行基础的文件打包操作
-// 将源目录下的所有文件按照特定格式写入目标文件
-bool Packer::PackToFile(const fs::path& source_path, const fs::path& target_path) {
+// 将源目录下的所有文件按照特定格式写入备份流
+// base为增量备份的基础清单，snapshot不为空时记录本次每个文件的状态
+bool Packer::PackToStream(const fs::path& source_path, std::ostream& backup_file,
+                          std::vector<IndexEntry>& entries, const Manifest* base,
+                          Manifest* snapshot) {
     inode_table.clear();  // 清空inode表，避免多次打包时的干扰
 
     const fs::path normalized_source = source_path.lexically_normal();
-    const fs::path normalized_target = target_path.lexically_normal();
     
     try {
-        std::ofstream backup_file(normalized_target, std::ios::binary);
-        if (!backup_file) {
-            throw std::runtime_error("无法创建备份文件: " + normalized_target.string());
-        }
-
         // 切换工作目录以获取正确的相对路径
         std::filesystem::current_path(normalized_source);
         spdlog::info("切换工作目录到: {}", normalized_source.string());
 
+        if (threads_ > 1) {
+            PackParallel(normalized_source, backup_file, entries, base, snapshot);
+            return true;
+        }
+
+        std::optional<DuplicateFinder> duplicates;
+        if (dedup_files_) {
+            duplicates.emplace();
+        }
+
         // 递归处理所有文件
         for (const auto &entry : fs::recursive_directory_iterator(normalized_source)) {
             const auto &path = fs::path(entry.path()).lexically_relative(fs::current_path());
@@ -129,17 +315,55 @@ bool Packer::PackToFile(const fs::path& source_path, const fs::path& target_path
                 continue;
             }
 
-            spdlog::info("打包文件: {}", path.string());
-
             // 根据文件类型创建相应的处理器
-            if (auto handler = FileHandler::Create(path)) {
-                handler->Pack(backup_file, inode_table);
-            } else {
+            auto handler = FileHandler::Create(path, store_.get());
+            if (!handler) {
                 spdlog::warn("跳过未知文件类型: {}", path.string());
+                continue;
+            }
+            handler->set_drop_cache(direct_io_);
+            handler->set_hash_content(snapshot != nullptr);
+            const FileHeader header = handler->getFileHeader();
+            bool replaced = false;
+            if (snapshot && !SelectForPack(header, base, *snapshot, replaced)) {
+                spdlog::info("文件未改变: {}", path.string());
+                continue;
+            }
+            spdlog::info("打包文件: {}", path.string());
+
+            // 硬链接的后续路径已有链接记录，不再比较内容
+            const struct stat& metadata = header.metadata;
+            std::string original;
+            if (duplicates && S_ISREG(metadata.st_mode) &&
+                !(metadata.st_nlink > 1 && inode_table.count(metadata.st_ino))) {
+                if (auto duplicate = duplicates->find_or_add(header.path, metadata.st_size)) {
+                    spdlog::info("内容与{}相同: {}", *duplicate, path.string());
+                    handler = std::make_unique<DuplicateFileHandler>(header, *duplicate);
+                    original = *duplicate;
+                }
+            }
+
+            if (replaced) {
+                WriteWhiteout(backup_file, header.path, entries);
+            }
+            uint64_t begin = backup_file.tellp();
+            handler->Pack(backup_file, inode_table);
+            entries.push_back(MakeIndexEntry(header, begin, backup_file.tellp()));
+            if (snapshot) {
+                if (original.empty() && metadata.st_nlink > 1) {
+                    original = inode_table[metadata.st_ino];
+                }
+                AddToSnapshot(*snapshot, header, handler->content_hash(), original);
             }
         }
 
-        backup_file.close();
+        if (duplicates && duplicates->duplicates() > 0) {
+            spdlog::info("重复文件: {}个，共{}字节", duplicates->duplicates(),
+                         duplicates->duplicate_bytes());
+        }
+        if (base) {
+            WriteDeletions(backup_file, *base, *snapshot, entries);
+        }
         return true;
     } catch (const std::exception &e) {
         spdlog::error("打包过程出错: {}", e.what());
@@ -147,63 +371,588 @@ bool Packer::PackToFile(const fs::path& source_path, const fs::path& target_path
     }
 }
 
-// 解包文件的主函数
-// 处理流程：读取header -> 解密(如果需要) -> 解压(如果需要) -> 解包
-bool Packer::Unpack(const fs::path& backup_path, const fs::path& restore_path) {
+// 多线程打包
+// 遍历线程按顺序枚举文件并确定硬链接关系，工作线程并发读取文件内容，
+// 调用线程作为唯一的写入者按遍历顺序把结果写入备份流
+void Packer::PackParallel(const fs::path& source_path, std::ostream& backup_file,
+                          std::vector<IndexEntry>& entries, const Manifest* base,
+                          Manifest* snapshot) {
+    struct PackTask {
+        std::shared_ptr<FileHandler> handler;
+        // 该条目打包时可见的inode表：硬链接条目只含其目标，其余为空
+        std::unordered_map<ino_t, std::string> links;
+        // 大文件由写入线程直接流式写入，避免整体缓存在内存中
+        bool direct = false;
+        // 路径在基础备份中是其他类型的文件，需要先写入删除标记
+        bool replaced = false;
+        std::future<std::string> record;
+        std::string original;  // 硬链接或重复文件的原文件，清单沿用其内容哈希
+    };
+
+    ThreadPool pool(threads_);
+    // 限制积压的条目数，使内存占用与文件总量无关
+    BoundedQueue<PackTask> queue(threads_ * 4);
+    std::exception_ptr walker_error;
+    // 遍历线程中判定为未改变的文件，写完后再并入snapshot
+    Manifest carried;
+    std::optional<DuplicateFinder> duplicates;
+    if (dedup_files_) {
+        duplicates.emplace();
+    }
+
+    std::thread walker([&] {
+        try {
+            for (const auto &entry : fs::recursive_directory_iterator(source_path)) {
+                const auto &path = fs::path(entry.path()).lexically_relative(fs::current_path());
+
+                if (!filter_(path)) {
+                    spdlog::info("跳过文件: {}", path.string());
+                    continue;
+                }
+
+                PackTask task;
+                task.handler = FileHandler::Create(path, store_.get());
+                if (!task.handler) {
+                    spdlog::warn("跳过未知文件类型: {}", path.string());
+                    continue;
+                }
+                task.handler->set_drop_cache(direct_io_);
+                task.handler->set_hash_content(snapshot != nullptr);
+                if (snapshot &&
+                    !SelectForPack(task.handler->getFileHeader(), base, carried, task.replaced)) {
+                    spdlog::info("文件未改变: {}", path.string());
+                    continue;
+                }
+                spdlog::info("打包文件: {}", path.string());
+
+                // 硬链接按遍历顺序判定，第一次出现的路径保存数据
+                const struct stat metadata = task.handler->getFileHeader().metadata;
+                bool is_link_entry = false;
+                if (S_ISREG(metadata.st_mode) && metadata.st_nlink > 1) {
+                    auto it = inode_table.find(metadata.st_ino);
+                    if (it != inode_table.end()) {
+                        task.links.emplace(it->first, it->second);
+                        task.original = it->second;
+                        is_link_entry = true;
+                    } else {
+                        inode_table.emplace(metadata.st_ino, path.string());
+                    }
+                }
+
+                bool is_duplicate = false;
+                if (duplicates && S_ISREG(metadata.st_mode) && !is_link_entry) {
+                    const FileHeader header = task.handler->getFileHeader();
+                    if (auto original = duplicates->find_or_add(header.path, metadata.st_size)) {
+                        spdlog::info("内容与{}相同: {}", *original, path.string());
+                        task.handler = std::make_shared<DuplicateFileHandler>(header, *original);
+                        task.original = *original;
+                        is_duplicate = true;
+                    }
+                }
+
+                // 重复文件和使用数据块存储时的记录都很小，不需要直接写入
+                if (!is_duplicate && S_ISREG(metadata.st_mode) && !is_link_entry && !store_ &&
+                    static_cast<size_t>(metadata.st_size) > window_size_) {
+                    task.direct = true;
+                } else {
+                    task.record = pool.submit([handler = task.handler, links = task.links]() mutable {
+                        std::ostringstream record(std::ios::binary);
+                        handler->Pack(record, links);
+                        return std::move(record).str();
+                    });
+                }
+                if (!queue.push(std::move(task))) {
+                    break;  // 写入端已出错
+                }
+            }
+        } catch (...) {
+            walker_error = std::current_exception();
+        }
+        queue.close();
+    });
+
     try {
-        // 验证备份文件存在
-        if (!fs::exists(backup_path)) {
-            throw std::runtime_error("备份文件不存在: " + backup_path.string());
+        while (auto task = queue.pop()) {
+            const FileHeader& header = task->handler->getFileHeader();
+            if (task->replaced) {
+                WriteWhiteout(backup_file, header.path, entries);
+            }
+            uint64_t begin = backup_file.tellp();
+            if (task->direct) {
+                task->handler->Pack(backup_file, task->links);
+            } else {
+                std::string record = task->record.get();
+                backup_file.write(record.data(), record.size());
+            }
+            entries.push_back(MakeIndexEntry(header, begin, backup_file.tellp()));
+            if (snapshot) {
+                AddToSnapshot(*snapshot, header, task->handler->content_hash(), task->original);
+            }
         }
-        
-        spdlog::info("开始解包: {} -> {}", backup_path.string(), restore_path.string());
+    } catch (...) {
+        queue.close();
+        walker.join();
+        throw;
+    }
+    walker.join();
+    if (walker_error) {
+        std::rethrow_exception(walker_error);
+    }
+
+    if (duplicates && duplicates->duplicates() > 0) {
+        spdlog::info("重复文件: {}个，共{}字节", duplicates->duplicates(),
+                     duplicates->duplicate_bytes());
+    }
+    if (snapshot) {
+        for (const auto& [path, entry] : carried.entries()) {
+            snapshot->add(entry);
+        }
+    }
+    if (base) {
+        WriteDeletions(backup_file, *base, *snapshot, entries);
+    }
+}
 
-        // 读取备份文件
-        std::ifstream backup_file(backup_path, std::ios::binary);
-        if (!backup_file) {
-            throw std::runtime_error("无法打开备份文件: " + backup_path.string());
+// 增量备份时与基础清单比较，决定是否需要打包该文件
+// 未改变的文件沿用基础清单中的内容哈希记入carried并返回false；
+// 路径在基础清单中但文件类型不同时replaced置为true，需要先写入删除标记
+bool Packer::SelectForPack(const FileHeader& header, const Manifest* base, Manifest& carried,
+                           bool& replaced) const {
+    replaced = false;
+    const ManifestEntry* previous = base ? base->find(header.path) : nullptr;
+    if (!previous) {
+        return true;
+    }
+    ManifestEntry current = ManifestEntry::FromStat(header.path, header.metadata);
+    if ((current.mode & S_IFMT) != (previous->mode & S_IFMT)) {
+        replaced = true;
+        return true;
+    }
+    // 目录记录只有文件头，总是重新打包，恢复时才能重新设置被子项改动的元数据
+    if (S_ISDIR(current.mode)) {
+        return true;
+    }
+    if (!current.same_metadata(*previous)) {
+        // 文件被复制或替换过但保留了修改时间，只有inode不同时比较内容
+        const bool moved = S_ISREG(current.mode) && current.mode == previous->mode &&
+                           current.size == previous->size && current.mtime_ns == previous->mtime_ns;
+        if (!moved || Manifest::HashFile(header.path) != previous->hash) {
+            return true;
         }
+    }
+    current.hash = previous->hash;
+    carried.add(std::move(current));
+    return false;
+}
 
-        // 确保还原目录存在
-        if (!fs::exists(restore_path)) {
-            fs::create_directories(restore_path);
+// 写入一条删除标记
+void Packer::WriteWhiteout(std::ostream& backup_file, const std::string& path,
+                           std::vector<IndexEntry>& entries) {
+    WhiteoutHandler handler(WhiteoutHandler::MakeHeader(path));
+    uint64_t begin = backup_file.tellp();
+    handler.Pack(backup_file, inode_table);
+    entries.push_back(MakeIndexEntry(handler.getFileHeader(), begin, backup_file.tellp()));
+}
+
+// 为基础清单中本次已不存在的路径写入删除标记
+// 这些路径及其下级都不在本次的记录中，写在所有记录之后不会删除刚打包的文件
+void Packer::WriteDeletions(std::ostream& backup_file, const Manifest& base,
+                            const Manifest& snapshot, std::vector<IndexEntry>& entries) {
+    for (const auto& [path, entry] : base.entries()) {
+        if (!snapshot.find(path)) {
+            spdlog::info("记录删除: {}", path);
+            WriteWhiteout(backup_file, path, entries);
         }
+    }
+}
 
-        // 读取header和数据
-        BackupHeader stored_header;
-        backup_file.read(reinterpret_cast<char*>(&stored_header), sizeof(BackupHeader));
-        std::vector<char> final_data((std::istreambuf_iterator<char>(backup_file)),
-                                   std::istreambuf_iterator<char>());
-        backup_file.close();
+// 打开备份文件并读取BackupHeader，返回的流位于header之后
+std::unique_ptr<ArchiveStream> Packer::OpenBackup(const fs::path& backup_path,
+                                                  BackupHeader& header) const {
+    if (!fs::exists(backup_path)) {
+        throw std::runtime_error("备份文件不存在: " + backup_path.string());
+    }
+    auto archive = std::make_unique<ArchiveStream>(backup_path);
+    std::istream& backup_file = *archive;
+    backup_file.read(reinterpret_cast<char*>(&header), sizeof(BackupHeader));
+    if (backup_file.gcount() != sizeof(BackupHeader)) {
+        throw std::runtime_error("备份文件格式错误: " + backup_path.string());
+    }
+    if ((header.mod & MOD_ENCRYPTED) && !key_) {
+        throw std::runtime_error("需要解密密钥");
+    }
+    return archive;
+}
 
-        // 处理数据：解密和解压
-        if (stored_header.mod & MOD_ENCRYPTED) {
-            spdlog::info("解密数据");
-            if (!aes_) {
-                throw std::runtime_error("需要解密密钥");
+// 读取v2格式的格式信息和文件尾
+// 返回时流位于第一个数据帧
+void Packer::ReadArchiveInfo(std::istream& backup_file, ArchiveInfo& info,
+                             ArchiveTrailer& trailer) const {
+    // 旧版本的格式信息较短，缺少的字段保持为0
+    info = ArchiveInfo{};
+    backup_file.read(reinterpret_cast<char*>(&info), ARCHIVE_INFO_MIN_SIZE);
+    if (backup_file.gcount() != ARCHIVE_INFO_MIN_SIZE ||
+        std::memcmp(info.magic, ARCHIVE_MAGIC, sizeof(info.magic)) != 0 ||
+        info.info_size < ARCHIVE_INFO_MIN_SIZE) {
+        throw std::runtime_error("备份格式信息损坏");
+    }
+    const size_t known_size = std::min<size_t>(info.info_size, sizeof(info));
+    const uint16_t info_size = info.info_size;
+    backup_file.read(reinterpret_cast<char*>(&info) + ARCHIVE_INFO_MIN_SIZE,
+                     known_size - ARCHIVE_INFO_MIN_SIZE);
+    if (static_cast<size_t>(backup_file.gcount()) != known_size - ARCHIVE_INFO_MIN_SIZE ||
+        info.info_size != info_size) {
+        throw std::runtime_error("备份格式信息损坏");
+    }
+    if (info.version > ARCHIVE_VERSION) {
+        throw std::runtime_error("不支持的备份格式版本: " + std::to_string(info.version));
+    }
+    if (info.frame_size == 0) {
+        throw std::runtime_error("备份格式信息损坏");
+    }
+    const std::streamoff data_offset = sizeof(BackupHeader) + info.info_size;
+
+    backup_file.seekg(-static_cast<std::streamoff>(sizeof(trailer)), std::ios::end);
+    backup_file.read(reinterpret_cast<char*>(&trailer), sizeof(trailer));
+    if (backup_file.gcount() != sizeof(trailer) ||
+        std::memcmp(trailer.magic, TRAILER_MAGIC, sizeof(trailer.magic)) != 0 ||
+        trailer.index_offset < static_cast<uint64_t>(data_offset)) {
+        throw std::runtime_error("备份文件尾损坏，文件可能不完整");
+    }
+
+    // 跳过以后版本扩展的格式信息字段
+    backup_file.seekg(data_offset);
+    if (!backup_file) {
+        throw std::runtime_error("备份文件格式错误");
+    }
+}
+
+// 按格式信息中的加密方式和派生参数取得加密模块，不加密时返回空
+const AESModule* Packer::CipherModule(const ArchiveInfo& info) const {
+    if (info.cipher == CIPHER_NONE) {
+        return nullptr;
+    }
+    if (!key_) {
+        throw std::runtime_error("需要解密密钥");
+    }
+    KdfParams params;
+    params.algorithm = info.kdf;
+    if (info.kdf != KDF_LEGACY) {
+        params.cost = info.kdf_cost;
+        std::memcpy(params.salt.data(), info.salt, params.salt.size());
+    }
+    return &key_->module(params);
+}
+
+// 文件数据保存在数据块存储中的备份，检查已打开的存储是否为打包时使用的存储
+void Packer::CheckChunkStore(const ArchiveInfo& info) const {
+    if (std::all_of(std::begin(info.store_id), std::end(info.store_id),
+                    [](uint8_t byte) { return byte == 0; })) {
+        return;
+    }
+    if (!store_) {
+        throw std::runtime_error("备份的文件数据保存在数据块存储中，需要指定存储目录");
+    }
+    if (std::memcmp(store_->id().data(), info.store_id, sizeof(info.store_id)) != 0) {
+        throw std::runtime_error("数据块存储与备份不匹配");
+    }
+}
+
+// 读取当前位置的一个帧的头部和存储数据
+void Packer::ReadStoredFrame(std::istream& backup_file, FrameHeader& header,
+                             std::vector<char>& stored) const {
+    backup_file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (backup_file.gcount() != sizeof(header)) {
+        throw std::runtime_error("数据帧头部不完整");
+    }
+    stored.resize(header.stored_size);
+    backup_file.read(stored.data(), stored.size());
+    if (static_cast<size_t>(backup_file.gcount()) != stored.size()) {
+        throw std::runtime_error("数据帧不完整");
+    }
+}
+
+// 校验存储数据后解码，可以在工作线程中并发调用
+// 不压缩不加密时存储数据就是解码结果，直接交出而不复制
+std::vector<char> Packer::DecodeFrame(const FrameCodec& codec, const FrameHeader& header,
+                                      std::vector<char> stored, uint64_t number) const {
+    if (calculateCRC32(stored.data(), stored.size()) != header.checksum) {
+        throw std::runtime_error("数据帧校验失败");
+    }
+    if (codec.passthrough()) {
+        if (stored.size() != header.raw_size) {
+            throw std::runtime_error("数据帧解码后长度不符");
+        }
+        return stored;
+    }
+    return codec.decode(stored.data(), stored.size(), header.raw_size, number);
+}
+
+// 读取当前位置的一个帧，校验后解码
+void Packer::ReadFrame(std::istream& backup_file, const FrameCodec& codec, uint64_t number,
+                       std::vector<char>& frame) const {
+    FrameHeader header;
+    ReadStoredFrame(backup_file, header, frame);
+    frame = DecodeFrame(codec, header, std::move(frame), number);
+}
+
+// 构造从当前位置顺序读取frames个数据帧的数据源，每次产生一个解码后的帧
+ChunkReader::ChunkSource Packer::MakeFrameSource(std::istream& backup_file, const FrameCodec& codec,
+                                                 uint64_t first, uint64_t frames) const {
+    if (threads_ <= 1) {
+        return [&, codec, number = first, end = first + frames](std::vector<char>& chunk) mutable {
+            if (number == end) {
+                return false;
+            }
+            ReadFrame(backup_file, codec, number++, chunk);
+            return true;
+        };
+    }
+
+    // 多线程：调用线程顺序读取存储数据，校验和解码在线程池中并发进行，
+    // 最多预读 线程数 × 2 帧。读取出错时先交出已预读的帧，错误按帧的顺序抛出
+    struct Prefetch {
+        Prefetch(unsigned threads, uint64_t first, uint64_t frames)
+            : number(first), remaining(frames), pool(threads) {}
+        uint64_t number;
+        uint64_t remaining;
+        std::exception_ptr read_error;
+        std::deque<std::future<std::vector<char>>> pending;
+        ThreadPool pool;
+    };
+    auto prefetch = std::make_shared<Prefetch>(threads_, first, frames);
+    return [&, codec, prefetch](std::vector<char>& chunk) {
+        while (prefetch->remaining > 0 && prefetch->pending.size() < threads_ * 2) {
+            --prefetch->remaining;
+            FrameHeader frame_header;
+            std::vector<char> stored;
+            try {
+                ReadStoredFrame(backup_file, frame_header, stored);
+            } catch (...) {
+                prefetch->read_error = std::current_exception();
+                prefetch->remaining = 0;
+                break;
             }
-            final_data = aes_->decrypt(final_data.data(), final_data.size());
+            prefetch->pending.push_back(prefetch->pool.submit(
+                [this, codec, frame_header, number = prefetch->number++,
+                 stored = std::move(stored)]() mutable {
+                    return DecodeFrame(codec, frame_header, std::move(stored), number);
+                }));
+        }
+        if (prefetch->pending.empty()) {
+            if (prefetch->read_error) {
+                std::rethrow_exception(prefetch->read_error);
+            }
+            return false;
         }
+        chunk = prefetch->pending.front().get();
+        prefetch->pending.pop_front();
+        return true;
+    };
+}
 
-        if (stored_header.mod & MOD_COMPRESSED) {
+// 构造顺序读取记录流的数据源，调用时流位于BackupHeader之后
+// 旧格式未压缩未加密的备份可以直接从文件读取，此时返回空的数据源
+ChunkReader::ChunkSource Packer::MakeRecordSource(std::istream& backup_file,
+                                                  const BackupHeader& header) const {
+    if (header.mod & MOD_FRAMED) {
+        // v2分帧格式：每次读取一个数据帧，校验、解码后交给解包流程
+        ArchiveInfo info;
+        ArchiveTrailer trailer;
+        ReadArchiveInfo(backup_file, info, trailer);
+        CheckChunkStore(info);
+        FrameCodec codec(info, CipherModule(info));
+        if (codec.bound()) {
+            // 帧数写在未认证的文件尾中，先解开按帧数绑定的索引帧，
+            // 截掉末尾的帧或改写帧数都会在这里失败
+            const auto records = backup_file.tellg();
+            ReadIndex(backup_file, trailer, codec);
+            backup_file.seekg(records);
+        }
+        return MakeFrameSource(backup_file, codec, 0, trailer.frame_count);
+    }
+    if (!(header.mod & (MOD_COMPRESSED | MOD_ENCRYPTED))) {
+        return nullptr;
+    }
+    if (!(header.mod & MOD_COMPRESSED)) {
+        // 旧格式只加密未压缩时按窗口大小分段流式解密，内存占用与备份大小无关
+        spdlog::info("解密数据");
+        auto decryptor = std::make_shared<AESModule::Decryptor>(key_->module(KdfParams{}));
+        return [&, decryptor, input = std::vector<char>(window_size_),
+                done = false](std::vector<char>& chunk) mutable {
+            if (done) {
+                return false;
+            }
+            backup_file.read(input.data(), input.size());
+            const size_t count = backup_file.gcount();
+            chunk.resize(count + 2 * AESModule::BLOCK_SIZE);
+            size_t written = decryptor->update({input.data(), count}, chunk.data());
+            if (count < input.size()) {
+                written += decryptor->finish(chunk.data() + written);
+                done = true;
+            }
+            chunk.resize(written);
+            return true;
+        };
+    }
+    // 旧格式的压缩数据只能整体解码
+    return [&, mod = header.mod, done = false](std::vector<char>& chunk) mutable {
+        if (done) {
+            return false;
+        }
+        done = true;
+        chunk.assign(std::istreambuf_iterator<char>(backup_file),
+                     std::istreambuf_iterator<char>());
+        if (mod & MOD_ENCRYPTED) {
+            spdlog::info("解密数据");
+            chunk = key_->module(KdfParams{}).decrypt(chunk.data(), chunk.size());
+        }
+        if (mod & MOD_COMPRESSED) {
             spdlog::info("解压数据");
-            final_data = LZWCompression::decompress(final_data.data());
+            chunk = LZWCompression::decompress_legacy(chunk.data(), chunk.size());
         }
+        return true;
+    };
+}
+
+namespace {
+// 从映射的备份恢复时，提前提示内核读入当前位置之后这么多数据
+constexpr size_t MAPPED_READAHEAD = 16 << 20;
+}  // namespace
 
-        // 创建临时文件存储处理后的数据
-        fs::path temp_path = backup_path.parent_path() / (backup_path.stem().string() + ".tmp");
-        std::ofstream temp_file(temp_path, std::ios::binary);
-        if (!temp_file) {
-            throw std::runtime_error("无法创建临时文件");
+// 既不压缩也不加密的备份映射到内存，构造按顺序给出记录流各段所在内存的数据源，
+// 调用时流位于BackupHeader之后；其他备份返回空的数据源，流的位置不变
+SpanReader::SpanSource Packer::MakeMappedSource(const fs::path& backup_path,
+                                                std::istream& backup_file,
+                                                const BackupHeader& header) const {
+    const std::streampos records_begin = backup_file.tellg();
+    uint64_t offset = records_begin;
+    uint64_t frames = 0;
+    if (header.mod & MOD_FRAMED) {
+        ArchiveInfo info;
+        ArchiveTrailer trailer;
+        ReadArchiveInfo(backup_file, info, trailer);
+        if (info.codec != CODEC_NONE || info.cipher != CIPHER_NONE) {
+            backup_file.seekg(records_begin);
+            return nullptr;
         }
+        CheckChunkStore(info);
+        offset = backup_file.tellg();
+        frames = trailer.frame_count;
+    } else if (header.mod & (MOD_COMPRESSED | MOD_ENCRYPTED)) {
+        return nullptr;
+    }
 
-        temp_file.write(final_data.data(), final_data.size());
-        temp_file.close();
+    auto archive = std::make_shared<MappedFile>(backup_path);
+    archive->advise_sequential();
+    archive->advise_willneed(offset, MAPPED_READAHEAD);
+    // 读取位置接近已提示的范围末尾时，继续提示之后的数据
+    auto read_ahead = [archive, advised = offset + MAPPED_READAHEAD](uint64_t position) mutable {
+        if (position + MAPPED_READAHEAD / 2 > advised) {
+            archive->advise_willneed(advised, position + MAPPED_READAHEAD - advised);
+            advised = position + MAPPED_READAHEAD;
+        }
+    };
 
-        // 执行实际的解包操作
-        bool result = UnpackFromFile(temp_path, restore_path);
-        fs::remove(temp_path);
-        return result;
+    if (!(header.mod & MOD_FRAMED)) {
+        // 旧格式：记录流就是文件的剩余部分，按预读范围分段给出
+        return [archive, read_ahead, offset](std::span<const char>& span) mutable {
+            if (offset >= archive->size()) {
+                return false;
+            }
+            const size_t length = std::min<uint64_t>(archive->size() - offset, MAPPED_READAHEAD);
+            span = archive->range(offset, length);
+            offset += length;
+            read_ahead(offset);
+            return true;
+        };
+    }
+
+    // v2分帧格式：存储数据就是原始数据，校验后直接给出帧数据所在的内存
+    return [this, archive, read_ahead, offset, remaining = frames](std::span<const char>& span) mutable {
+        if (remaining == 0) {
+            return false;
+        }
+        --remaining;
+        FrameHeader frame_header;
+        std::memcpy(&frame_header, archive->range(offset, sizeof(frame_header)).data(),
+                    sizeof(frame_header));
+        span = archive->range(offset + sizeof(frame_header), frame_header.stored_size);
+        if (calculateCRC32(span.data(), span.size()) != frame_header.checksum) {
+            throw std::runtime_error("数据帧校验失败");
+        }
+        if (frame_header.raw_size != frame_header.stored_size) {
+            throw std::runtime_error("数据帧解码后长度不符");
+        }
+        offset += sizeof(frame_header) + frame_header.stored_size;
+        read_ahead(offset);
+        return true;
+    };
+}
+
+// 解包文件的主函数
+// 处理流程：读取header -> 逐块读取 -> 解密(如果需要) -> 解压(如果需要) -> 解包
+// 解码后的数据块直接送入文件处理器，不产生临时文件
+bool Packer::Unpack(const fs::path& backup_path, const fs::path& restore_path) {
+    return Unpack(std::vector<fs::path>{backup_path}, restore_path);
+}
+
+// 依次解包基础备份和增量备份，全部还原到以基础备份命名的目录
+bool Packer::Unpack(const std::vector<fs::path>& chain, const fs::path& restore_path) {
+    try {
+        if (chain.empty()) {
+            throw std::runtime_error("没有指定备份文件");
+        }
+        // 解包时会切换工作目录，相对路径需要先解析
+        std::vector<fs::path> backups;
+        for (const auto& backup_path : chain) {
+            backups.push_back(fs::absolute(backup_path));
+        }
+
+        // 确保还原目录存在
+        if (!fs::exists(restore_path)) {
+            fs::create_directories(restore_path);
+        }
+        fs::path project_dir = fs::absolute(restore_path / backups.front().stem());
+        StoreScope store_scope(store_, store_path_, false);
+
+        for (const auto& backup_path : backups) {
+            spdlog::info("开始解包: {} -> {}", backup_path.string(), restore_path.string());
+
+            BackupHeader stored_header;
+            std::unique_ptr<ArchiveStream> archive = OpenBackup(backup_path, stored_header);
+            std::istream& backup_file = *archive;
+
+            // 既不压缩也不加密的备份映射到内存，文件内容直接从映射写出
+            if (SpanReader::SpanSource mapped =
+                    MakeMappedSource(backup_path, backup_file, stored_header)) {
+                SpanReader reader(std::move(mapped));
+                std::istream backup_stream(&reader);
+                backup_stream.exceptions(std::ios::badbit);
+                if (!UnpackFromStream(backup_stream, project_dir)) {
+                    return false;
+                }
+                continue;
+            }
+
+            ChunkReader::ChunkSource source = MakeRecordSource(backup_file, stored_header);
+            if (!source) {
+                // 旧格式未压缩未加密的备份直接从文件读取
+                if (!UnpackFromStream(backup_file, project_dir)) {
+                    return false;
+                }
+                continue;
+            }
+
+            ChunkReader reader(std::move(source));
+            std::istream backup_stream(&reader);
+            // 让解码过程中的错误以异常形式传出
+            backup_stream.exceptions(std::ios::badbit);
+            if (!UnpackFromStream(backup_stream, project_dir)) {
+                return false;
+            }
+        }
+        return true;
 
     } catch (const std::exception& e) {
         spdlog::error("解包过程出错: {}", e.what());
@@ -212,30 +961,33 @@ bool Packer::Unpack(const fs::path& backup_path, const fs::path& restore_path) {
 }
 
 // 执行基础的文件解包操作
-// 从备份文件中读取并还原所有文件
-bool Packer::UnpackFromFile(const fs::path& backup_path, const fs::path& restore_path) {
+// 从备份流中读取并还原所有文件
+bool Packer::UnpackFromStream(std::istream& backup_file, const fs::path& project_dir) {
     try {
-        std::ifstream backup_file(backup_path, std::ios::binary);
-        if (!backup_file) {
-            throw std::runtime_error("无法打开备份文件: " + backup_path.string());
-        }
-        
         // 创建还原目录
-        fs::path project_dir = restore_path / backup_path.stem();
         fs::create_directories(project_dir);
         std::filesystem::current_path(project_dir);
         
         spdlog::info("创建项目目录: {}", project_dir.string());
 
+        if (threads_ > 1) {
+            UnpackParallel(backup_file);
+            spdlog::info("解包完成");
+            return true;
+        }
+
         // 读取并解包每个文件
         while (backup_file.peek() != EOF) {
             FileHeader header;
             backup_file.read(reinterpret_cast<char*>(&header), sizeof(FileHeader));
+            if (backup_file.gcount() != sizeof(FileHeader)) {
+                throw std::runtime_error("文件头不完整");
+            }
             
             spdlog::info("解包文件: {}", header.path);
 
             // 根据文件类型创建相应的处理器
-            if (auto handler = FileHandler::Create(header)) {
+            if (auto handler = FileHandler::Create(header, store_.get())) {
                 handler->Unpack(backup_file, restore_metadata_);
             } else {
                 spdlog::warn("跳过未知文件类型: {}", std::string(header.path));
@@ -250,38 +1002,1043 @@ bool Packer::UnpackFromFile(const fs::path& backup_path, const fs::path& restore
     }
 }
 
+namespace {
+// 创建普通文件，内容由fill回调写入
+template <class Fill>
+void write_regular_file(const fs::path& path, Fill&& fill) {
+    remove_existing(path);
+    FileDescriptor file = FileDescriptor::Create(path);
+    fill(file.get());
+    file.Close(path);
+}
+}  // namespace
+
+// 多线程解包
+// 调用线程顺序解析备份流并创建目录，普通文件、符号链接和管道文件的写入分发给工作线程；
+// 重复文件在原文件写完后复制，硬链接在所有目标文件写完后再创建，
+// 目录元数据最后按后序统一恢复，避免被子项写入覆盖
+void Packer::UnpackParallel(std::istream& backup_file) {
+    struct LinkEntry {
+        fs::path path;
+        fs::path target;
+        struct stat metadata;
+    };
+    struct DirectoryEntry {
+        fs::path path;
+        struct stat metadata;
+    };
+
+    ThreadPool pool(threads_);
+    std::deque<std::future<void>> pending;
+    std::vector<LinkEntry> hard_links;
+    std::vector<LinkEntry> duplicates;
+    std::vector<DirectoryEntry> directories;
+    std::unordered_set<std::string> known_dirs;
+    const bool restore_metadata = restore_metadata_;
+
+    // 每个目录只创建一次
+    auto ensure_directory = [&](const fs::path& dir) {
+        if (dir.empty() || known_dirs.count(dir.string())) {
+            return;
+        }
+        fs::create_directories(dir);
+        for (fs::path p = dir; !p.empty() && known_dirs.insert(p.string()).second;
+             p = p.parent_path()) {
+        }
+    };
+
+    // 限制积压的任务数，同时尽早暴露工作线程中的错误
+    auto submit = [&](auto&& job) {
+        pending.push_back(pool.submit(std::forward<decltype(job)>(job)));
+        while (pending.size() > threads_ * 4) {
+            pending.front().get();
+            pending.pop_front();
+        }
+    };
+
+    try {
+        while (backup_file.peek() != EOF) {
+            FileHeader header;
+            backup_file.read(reinterpret_cast<char*>(&header), sizeof(FileHeader));
+            if (backup_file.gcount() != sizeof(FileHeader)) {
+                throw std::runtime_error("文件头不完整");
+            }
+            spdlog::info("解包文件: {}", header.path);
+
+            const struct stat metadata = header.metadata;
+            fs::path path(header.path);
+            switch (metadata.st_mode & S_IFMT) {
+            case S_IFDIR:
+                ensure_directory(path);
+                if (restore_metadata) {
+                    directories.push_back({path, metadata});
+                }
+                break;
+
+            case S_IFREG:
+                ensure_directory(path.parent_path());
+                if (metadata.st_nlink > 1) {
+                    // 硬链接延迟到目标文件写完后创建
+                    hard_links.push_back({path, FileHandler::ReadLongPath(backup_file), metadata});
+                } else if (static_cast<size_t>(metadata.st_size) <= window_size_) {
+                    std::vector<char> content(metadata.st_size);
+                    backup_file.read(content.data(), content.size());
+                    if (static_cast<size_t>(backup_file.gcount()) != content.size()) {
+                        throw std::runtime_error("文件数据不完整: " + path.string());
+                    }
+                    submit([path, metadata, restore_metadata, content = std::move(content)] {
+                        write_regular_file(path, [&](int fd) {
+                            write_all(fd, content.data(), content.size(), path);
+                        });
+                        if (restore_metadata) {
+                            FileHandler::RestoreMetadata(path, metadata);
+                        }
+                    });
+                } else {
+                    // 大文件由解析线程直接边读边写，避免整体缓存在内存中
+                    write_regular_file(path, [&](int fd) {
+                        std::vector<char> buffer(std::min<size_t>(window_size_, metadata.st_size));
+                        size_t remaining = metadata.st_size;
+                        while (remaining > 0) {
+                            size_t count = std::min(remaining, buffer.size());
+                            backup_file.read(buffer.data(), count);
+                            if (static_cast<size_t>(backup_file.gcount()) != count) {
+                                throw std::runtime_error("文件数据不完整: " + path.string());
+                            }
+                            write_all(fd, buffer.data(), count, path);
+                            remaining -= count;
+                        }
+                    });
+                    if (restore_metadata) {
+                        FileHandler::RestoreMetadata(path, metadata);
+                    }
+                }
+                break;
+
+            case MODE_DUPLICATE:
+                ensure_directory(path.parent_path());
+                duplicates.push_back({path, FileHandler::ReadLongPath(backup_file), metadata});
+                break;
+
+            case MODE_CHUNKED: {
+                ensure_directory(path.parent_path());
+                if (!store_) {
+                    throw std::runtime_error("文件数据保存在数据块存储中，需要指定存储目录: " +
+                                             path.string());
+                }
+                std::vector<ChunkRef> chunks = ChunkedFileHandler::ReadChunkList(backup_file, metadata);
+                submit([store = store_, path, metadata, restore_metadata, chunks = std::move(chunks)] {
+                    write_regular_file(path, [&](int fd) {
+                        std::vector<char> data;
+                        for (const auto& chunk : chunks) {
+                            ChunkedFileHandler::ReadChunk(*store, chunk, data);
+                            write_all(fd, data.data(), data.size(), path);
+                        }
+                    });
+                    if (restore_metadata) {
+                        FileHandler::RestoreMetadata(path, metadata);
+                    }
+                });
+                break;
+            }
+
+            case S_IFLNK: {
+                ensure_directory(path.parent_path());
+                std::string target = FileHandler::ReadLongPath(backup_file);
+                submit([path, target, metadata, restore_metadata] {
+                    remove_existing(path);
+                    fs::create_symlink(target, path);
+                    if (restore_metadata) {
+                        FileHandler::RestoreMetadata(path, metadata);
+                    }
+                });
+                break;
+            }
+
+            case MODE_WHITEOUT:
+                // 删除标记位于它所影响的记录之前，直接在解析线程中删除
+                fs::remove_all(path);
+                known_dirs.clear();
+                break;
+
+            case S_IFIFO:
+                ensure_directory(path.parent_path());
+                submit([path, metadata, restore_metadata] {
+                    remove_existing(path);
+                    if (mkfifo(path.c_str(), metadata.st_mode & 07777) != 0) {
+                        throw std::runtime_error("无法创建管道文件: " + path.string() +
+                                                 " (" + strerror(errno) + ")");
+                    }
+                    if (restore_metadata) {
+                        FileHandler::RestoreMetadata(path, metadata);
+                    }
+                });
+                break;
+
+            default:
+                spdlog::warn("跳过未知文件类型: {}", path.string());
+                break;
+            }
+        }
+
+        auto wait_pending = [&] {
+            while (!pending.empty()) {
+                pending.front().get();
+                pending.pop_front();
+            }
+        };
+        wait_pending();
+
+        // 硬链接可能指向重复文件，在创建硬链接之前复制
+        for (const auto& duplicate : duplicates) {
+            submit([duplicate, restore_metadata] {
+                DuplicateFileHandler::CopyContent(duplicate.target, duplicate.path);
+                if (restore_metadata) {
+                    FileHandler::RestoreMetadata(duplicate.path, duplicate.metadata);
+                }
+            });
+        }
+        wait_pending();
+    } catch (...) {
+        // 等待已提交的任务结束后再传出错误
+        for (auto& job : pending) {
+            job.wait();
+        }
+        throw;
+    }
+
+    for (const auto& link : hard_links) {
+        remove_existing(link.path);
+        fs::create_hard_link(link.target, link.path);
+        if (restore_metadata) {
+            FileHandler::RestoreMetadata(link.path, link.metadata);
+        }
+    }
+
+    // 目录按遍历的逆序恢复元数据，子目录总在父目录之前处理
+    for (auto it = directories.rbegin(); it != directories.rend(); ++it) {
+        FileHandler::RestoreMetadata(it->path, it->metadata);
+    }
+}
+
+namespace {
+// 路径或其任一上级目录与某个模式匹配时返回true
+bool matches_any(const std::string& path, const std::vector<std::string>& patterns) {
+    for (const auto& pattern : patterns) {
+        for (size_t end = path.find('/');; end = path.find('/', end + 1)) {
+            if (fnmatch(pattern.c_str(), path.substr(0, end).c_str(), 0) == 0) {
+                return true;
+            }
+            if (end == std::string::npos) {
+                break;
+            }
+        }
+    }
+    return false;
+}
+
+// 跳过指定字节数，可定位的流直接seek，否则读取后丢弃
+void skip_bytes(std::istream& in, uint64_t count) {
+    if (count == 0) {
+        return;
+    }
+    if (!in.seekg(static_cast<std::streamoff>(count), std::ios::cur)) {
+        in.clear();
+        in.ignore(static_cast<std::streamsize>(count));
+        if (static_cast<uint64_t>(in.gcount()) != count) {
+            throw std::runtime_error("备份数据不完整");
+        }
+    }
+}
+
+// 跳过一条记录中文件头之后的数据
+void skip_payload(std::istream& in, const FileHeader& header) {
+    const struct stat& metadata = header.metadata;
+    switch (metadata.st_mode & S_IFMT) {
+    case S_IFREG:
+        if (metadata.st_nlink > 1) {
+            FileHandler::ReadLongPath(in);
+        } else {
+            skip_bytes(in, metadata.st_size);
+        }
+        break;
+    case S_IFLNK:
+    case MODE_DUPLICATE:
+        FileHandler::ReadLongPath(in);
+        break;
+    case MODE_CHUNKED:
+        ChunkedFileHandler::ReadChunkList(in, metadata);
+        break;
+    default:
+        break;
+    }
+}
+
+// 顺序读取记录流中的文件头，跳过文件数据
+void list_records(std::istream& in, std::vector<IndexEntry>& entries) {
+    while (in.peek() != EOF) {
+        FileHeader header;
+        in.read(reinterpret_cast<char*>(&header), sizeof(FileHeader));
+        if (in.gcount() != sizeof(FileHeader)) {
+            throw std::runtime_error("文件头不完整");
+        }
+        IndexEntry entry{};
+        entry.path = header.path;
+        entry.metadata = header.metadata;
+        entries.push_back(std::move(entry));
+        skip_payload(in, header);
+    }
+}
+
+// 逐条还原选中的记录
+// 目录的元数据推迟到最后按逆序恢复，避免被之后写入的子项覆盖
+class RecordRestorer {
+public:
+    RecordRestorer(bool restore_metadata, ChunkStore* store)
+        : restore_metadata_(restore_metadata), store_(store) {}
+
+    // 还原一条记录，调用时流位于文件头之后
+    void restore(std::istream& record, const FileHeader& header) {
+        auto handler = FileHandler::Create(header, store_);
+        if (!handler) {
+            spdlog::warn("跳过未知文件类型: {}", std::string(header.path));
+            skip_payload(record, header);
+            return;
+        }
+        if (S_ISDIR(header.metadata.st_mode)) {
+            handler->Unpack(record, false);
+            if (restore_metadata_) {
+                directories_.push_back(header);
+            }
+        } else {
+            handler->Unpack(record, restore_metadata_);
+        }
+        restored_.insert(header.path);
+    }
+
+    // 创建指向已还原文件的硬链接
+    void link(const FileHeader& header, const std::string& target) {
+        fs::path link_path = fs::current_path() / header.path;
+        fs::create_directories(link_path.parent_path());
+        fs::remove(link_path);
+        fs::create_hard_link(fs::current_path() / target, link_path);
+        if (restore_metadata_) {
+            FileHandler::RestoreMetadata(link_path, header.metadata);
+        }
+        restored_.insert(header.path);
+    }
+
+    // 复制已还原的原文件
+    void duplicate(const FileHeader& header, const std::string& original) {
+        fs::path path = fs::current_path() / header.path;
+        fs::create_directories(path.parent_path());
+        DuplicateFileHandler::CopyContent(fs::current_path() / original, path);
+        if (restore_metadata_) {
+            FileHandler::RestoreMetadata(path, header.metadata);
+        }
+        restored_.insert(header.path);
+    }
+
+    bool restored(const std::string& path) const { return restored_.count(path) > 0; }
+
+    // 恢复目录元数据，返回还原的记录数
+    size_t finish() {
+        for (auto it = directories_.rbegin(); it != directories_.rend(); ++it) {
+            FileHandler::RestoreMetadata(fs::current_path() / it->path, it->metadata);
+        }
+        directories_.clear();
+        return restored_.size();
+    }
+
+private:
+    bool restore_metadata_;
+    ChunkStore* store_;
+    std::vector<FileHeader> directories_;
+    std::unordered_set<std::string> restored_;
+};
+}  // namespace
+
+// 读取并解码索引帧
+ArchiveIndex Packer::ReadIndex(std::istream& backup_file, const ArchiveTrailer& trailer,
+                               const FrameCodec& codec) const {
+    backup_file.seekg(trailer.index_offset);
+    std::vector<char> data;
+    ReadFrame(backup_file, codec, INDEX_FRAME | trailer.frame_count, data);
+    ArchiveIndex index = ArchiveIndex::deserialize(data.data(), data.size());
+    if (index.frames.size() != trailer.frame_count) {
+        throw std::runtime_error("索引与文件尾不一致");
+    }
+    return index;
+}
+
+// 提取部分文件
+// v2格式通过索引定位匹配的记录，只读取和解码这些记录所在的帧；
+// 旧格式顺序扫描文件头，跳过未匹配记录的数据
+bool Packer::Extract(const fs::path& backup_path, const std::vector<std::string>& patterns,
+                     const fs::path& restore_path) {
+    try {
+        if (patterns.empty()) {
+            throw std::runtime_error("未指定要提取的文件");
+        }
+
+        spdlog::info("开始提取: {} -> {}", backup_path.string(), restore_path.string());
+
+        BackupHeader stored_header;
+        std::unique_ptr<ArchiveStream> archive = OpenBackup(backup_path, stored_header);
+        std::istream& backup_file = *archive;
+        StoreScope store_scope(store_, store_path_, false);
+
+        // 与Unpack相同，文件还原到以备份名命名的目录下
+        fs::path project_dir = restore_path / backup_path.stem();
+        fs::create_directories(project_dir);
+        std::filesystem::current_path(project_dir);
+
+        size_t extracted;
+        if (stored_header.mod & MOD_FRAMED) {
+            extracted = ExtractFramed(backup_file, patterns);
+        } else if (auto source = MakeRecordSource(backup_file, stored_header)) {
+            ChunkReader reader(std::move(source));
+            std::istream backup_stream(&reader);
+            backup_stream.exceptions(std::ios::badbit);
+            extracted = ExtractFromStream(backup_stream, patterns);
+        } else {
+            extracted = ExtractFromStream(backup_file, patterns);
+        }
+
+        if (extracted == 0) {
+            spdlog::error("备份中没有匹配的文件");
+            return false;
+        }
+        spdlog::info("提取完成，共{}个文件", extracted);
+        return true;
+    } catch (const std::exception& e) {
+        spdlog::error("提取过程出错: {}", e.what());
+        return false;
+    }
+}
+
+// 按索引提取v2格式备份中的匹配记录
+size_t Packer::ExtractFramed(std::istream& backup_file, const std::vector<std::string>& patterns) {
+    ArchiveInfo info;
+    ArchiveTrailer trailer;
+    ReadArchiveInfo(backup_file, info, trailer);
+    CheckChunkStore(info);
+    FrameCodec codec(info, CipherModule(info));
+    ArchiveIndex index = ReadIndex(backup_file, trailer, codec);
+
+    // 硬链接的数据保存在同一inode第一次出现的条目中，选中链接时一并提取该条目
+    std::vector<bool> selected(index.entries.size(), false);
+    std::unordered_map<ino_t, size_t> link_owners;
+    for (size_t i = 0; i < index.entries.size(); ++i) {
+        const IndexEntry& entry = index.entries[i];
+        size_t owner = i;
+        if (S_ISREG(entry.metadata.st_mode) && entry.metadata.st_nlink > 1) {
+            owner = link_owners.emplace(entry.metadata.st_ino, i).first->second;
+        }
+        if (matches_any(entry.path, patterns)) {
+            selected[i] = true;
+            selected[owner] = true;
+        }
+    }
+
+    // 相邻的记录常位于同一帧，缓存最近解码的一帧
+    uint64_t cached_frame = UINT64_MAX;
+    std::vector<char> cached;
+    auto load_frame = [&](uint64_t frame) -> const std::vector<char>& {
+        if (frame >= index.frames.size()) {
+            throw std::runtime_error("索引条目指向不存在的帧");
+        }
+        if (frame != cached_frame) {
+            backup_file.seekg(index.frames[frame].offset);
+            ReadFrame(backup_file, codec, frame, cached);
+            cached_frame = frame;
+        }
+        return cached;
+    };
+
+    // 重复文件记录的原文件按路径查找，未被选中时在还原重复文件之前提取
+    std::unordered_map<std::string, size_t> regular_files;
+    for (size_t i = 0; i < index.entries.size(); ++i) {
+        if (S_ISREG(index.entries[i].metadata.st_mode)) {
+            regular_files[index.entries[i].path] = i;
+        }
+    }
+
+    RecordRestorer restorer(restore_metadata_, store_.get());
+    std::function<void(size_t)> extract = [&](size_t i) {
+        const IndexEntry& entry = index.entries[i];
+        spdlog::info("提取文件: {}", entry.path);
+
+        // 从记录起始处开始，只交出该记录的字节
+        ChunkReader reader([&, frame = uint64_t{entry.frame}, skip = size_t{entry.offset},
+                            remaining = entry.size](std::vector<char>& chunk) mutable {
+            if (remaining == 0) {
+                return false;
+            }
+            const std::vector<char>& data = load_frame(frame++);
+            if (skip > data.size()) {
+                throw std::runtime_error("索引条目偏移无效");
+            }
+            size_t count = std::min<uint64_t>(data.size() - skip, remaining);
+            chunk.assign(data.begin() + skip, data.begin() + skip + count);
+            skip = 0;
+            remaining -= count;
+            return true;
+        });
+        std::istream record(&reader);
+        record.exceptions(std::ios::badbit);
+
+        FileHeader header;
+        record.read(reinterpret_cast<char*>(&header), sizeof(FileHeader));
+        if (record.gcount() != sizeof(FileHeader)) {
+            throw std::runtime_error("文件头不完整: " + entry.path);
+        }
+        if ((header.metadata.st_mode & S_IFMT) != MODE_DUPLICATE) {
+            restorer.restore(record, header);
+            return;
+        }
+        const std::string original = FileHandler::ReadLongPath(record);
+        if (!restorer.restored(original)) {
+            auto it = regular_files.find(original);
+            if (it == regular_files.end() || it->second >= i) {
+                throw std::runtime_error("重复文件的原文件不在备份中: " + original);
+            }
+            extract(it->second);
+        }
+        restorer.duplicate(header, original);
+    };
+    for (size_t i = 0; i < index.entries.size(); ++i) {
+        if (selected[i]) {
+            extract(i);
+        }
+    }
+    return restorer.finish();
+}
+
+// 顺序扫描旧格式备份，还原匹配的记录并跳过其余记录的数据
+size_t Packer::ExtractFromStream(std::istream& backup_file, const std::vector<std::string>& patterns) {
+    RecordRestorer restorer(restore_metadata_, store_.get());
+    while (backup_file.peek() != EOF) {
+        FileHeader header;
+        backup_file.read(reinterpret_cast<char*>(&header), sizeof(FileHeader));
+        if (backup_file.gcount() != sizeof(FileHeader)) {
+            throw std::runtime_error("文件头不完整");
+        }
+
+        if (!matches_any(header.path, patterns)) {
+            skip_payload(backup_file, header);
+            continue;
+        }
+
+        // 旧格式没有索引，硬链接的目标在扫描到链接时已经过去，未被提取时只能跳过
+        if (S_ISREG(header.metadata.st_mode) && header.metadata.st_nlink > 1) {
+            std::string target = FileHandler::ReadLongPath(backup_file);
+            if (!restorer.restored(target)) {
+                spdlog::warn("硬链接的目标未被提取，跳过: {} -> {}", header.path, target);
+            } else {
+                spdlog::info("提取文件: {}", header.path);
+                restorer.link(header, target);
+            }
+            continue;
+        }
+
+        spdlog::info("提取文件: {}", header.path);
+        restorer.restore(backup_file, header);
+    }
+    return restorer.finish();
+}
+
+// 列出备份内容
+// v2格式只读取索引帧；旧格式顺序读取文件头并跳过文件数据
+bool Packer::List(const fs::path& backup_path, std::vector<IndexEntry>& entries) {
+    try {
+        BackupHeader stored_header;
+        std::unique_ptr<ArchiveStream> archive = OpenBackup(backup_path, stored_header);
+        std::istream& backup_file = *archive;
+
+        entries.clear();
+        if (stored_header.mod & MOD_FRAMED) {
+            ArchiveInfo info;
+            ArchiveTrailer trailer;
+            ReadArchiveInfo(backup_file, info, trailer);
+            entries = ReadIndex(backup_file, trailer, FrameCodec(info, CipherModule(info))).entries;
+        } else if (auto source = MakeRecordSource(backup_file, stored_header)) {
+            ChunkReader reader(std::move(source));
+            std::istream backup_stream(&reader);
+            backup_stream.exceptions(std::ios::badbit);
+            list_records(backup_stream, entries);
+        } else {
+            list_records(backup_file, entries);
+        }
+        return true;
+    } catch (const std::exception& e) {
+        spdlog::error("读取备份内容出错: {}", e.what());
+        return false;
+    }
+}
+
+namespace {
+// 并行计算各段的CRC32：每段按chunk_size切分成独立的任务，结果再按顺序合并回各段
+void checksum_segments(const MappedFile& archive, std::vector<VerifySegment>& segments,
+                       unsigned threads, size_t chunk_size) {
+    if (threads <= 1) {
+        for (auto& segment : segments) {
+            segment.crc = CRC32::update(archive.data() + segment.offset, segment.size);
+        }
+        return;
+    }
+
+    struct Piece {
+        size_t segment;
+        uint64_t size;
+        std::future<uint32_t> crc;
+    };
+    std::vector<Piece> pieces;
+    ThreadPool pool(threads);
+    for (size_t i = 0; i < segments.size(); ++i) {
+        uint64_t offset = segments[i].offset;
+        const uint64_t end = offset + segments[i].size;
+        do {
+            const uint64_t size = std::min<uint64_t>(chunk_size, end - offset);
+            const char* data = archive.data() + offset;
+            pieces.push_back({i, size, pool.submit([data, size] {
+                                  return CRC32::update(data, size);
+                              })});
+            offset += size;
+        } while (offset < end);
+    }
+
+    for (auto& segment : segments) {
+        segment.crc = CRC32::INIT;
+    }
+    std::vector<bool> started(segments.size(), false);
+    for (auto& piece : pieces) {
+        const uint32_t crc = piece.crc.get();
+        VerifySegment& segment = segments[piece.segment];
+        segment.crc = started[piece.segment] ? CRC32::combine(segment.crc, crc, piece.size) : crc;
+        started[piece.segment] = true;
+    }
+}
+
+// 按固定大小切分[begin, end)
+void split_range(std::vector<VerifySegment>& segments, uint64_t begin, uint64_t end,
+                 uint64_t chunk_size) {
+    while (begin < end) {
+        const uint64_t size = std::min(chunk_size, end - begin);
+        segments.push_back({begin, size, VerifySegment::NO_FRAME, 0, true, 0});
+        begin += size;
+    }
+}
+} // namespace
+
+// 定位v2格式备份中各数据帧和索引帧的存储数据，划分为需要校验的区间
+// 能读取索引时按索引中的帧位置，否则依次解析帧头；entries中返回文件索引（无法读取时为空）
+std::vector<VerifySegment> Packer::LocateFrames(const fs::path& backup_path,
+                                                const MappedFile& archive,
+                                                std::vector<IndexEntry>& entries,
+                                                uint32_t& frame_size,
+                                                VerifyReport& report) const {
+    ArchiveStream backup_file(backup_path);
+    backup_file.seekg(sizeof(BackupHeader));
+    ArchiveInfo info;
+    ArchiveTrailer trailer;
+    ReadArchiveInfo(backup_file, info, trailer);
+    frame_size = info.frame_size;
+    const uint64_t data_offset = sizeof(BackupHeader) + info.info_size;
+    const uint64_t trailer_offset = archive.size() - sizeof(ArchiveTrailer);
+
+    std::vector<FrameInfo> frames;
+    try {
+        ArchiveIndex index = ReadIndex(backup_file, trailer, FrameCodec(info, CipherModule(info)));
+        frames = std::move(index.frames);
+        entries = std::move(index.entries);
+    } catch (const std::exception& e) {
+        spdlog::warn("无法读取索引({})，按帧头定位数据帧，无法确定受影响的文件", e.what());
+    }
+
+    // 没有索引时依次解析帧头；帧头损坏时之后的帧无法定位
+    if (frames.empty() && trailer.frame_count > 0) {
+        uint64_t offset = data_offset;
+        for (uint64_t i = 0; i < trailer.frame_count; ++i) {
+            FrameHeader header;
+            if (offset + sizeof(header) > trailer.index_offset) {
+                break;
+            }
+            std::memcpy(&header, archive.data() + offset, sizeof(header));
+            if (offset + sizeof(header) + header.stored_size > trailer.index_offset) {
+                break;
+            }
+            frames.push_back({offset, header.stored_size, header.raw_size, header.checksum});
+            offset += sizeof(header) + header.stored_size;
+        }
+        if (frames.size() != trailer.frame_count) {
+            const uint64_t end = trailer.index_offset;
+            spdlog::error("数据帧{}的帧头损坏，之后的数据帧无法定位", frames.size());
+            report.damaged.push_back({offset, end - offset, static_cast<int64_t>(frames.size()), {}});
+        }
+    }
+
+    // 各帧的存储数据单独成段，帧头等其余部分按固定大小切分
+    std::vector<VerifySegment> segments;
+    uint64_t position = sizeof(BackupHeader);
+    auto add_frame = [&](uint64_t header_offset, int64_t number, std::optional<uint32_t> expected) {
+        FrameHeader header;
+        if (header_offset < position || header_offset + sizeof(header) > trailer_offset) {
+            throw std::runtime_error("数据帧位置无效");
+        }
+        std::memcpy(&header, archive.data() + header_offset, sizeof(header));
+        const uint64_t begin = header_offset + sizeof(header);
+        if (header.stored_size > trailer_offset - begin) {
+            throw std::runtime_error("数据帧位置无效");
+        }
+        split_range(segments, position, begin, VERIFY_CHUNK_SIZE);
+        // 帧头和索引中的校验和任一不符都视为损坏
+        segments.push_back({begin, header.stored_size, number, header.checksum,
+                            expected.value_or(header.checksum) == header.checksum, 0});
+        position = begin + header.stored_size;
+    };
+    for (size_t i = 0; i < frames.size(); ++i) {
+        add_frame(frames[i].offset, static_cast<int64_t>(i), frames[i].checksum);
+    }
+    add_frame(trailer.index_offset, static_cast<int64_t>(trailer.frame_count), std::nullopt);
+    split_range(segments, position, archive.size(), VERIFY_CHUNK_SIZE);
+    return segments;
+}
+
+namespace {
+// 深度验证时逐条检查记录，文件数据只读取不写入
+class RecordChecker {
+public:
+    RecordChecker(VerifyReport& report, const ChunkStore* store) : report_(report), store_(store) {}
+
+    // 检查当前位置的一条记录，expected为索引中对应的条目，没有索引时为空
+    void check(std::istream& in, const IndexEntry* expected) {
+        current_ = expected ? expected->path : std::string();
+        FileHeader header;
+        in.read(reinterpret_cast<char*>(&header), sizeof(FileHeader));
+        if (in.gcount() != sizeof(FileHeader)) {
+            throw std::runtime_error("文件头不完整");
+        }
+        if (std::memchr(header.path, '\0', MAX_PATH_LEN) == nullptr) {
+            throw std::runtime_error("文件路径无效");
+        }
+        const std::string path = header.path;
+        if (current_.empty()) {
+            current_ = path;
+        }
+        if (expected && path != expected->path) {
+            throw std::runtime_error("记录与索引不一致: " + path);
+        }
+        // 恢复时路径拼接在目标目录之下，绝对路径或..会写到目录之外
+        const fs::path relative(path);
+        if (path.empty() || relative.is_absolute() ||
+            std::any_of(relative.begin(), relative.end(),
+                        [](const fs::path& part) { return part == ".."; })) {
+            throw std::runtime_error("文件路径不安全: " + path);
+        }
+
+        const struct stat& metadata = header.metadata;
+        uint64_t payload = 0;
+        switch (metadata.st_mode & S_IFMT) {
+        case S_IFREG:
+            if (metadata.st_nlink > 1) {
+                const std::string target = FileHandler::ReadLongPath(in);
+                payload = sizeof(uint32_t) + target.size();
+                if (!regular_files_.count(target)) {
+                    throw std::runtime_error("硬链接的目标不在备份中: " + target);
+                }
+            } else {
+                if (metadata.st_size < 0) {
+                    throw std::runtime_error("文件大小无效");
+                }
+                payload = metadata.st_size;
+                discard(in, payload);
+                regular_files_.insert(path);
+            }
+            break;
+        case MODE_DUPLICATE: {
+            const std::string original = FileHandler::ReadLongPath(in);
+            payload = sizeof(uint32_t) + original.size();
+            if (!regular_files_.count(original)) {
+                throw std::runtime_error("重复文件的原文件不在备份中: " + original);
+            }
+            regular_files_.insert(path);
+            break;
+        }
+        case MODE_CHUNKED: {
+            const std::vector<ChunkRef> chunks = ChunkedFileHandler::ReadChunkList(in, metadata);
+            payload = sizeof(uint32_t) + chunks.size() * sizeof(ChunkRef);
+            if (!store_) {
+                throw std::runtime_error("缺少数据块存储");
+            }
+            std::vector<char> data;
+            for (const auto& chunk : chunks) {
+                ChunkedFileHandler::ReadChunk(*store_, chunk, data);
+            }
+            regular_files_.insert(path);
+            break;
+        }
+        case S_IFLNK: {
+            const std::string target = FileHandler::ReadLongPath(in);
+            payload = sizeof(uint32_t) + target.size();
+            if (target.empty()) {
+                throw std::runtime_error("符号链接的目标为空");
+            }
+            break;
+        }
+        case S_IFDIR:
+        case S_IFIFO:
+        case MODE_WHITEOUT:
+            break;
+        default:
+            throw std::runtime_error("未知的文件类型");
+        }
+        if (expected && sizeof(FileHeader) + payload != expected->size) {
+            throw std::runtime_error("记录长度与索引不一致");
+        }
+        ++report_.files_checked;
+    }
+
+    // 顺序检查流中所有记录，出错后无法定位之后的记录，检查到此为止
+    void check_all(std::istream& in) {
+        try {
+            while (in.peek() != EOF) {
+                check(in, nullptr);
+            }
+        } catch (const std::exception& e) {
+            const std::string path = current_.empty()
+                ? "第" + std::to_string(report_.files_checked + report_.file_errors.size() + 1) + "条记录"
+                : current_;
+            fail(path, std::string(e.what()) + "，之后的记录无法检查");
+        }
+    }
+
+    void fail(const std::string& path, const std::string& error) {
+        report_.file_errors.push_back({path, error});
+    }
+
+    // 未能检查的索引条目，普通文件仍然作为硬链接的目标
+    void skip(const IndexEntry& entry, const std::string& error) {
+        fail(entry.path, error);
+        if (S_ISREG(entry.metadata.st_mode) && entry.metadata.st_nlink <= 1) {
+            regular_files_.insert(entry.path);
+        }
+    }
+
+    // 读取并丢弃数据，数据不足时抛出异常
+    static void discard(std::istream& in, uint64_t count) {
+        char buffer[64 * 1024];
+        while (count > 0) {
+            const auto piece = static_cast<std::streamsize>(std::min<uint64_t>(count, sizeof(buffer)));
+            in.read(buffer, piece);
+            if (in.gcount() != piece) {
+                throw std::runtime_error("文件数据不完整");
+            }
+            count -= piece;
+        }
+    }
+
+private:
+    VerifyReport& report_;
+    const ChunkStore* store_;                         // 数据块存储，备份不使用存储时为空
+    std::string current_;                             // 正在检查的记录
+    std::unordered_set<std::string> regular_files_;   // 已出现的普通文件，用于检查硬链接和重复文件
+};
+} // namespace
+
+// 深度验证：完整解码记录流并逐条检查，不写入任何文件
+// v2格式能读取索引时逐条与索引比对，遇到损坏的数据帧后从之后第一个完好的帧继续检查
+void Packer::VerifyRecords(const fs::path& backup_path, VerifyReport& report) const {
+    BackupHeader stored_header;
+    std::unique_ptr<ArchiveStream> archive = OpenBackup(backup_path, stored_header);
+    std::istream& backup_file = *archive;
+    RecordChecker checker(report, store_.get());
+
+    if (!(stored_header.mod & MOD_FRAMED)) {
+        ChunkReader::ChunkSource source = MakeRecordSource(backup_file, stored_header);
+        if (!source) {
+            checker.check_all(backup_file);
+            return;
+        }
+        ChunkReader reader(std::move(source));
+        std::istream backup_stream(&reader);
+        backup_stream.exceptions(std::ios::badbit);
+        checker.check_all(backup_stream);
+        return;
+    }
+
+    ArchiveInfo info;
+    ArchiveTrailer trailer;
+    ReadArchiveInfo(backup_file, info, trailer);
+    CheckChunkStore(info);
+    const FrameCodec codec(info, CipherModule(info));
+    ArchiveIndex index;
+    try {
+        index = ReadIndex(backup_file, trailer, codec);
+    } catch (const std::exception& e) {
+        spdlog::warn("无法读取索引({})，顺序检查记录", e.what());
+        backup_file.clear();
+        backup_file.seekg(sizeof(BackupHeader) + info.info_size);
+        ChunkReader reader(MakeFrameSource(backup_file, codec, 0, trailer.frame_count));
+        std::istream backup_stream(&reader);
+        backup_stream.exceptions(std::ios::badbit);
+        checker.check_all(backup_stream);
+        return;
+    }
+
+    const std::vector<IndexEntry>& entries = index.entries;
+    size_t next = 0;
+    while (next < entries.size()) {
+        // 从条目next所在的帧开始解码
+        const IndexEntry& start = entries[next];
+        if (start.frame >= index.frames.size()) {
+            checker.fail(start.path, "索引条目无效");
+            ++next;
+            continue;
+        }
+        backup_file.clear();
+        backup_file.seekg(index.frames[start.frame].offset);
+        ChunkReader::ChunkSource frames =
+            MakeFrameSource(backup_file, codec, start.frame, index.frames.size() - start.frame);
+        uint64_t produced = 0;
+        bool frame_failed = false;
+        ChunkReader reader([&](std::vector<char>& chunk) {
+            try {
+                const bool more = frames(chunk);
+                produced += more ? 1 : 0;
+                return more;
+            } catch (...) {
+                frame_failed = true;
+                throw;
+            }
+        });
+        std::istream backup_stream(&reader);
+        backup_stream.exceptions(std::ios::badbit);
+
+        size_t i = next;
+        try {
+            RecordChecker::discard(backup_stream, start.offset);
+            for (; i < entries.size(); ++i) {
+                checker.check(backup_stream, &entries[i]);
+            }
+            next = entries.size();
+        } catch (const std::exception& e) {
+            checker.fail(entries[i].path, e.what());
+            next = i + 1;
+            if (frame_failed) {
+                // 起始于损坏帧内的记录无法定位，从之后的帧继续
+                const uint64_t bad_frame = start.frame + produced;
+                for (; next < entries.size() && entries[next].frame <= bad_frame; ++next) {
+                    checker.skip(entries[next], "所在的数据帧损坏");
+                }
+            }
+        }
+    }
+}
+
 // 验证备份文件的完整性
-// 检查文件格式并验证校验和
 bool Packer::Verify(const fs::path& backup_path) {
+    VerifyReport report;
+    return Verify(backup_path, report);
+}
+
+// 验证备份文件的完整性
+// 备份文件映射到内存后分段并行计算校验和，再合并为整体的校验和与文件头比较；
+// v2格式同时逐帧比较校验和，定位损坏的数据帧及其中的文件
+bool Packer::Verify(const fs::path& backup_path, VerifyReport& report) {
+    report = VerifyReport{};
     try {
-        std::ifstream backup_file(backup_path, std::ios::binary);
-        if (!backup_file) {
-            throw std::runtime_error("无法打开备份文件: " + backup_path.string());
+        if (!fs::exists(backup_path)) {
+            throw std::runtime_error("备份文件不存在: " + backup_path.string());
+        }
+        MappedFile archive(backup_path);
+        archive.advise_sequential();
+        if (archive.size() < sizeof(BackupHeader)) {
+            throw std::runtime_error("备份文件格式错误: " + backup_path.string());
         }
 
         // 读取备份信息
         BackupHeader stored_header;
-        backup_file.read(reinterpret_cast<char*>(&stored_header), sizeof(BackupHeader));
+        std::memcpy(&stored_header, archive.data(), sizeof(BackupHeader));
         uint32_t stored_checksum = stored_header.checksum;
 
+        // 划分校验区间，格式信息损坏时只能校验整体
+        std::vector<IndexEntry> entries;
+        uint32_t frame_size = 0;
+        std::vector<VerifySegment> segments;
+        if (stored_header.mod & MOD_FRAMED) {
+            try {
+                segments = LocateFrames(backup_path, archive, entries, frame_size, report);
+            } catch (const std::exception& e) {
+                spdlog::error("无法定位数据帧: {}", e.what());
+                segments.clear();
+                report.damaged.clear();
+            }
+        }
+        if (segments.empty()) {
+            split_range(segments, sizeof(BackupHeader), archive.size(), VERIFY_CHUNK_SIZE);
+        }
+
         // 计算实际的校验和
-        backup_file.seekg(sizeof(BackupHeader));
-        std::vector<char> buffer(4096);
-        uint32_t calculated_checksum = 0xFFFFFFFF;
+        spdlog::debug("CRC32实现: {}，线程数: {}", CRC32::implementation(), threads_);
+        checksum_segments(archive, segments, threads_, VERIFY_CHUNK_SIZE);
+        uint32_t calculated_checksum = CRC32::INIT;
+        for (const auto& segment : segments) {
+            calculated_checksum = CRC32::combine(calculated_checksum, segment.crc, segment.size);
+        }
+        report.checksum_ok = calculated_checksum == stored_checksum;
 
-        while (backup_file) {
-            backup_file.read(buffer.data(), buffer.size());
-            std::streamsize count = backup_file.gcount();
-            if (count > 0) {
-                calculated_checksum = calculateCRC32(buffer.data(), count, calculated_checksum);
+        // 逐帧比较校验和
+        for (const auto& segment : segments) {
+            if (segment.frame == VerifySegment::NO_FRAME ||
+                (segment.consistent && segment.crc == segment.expected)) {
+                continue;
+            }
+            VerifyReport::Damage damage{segment.offset, segment.size, segment.frame, {}};
+            // 记录跨越的帧范围与损坏帧相交的文件
+            for (const auto& entry : entries) {
+                const uint64_t begin = uint64_t{entry.frame} * frame_size + entry.offset;
+                const uint64_t first = begin / frame_size;
+                const uint64_t last = (begin + std::max<uint64_t>(entry.size, 1) - 1) / frame_size;
+                if (first <= static_cast<uint64_t>(segment.frame) &&
+                    static_cast<uint64_t>(segment.frame) <= last) {
+                    damage.files.push_back(entry.path);
+                }
             }
+            report.damaged.push_back(std::move(damage));
         }
+        std::sort(report.damaged.begin(), report.damaged.end(),
+                  [](const auto& a, const auto& b) { return a.offset < b.offset; });
 
         // 比较校验和
-        if (calculated_checksum != stored_checksum) {
+        bool passed = true;
+        if (!report.checksum_ok || !report.damaged.empty()) {
             spdlog::error("备份文件校验失败！");
             spdlog::error("存储的校验和: {:#x}", stored_checksum);
             spdlog::error("计算的校验和: {:#x}", calculated_checksum);
+            for (const auto& damage : report.damaged) {
+                spdlog::error("损坏的数据帧{}: 偏移{}，{}字节", damage.frame, damage.offset,
+                              damage.size);
+                for (const auto& file : damage.files) {
+                    spdlog::error("  受影响的文件: {}", file);
+                }
+            }
+            passed = false;
+        }
+
+        // 深度验证：校验和不符时仍然逐条检查，确定哪些文件仍然完好
+        if (deep_verify_) {
+            spdlog::info("深度验证：解码并检查每个文件");
+            StoreScope store_scope(store_, store_path_, false);
+            VerifyRecords(backup_path, report);
+            for (const auto& error : report.file_errors) {
+                spdlog::error("文件损坏: {} ({})", error.path, error.error);
+            }
+            spdlog::info("深度验证完成：{}个文件完好，{}个有问题", report.files_checked,
+                         report.file_errors.size());
+            passed = passed && report.file_errors.empty();
+        }
+        if (!passed) {
             return false;
         }
 
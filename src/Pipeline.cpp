@@ -0,0 +1,139 @@
+// 实现分块流水线的缓冲区
+// 打包输出按窗口切块后依次流经压缩、加密、校验各阶段
+
+#include "Pipeline.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+ChunkWriter::ChunkWriter(size_t chunk_size, ChunkHandler handler)
+    : buffer_(chunk_size), handler_(std::move(handler)) {
+    if (chunk_size == 0) {
+        throw std::runtime_error("窗口大小不能为0");
+    }
+    setp(buffer_.data(), buffer_.data() + buffer_.size());
+}
+
+// 将当前缓冲区内容交给处理函数并清空
+void ChunkWriter::emit() {
+    size_t size = pptr() - pbase();
+    if (size == 0) {
+        return;
+    }
+    handler_(pbase(), size);
+    emitted_ += size;
+    setp(buffer_.data(), buffer_.data() + buffer_.size());
+}
+
+void ChunkWriter::finish() { emit(); }
+
+ChunkWriter::int_type ChunkWriter::overflow(int_type ch) {
+    emit();
+    if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(ch);
+        pbump(1);
+    }
+    return traits_type::not_eof(ch);
+}
+
+// 大块写入时直接把整窗口的数据交给处理函数，避免多一次拷贝
+std::streamsize ChunkWriter::xsputn(const char* s, std::streamsize n) {
+    std::streamsize written = 0;
+    const auto window = static_cast<std::streamsize>(buffer_.size());
+    while (written < n) {
+        std::streamsize remaining = n - written;
+        if (pptr() == pbase() && remaining >= window) {
+            handler_(s + written, window);
+            emitted_ += window;
+            written += window;
+            continue;
+        }
+        std::streamsize space = epptr() - pptr();
+        std::streamsize count = std::min(space, remaining);
+        std::memcpy(pptr(), s + written, count);
+        pbump(static_cast<int>(count));
+        written += count;
+        if (pptr() == epptr()) {
+            emit();
+        }
+    }
+    return written;
+}
+
+ChunkWriter::pos_type ChunkWriter::seekoff(off_type off, std::ios_base::seekdir dir,
+                                           std::ios_base::openmode which) {
+    if (off != 0 || dir != std::ios_base::cur || !(which & std::ios_base::out)) {
+        return pos_type(off_type(-1));
+    }
+    return pos_type(static_cast<off_type>(position()));
+}
+
+ChunkReader::ChunkReader(ChunkSource source) : source_(std::move(source)) {
+    setg(nullptr, nullptr, nullptr);
+}
+
+// 当前块读完后拉取下一块，跳过空块
+ChunkReader::int_type ChunkReader::underflow() {
+    if (gptr() < egptr()) {
+        return traits_type::to_int_type(*gptr());
+    }
+    consumed_ += egptr() - eback();
+    do {
+        buffer_.clear();
+        if (!source_(buffer_)) {
+            setg(nullptr, nullptr, nullptr);
+            return traits_type::eof();
+        }
+    } while (buffer_.empty());
+    setg(buffer_.data(), buffer_.data(), buffer_.data() + buffer_.size());
+    return traits_type::to_int_type(*gptr());
+}
+
+ChunkReader::pos_type ChunkReader::seekoff(off_type off, std::ios_base::seekdir dir,
+                                           std::ios_base::openmode which) {
+    if (off != 0 || dir != std::ios_base::cur || !(which & std::ios_base::in)) {
+        return pos_type(off_type(-1));
+    }
+    return pos_type(static_cast<off_type>(position()));
+}
+
+SpanReader::SpanReader(SpanSource source) : source_(std::move(source)) {
+    setg(nullptr, nullptr, nullptr);
+}
+
+// 当前区域读完后拉取下一段，跳过空的区域
+SpanReader::int_type SpanReader::underflow() {
+    if (gptr() < egptr()) {
+        return traits_type::to_int_type(*gptr());
+    }
+    consumed_ += egptr() - eback();
+    std::span<const char> span;
+    do {
+        if (!source_(span)) {
+            setg(nullptr, nullptr, nullptr);
+            return traits_type::eof();
+        }
+    } while (span.empty());
+    // 读取区只会被读取，不会通过它修改数据源的内存
+    char* data = const_cast<char*>(span.data());
+    setg(data, data, data + span.size());
+    return traits_type::to_int_type(*gptr());
+}
+
+std::span<const char> SpanReader::take(size_t size) {
+    if (gptr() == egptr() && underflow() == traits_type::eof()) {
+        return {};
+    }
+    const size_t count = std::min<size_t>(size, egptr() - gptr());
+    std::span<const char> data(gptr(), count);
+    setg(eback(), gptr() + count, egptr());
+    return data;
+}
+
+SpanReader::pos_type SpanReader::seekoff(off_type off, std::ios_base::seekdir dir,
+                                         std::ios_base::openmode which) {
+    if (off != 0 || dir != std::ios_base::cur || !(which & std::ios_base::in)) {
+        return pos_type(off_type(-1));
+    }
+    return pos_type(static_cast<off_type>(position()));
+}
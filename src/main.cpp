@@ -1,10 +1,13 @@
 #include "Packer.h"
 #include "ArgParser.h"
+#include "Codec.h"
 #include "GUI.h"
 #include "spdlog/sinks/basic_file_sink.h"
 #include "spdlog/sinks/stdout_color_sinks.h"
 #include "spdlog/spdlog.h"
+#include <iomanip>
 #include <iostream>
+#include <sstream>
 
 void initialize_logger(bool verbose) {
   try {
@@ -32,6 +35,22 @@ void initialize_logger(bool verbose) {
   }
 }
 
+// 以类似 ls -l 的格式输出备份中的文件
+void print_listing(const std::vector<IndexEntry> &entries) {
+  for (const auto &entry : entries) {
+    const struct stat &st = entry.metadata;
+    const char type = FileHandler::TypeChar(st.st_mode);
+    std::string mode = "rwxrwxrwx";
+    for (int i = 0; i < 9; ++i) {
+      if (!(st.st_mode & (0400 >> i))) mode[i] = '-';
+    }
+    char mtime[32];
+    std::strftime(mtime, sizeof(mtime), "%Y-%m-%d %H:%M", std::localtime(&st.st_mtime));
+    std::cout << type << mode << ' ' << std::setw(12) << st.st_size << ' '
+              << mtime << ' ' << entry.path << '\n';
+  }
+}
+
 int main(int argc, char *argv[]) {
   cmdline::parser parser;
   ParserConfig::configure_parser(parser);
@@ -55,6 +74,11 @@ int main(int argc, char *argv[]) {
     ParserConfig::check_conflicts(parser);
 
     Packer packer;
+    packer.set_threads(parser.get<int>("threads"));
+    packer.set_direct_io(parser.exist("direct-io"));
+    if (parser.exist("store")) {
+      packer.set_chunk_store(parser.get<std::string>("store"));
+    }
     fs::path input_path,output_path; 
     if (parser.exist("input")) 
       input_path = fs::absolute(parser.get<std::string>("input"));
@@ -63,14 +87,36 @@ int main(int argc, char *argv[]) {
     if (parser.exist("backup")) {
       // 设置过滤器
       packer.set_filter(ParserConfig::create_filter(parser));
+      if (parser.exist("window")) {
+        packer.set_window_size(static_cast<size_t>(parser.get<int>("window")) * 1024);
+      }
       
-      // 设置是否压缩
-      packer.set_compress(parser.exist("compress"));
+      // 设置压缩算法，指定--codec时自动启用压缩
+      if (parser.exist("codec")) {
+        packer.set_codec(Codec::IdFromName(parser.get<std::string>("codec")),
+                         parser.get<int>("level"));
+      } else {
+        packer.set_compress(parser.exist("compress"));
+      }
       
-      // 设置是否加密
+      // 设置是否加密，密钥派生参数随备份保存，恢复时不需要指定
+      packer.set_kdf(KeyHandle::KdfFromName(parser.get<std::string>("kdf")),
+                     static_cast<uint32_t>(parser.get<int>("kdf-cost")));
       packer.set_encrypt(parser.exist("encrypt"), parser.get<std::string>("password"));
-      // 构造备份文件路径
+      packer.set_dedup_files(parser.exist("dedup"));
+      // 构造备份文件路径，增量备份依次命名为 名称.incN.backup
       fs::path backup_path = output_path / (input_path.filename().string() + ".backup");
+      if (parser.exist("incremental")) {
+        for (int n = 1; n == 1 || fs::exists(backup_path); ++n) {
+          backup_path = output_path / (input_path.filename().string() + ".inc" +
+                                       std::to_string(n) + ".backup");
+        }
+        packer.set_incremental(parser.get<std::string>("base"));
+      }
+      // 清单与备份文件同名，扩展名为.manifest，增量备份总是写清单以便继续增量
+      if (parser.exist("manifest") || parser.exist("incremental")) {
+        packer.set_manifest(fs::path(backup_path).replace_extension(".manifest"));
+      }
       
       if (!packer.Pack(input_path, backup_path)) {
         spdlog::error("备份失败");
@@ -83,13 +129,43 @@ int main(int argc, char *argv[]) {
       
       // 如果提供了密码，设置解密
       packer.set_encrypt(parser.exist("password"), parser.get<std::string>("password"));
-      if (!packer.Unpack(input_path, output_path)) {
+      // 基础备份之后依次应用增量备份
+      std::vector<fs::path> chain{input_path};
+      if (parser.exist("increments")) {
+        std::stringstream increments(parser.get<std::string>("increments"));
+        for (std::string item; std::getline(increments, item, ',');) {
+          if (!item.empty()) {
+            chain.push_back(fs::absolute(item));
+          }
+        }
+      }
+      if (!packer.Unpack(chain, output_path)) {
         spdlog::error("恢复失败");
         return 1;
       }
       spdlog::info("恢复完成");
-    } 
+    } else if (parser.exist("extract")) {
+      packer.set_restore_metadata(parser.exist("metadata"));
+      packer.set_encrypt(parser.exist("password"), parser.get<std::string>("password"));
+      if (!packer.Extract(input_path, {parser.get<std::string>("extract")}, output_path)) {
+        spdlog::error("提取失败");
+        return 1;
+      }
+      spdlog::info("提取完成");
+    }
+    else if (parser.exist("list")) {
+      packer.set_encrypt(parser.exist("password"), parser.get<std::string>("password"));
+      std::vector<IndexEntry> entries;
+      if (!packer.List(input_path, entries)) {
+        spdlog::error("读取备份内容失败");
+        return 1;
+      }
+      print_listing(entries);
+    }
     else if (parser.exist("verify")) {
+      // 加密的备份提供密码时可以报告损坏数据所属的文件
+      packer.set_encrypt(parser.exist("password"), parser.get<std::string>("password"));
+      packer.set_deep_verify(parser.exist("deep"));
       if (!packer.Verify(input_path)) {
         spdlog::error("验证失败");
         return 1;
@@ -97,7 +173,7 @@ int main(int argc, char *argv[]) {
       spdlog::info("验证完成");
     }
     else {
-      spdlog::error("请选择操作：备份、恢复、验证");
+      spdlog::error("请选择操作：备份、恢复、提取、列出、验证");
       return 1;
     }
   } catch (const std::exception &e) {
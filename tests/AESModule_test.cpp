@@ -1,6 +1,8 @@
 #include <catch2/catch_test_macros.hpp>
 #include "AES.h"
+#include <stdexcept>
 #include <string>
+#include <algorithm>
 #include <random>
 #include <vector>
 
@@ -87,4 +89,181 @@ TEST_CASE("AES加密模块错误处理", "[aes][error]") {
         
         REQUIRE_THROWS(aes.decrypt(encrypted.data(), encrypted.size()));
     }
-} 
\ No newline at end of file
+}
+
+TEST_CASE("AES流式加解密测试", "[aes]") {
+    AESModule aes("stream_password");
+    std::mt19937 gen(11);
+    std::string data(300000, '\0');
+    for (auto& c : data) {
+        c = static_cast<char>(gen());
+    }
+
+    SECTION("分段加密的结果与整体加密相同") {
+        AESModule::Encryptor encryptor(aes);
+        std::vector<char> encrypted(data.size() + AESModule::BLOCK_SIZE);
+        size_t written = 0;
+        for (size_t pos = 0, step = 1; pos < data.size(); pos += step, step = step * 3 + 1) {
+            const size_t size = std::min(step, data.size() - pos);
+            written += encryptor.update({data.data() + pos, size}, encrypted.data() + written);
+        }
+        written += encryptor.finish(encrypted.data() + written);
+        encrypted.resize(written);
+        REQUIRE(encrypted == aes.encrypt(data));
+
+        // finish之后可以继续加密下一段数据
+        std::vector<char> again(16 + AESModule::BLOCK_SIZE);
+        size_t again_size = encryptor.update({data.data(), 16}, again.data());
+        again_size += encryptor.finish(again.data() + again_size);
+        again.resize(again_size);
+        REQUIRE(again == aes.encrypt(std::string_view(data.data(), 16)));
+    }
+
+    SECTION("分段解密") {
+        auto encrypted = aes.encrypt(data);
+        AESModule::Decryptor decryptor(aes);
+        std::vector<char> decrypted(encrypted.size() + AESModule::BLOCK_SIZE);
+        size_t written = 0;
+        for (size_t pos = 0; pos < encrypted.size(); pos += 1000) {
+            const size_t size = std::min<size_t>(1000, encrypted.size() - pos);
+            written += decryptor.update({encrypted.data() + pos, size}, decrypted.data() + written);
+        }
+        written += decryptor.finish(decrypted.data() + written);
+        REQUIRE(std::string(decrypted.data(), written) == data);
+    }
+
+    SECTION("追加到已有缓冲区") {
+        std::vector<char> out = {'x', 'y'};
+        aes.encrypt(data, out);
+        REQUIRE(out.size() == 2 + (data.size() / 16 + 1) * 16);
+        std::vector<char> plain = {'z'};
+        aes.decrypt(std::span<const char>(out).subspan(2), plain);
+        REQUIRE(std::string(plain.begin() + 1, plain.end()) == data);
+    }
+
+    SECTION("错误的密钥在结束时报错") {
+        auto encrypted = aes.encrypt(data);
+        AESModule::Decryptor decryptor(AESModule("other_password"));
+        std::vector<char> out(encrypted.size() + AESModule::BLOCK_SIZE);
+        size_t written = decryptor.update(encrypted, out.data());
+        REQUIRE_THROWS(decryptor.finish(out.data() + written));
+    }
+}
+
+TEST_CASE("AES-GCM分块认证加密测试", "[aes]") {
+    AESModule aes("gcm_password");
+    const std::string data = "authenticated frame payload, 认证加密的数据块";
+
+    SECTION("加密解密往返") {
+        std::vector<char> sealed;
+        aes.seal(data, sealed);
+        REQUIRE(sealed.size() == AESModule::NONCE_SIZE + data.size() + AESModule::TAG_SIZE);
+        std::vector<char> opened;
+        aes.open(sealed, opened);
+        REQUIRE(std::string(opened.begin(), opened.end()) == data);
+
+        std::vector<char> empty;
+        aes.seal({}, empty);
+        opened.clear();
+        aes.open(empty, opened);
+        REQUIRE(opened.empty());
+    }
+
+    SECTION("每次加密使用不同的nonce") {
+        std::vector<char> first, second;
+        aes.seal(data, first);
+        aes.seal(data, second);
+        REQUIRE(first != second);
+    }
+
+    SECTION("篡改的数据无法通过认证") {
+        std::vector<char> sealed;
+        aes.seal(data, sealed);
+        for (size_t i = 0; i < sealed.size(); ++i) {
+            std::vector<char> damaged = sealed;
+            damaged[i] ^= 0x01;
+            std::vector<char> opened;
+            REQUIRE_THROWS_AS(aes.open(damaged, opened), std::runtime_error);
+        }
+        std::vector<char> opened;
+        REQUIRE_THROWS_AS(aes.open(std::span<const char>(sealed).first(20), opened),
+                          std::runtime_error);
+        REQUIRE_THROWS_AS(AESModule("other_password").open(sealed, opened), std::runtime_error);
+    }
+}
+
+TEST_CASE("密钥句柄测试", "[aes]") {
+    const std::string data = "key handle payload";
+
+    SECTION("随机盐值和缓存") {
+        KeyHandle first("handle_password", KDF_PBKDF2, 1000);
+        KeyHandle second("handle_password", KDF_PBKDF2, 1000);
+        REQUIRE(first.params().algorithm == KDF_PBKDF2);
+        REQUIRE(first.params().cost == 1000);
+        REQUIRE(first.params().salt != second.params().salt);
+
+        // 同一组参数只派生一次
+        const AESModule& aes = first.module(first.params());
+        REQUIRE(&aes == &first.module(first.params()));
+
+        // 另一个句柄按相同参数派生出相同的密钥，盐值不同时密钥不同
+        std::vector<char> sealed;
+        aes.seal(data, sealed);
+        std::vector<char> opened;
+        second.module(first.params()).open(sealed, opened);
+        REQUIRE(std::string(opened.begin(), opened.end()) == data);
+        REQUIRE_THROWS_AS(second.module(second.params()).open(sealed, opened), std::runtime_error);
+    }
+
+    SECTION("旧版参数与原有派生方式一致") {
+        KeyHandle handle("test_password");
+        auto encrypted = AESModule("test_password").encrypt(data);
+        auto decrypted = handle.module(KdfParams{}).decrypt(encrypted.data(), encrypted.size());
+        REQUIRE(std::string(decrypted.begin(), decrypted.end()) == data);
+    }
+
+    SECTION("scrypt派生") {
+        KeyHandle handle("scrypt_password", KDF_SCRYPT, 10);
+        std::vector<char> sealed;
+        handle.module(handle.params()).seal(data, sealed);
+        std::vector<char> opened;
+        AESModule("scrypt_password", handle.params()).open(sealed, opened);
+        REQUIRE(std::string(opened.begin(), opened.end()) == data);
+    }
+
+    SECTION("每个备份派生各自的子密钥") {
+        KeyHandle handle("subkey_password", KDF_PBKDF2, 1000);
+        const AESModule& master = handle.module(handle.params());
+        const std::array<uint8_t, 16> first_nonce{1};
+        const std::array<uint8_t, 16> second_nonce{2};
+        AESModule first = master.derive(first_nonce);
+
+        // 相同的nonce得到相同的密钥，不同的nonce或主密钥得到不同的密钥
+        std::vector<char> sealed;
+        first.seal(data, sealed);
+        std::vector<char> opened;
+        master.derive(first_nonce).open(sealed, opened);
+        REQUIRE(std::string(opened.begin(), opened.end()) == data);
+        REQUIRE_THROWS_AS(master.derive(second_nonce).open(sealed, opened), std::runtime_error);
+        REQUIRE_THROWS_AS(master.open(sealed, opened), std::runtime_error);
+        REQUIRE_THROWS_AS(AESModule("other_password").derive(first_nonce).open(sealed, opened),
+                          std::runtime_error);
+    }
+
+    SECTION("参数检查") {
+        KeyHandle handle("password");
+        REQUIRE(handle.params().cost == KdfParams::DEFAULT_PBKDF2_ITERATIONS);
+        REQUIRE(handle.matches("password", KDF_PBKDF2, 0));
+        REQUIRE_FALSE(handle.matches("other", KDF_PBKDF2, 0));
+        REQUIRE_FALSE(handle.matches("password", KDF_SCRYPT, 0));
+
+        REQUIRE_THROWS_AS(KeyHandle("password", KDF_PBKDF2, 10), std::runtime_error);
+        REQUIRE_THROWS_AS(KeyHandle("password", KDF_SCRYPT, 30), std::runtime_error);
+        REQUIRE_THROWS_AS(KeyHandle("password", KDF_LEGACY), std::runtime_error);
+        KdfParams invalid;
+        invalid.algorithm = 9;
+        REQUIRE_THROWS_AS(handle.module(invalid), std::runtime_error);
+        REQUIRE(KeyHandle::KdfFromName("scrypt") == KDF_SCRYPT);
+        REQUIRE_THROWS_AS(KeyHandle::KdfFromName("argon2"), std::runtime_error);
+    }
+}
@@ -0,0 +1,110 @@
+#include <catch2/catch_test_macros.hpp>
+#include "ArchiveIO.h"
+#include <string>
+#include <system_error>
+
+namespace {
+std::string make_data(size_t size, char seed) {
+    std::string data(size, '\0');
+    for (size_t i = 0; i < size; ++i) {
+        data[i] = static_cast<char>(seed + i * 7 + i / 251);
+    }
+    return data;
+}
+} // namespace
+
+TEST_CASE("备份文件读写测试", "[archiveio]") {
+    const fs::path path = fs::absolute("archive_io_test.bin");
+    // 小块数据经过缓冲区，大块数据用writev直接写出，两者交替出现
+    const std::string head = "HEAD";
+    const std::string small = make_data(1000, 'a');
+    const std::string large = make_data(ArchiveWriter::BUFFER_SIZE * 2 + 123, 'b');
+    const std::string frame = make_data(ArchiveWriter::BUFFER_SIZE - 10, 'c');
+    std::string expected;
+    {
+        ArchiveWriter writer(path);
+        writer.write(head.data(), head.size());
+        writer.write(small.data(), small.size());
+        writer.write(large.data(), large.size());
+        writer.write(head.data(), head.size(), frame.data(), frame.size());
+        writer.write(small.data(), small.size());
+        REQUIRE(writer.size() == 2 * head.size() + 2 * small.size() + large.size() + frame.size());
+        writer.write_at(0, "head", 4);
+        writer.close();
+        REQUIRE_FALSE(writer.is_open());
+    }
+    expected = "head" + small + large + head + frame + small;
+    REQUIRE(fs::file_size(path) == expected.size());
+
+    ArchiveStream stream(path);
+    REQUIRE(stream.size() == expected.size());
+
+    SECTION("顺序读取") {
+        std::string data(expected.size(), '\0');
+        stream.read(data.data(), 10);
+        stream.read(data.data() + 10, data.size() - 10);
+        REQUIRE(stream.gcount() == static_cast<std::streamsize>(data.size() - 10));
+        REQUIRE(data == expected);
+        // 读到文件末尾之后
+        char byte;
+        REQUIRE_FALSE(stream.read(&byte, 1));
+    }
+
+    SECTION("定位后读取") {
+        std::string data(100, '\0');
+        stream.seekg(-100, std::ios::end);
+        stream.read(data.data(), data.size());
+        REQUIRE(data == expected.substr(expected.size() - 100));
+
+        stream.seekg(ArchiveReader::BUFFER_SIZE + 5);
+        REQUIRE(stream.tellg() == static_cast<std::streamoff>(ArchiveReader::BUFFER_SIZE + 5));
+        stream.read(data.data(), data.size());
+        REQUIRE(data == expected.substr(ArchiveReader::BUFFER_SIZE + 5, 100));
+
+        // 缓冲区内向回定位
+        stream.seekg(-50, std::ios::cur);
+        stream.read(data.data(), data.size());
+        REQUIRE(data == expected.substr(ArchiveReader::BUFFER_SIZE + 55, 100));
+    }
+
+    SECTION("打开不存在的文件") {
+        REQUIRE_THROWS_AS(ArchiveReader(path.string() + ".missing"), std::system_error);
+        REQUIRE_THROWS_AS(ArchiveWriter(path / "missing"), std::system_error);
+    }
+
+    fs::remove(path);
+}
+
+TEST_CASE("直接I/O写入测试", "[archiveio]") {
+    const fs::path path = fs::absolute("archive_io_direct_test.bin");
+    // 跨越多个缓冲区，末尾不足一块；回填的位置分别在已写出的部分、跨越两者和当前缓冲区中
+    const std::string data = make_data(ArchiveWriter::DIRECT_BUFFER_SIZE * 2 + 5000, 'd');
+    const std::string head = make_data(100, 'e');
+    std::string expected;
+    {
+        ArchiveWriter writer(path, true);
+        writer.write(data.data(), 10);
+        writer.write(head.data(), head.size(), data.data() + 10, data.size() - 10);
+        writer.write(head.data(), head.size());
+        REQUIRE(writer.size() == data.size() + 2 * head.size());
+
+        const uint64_t boundary = ArchiveWriter::DIRECT_BUFFER_SIZE * 2;
+        writer.write_at(5, "patched", 7);
+        writer.write_at(boundary - 3, "across", 6);
+        writer.write_at(writer.size() - 4, "tail", 4);
+        writer.close();
+
+        expected = data.substr(0, 10) + head + data.substr(10) + head;
+        expected.replace(5, 7, "patched");
+        expected.replace(boundary - 3, 6, "across");
+        expected.replace(expected.size() - 4, 4, "tail");
+    }
+    REQUIRE(fs::file_size(path) == expected.size());
+
+    ArchiveStream stream(path);
+    std::string content(expected.size(), '\0');
+    stream.read(content.data(), content.size());
+    REQUIRE(content == expected);
+
+    fs::remove(path);
+}
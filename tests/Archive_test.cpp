@@ -0,0 +1,156 @@
+#include <catch2/catch_test_macros.hpp>
+#include "Archive.h"
+#include "AES.h"
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+TEST_CASE("索引序列化测试", "[archive]") {
+    ArchiveIndex index;
+    index.frames.push_back({100, 2000, 4096, 0x12345678});
+    index.frames.push_back({2112, 50, 80, 0x9abcdef0});
+
+    IndexEntry entry{};
+    entry.path = "dir1/文件.txt";
+    entry.metadata.st_mode = S_IFREG | 0644;
+    entry.metadata.st_size = 4000;
+    entry.frame = 0;
+    entry.offset = 12;
+    entry.size = 4000 + 244;
+    index.entries.push_back(entry);
+    entry.path = "dir1";
+    entry.metadata.st_mode = S_IFDIR | 0755;
+    entry.frame = 1;
+    entry.offset = 30;
+    entry.size = 244;
+    index.entries.push_back(entry);
+
+    SECTION("序列化后可以完整还原") {
+        auto data = index.serialize();
+        auto restored = ArchiveIndex::deserialize(data.data(), data.size());
+
+        REQUIRE(restored.frames.size() == 2);
+        REQUIRE(restored.frames[1].offset == 2112);
+        REQUIRE(restored.frames[1].stored_size == 50);
+        REQUIRE(restored.frames[1].raw_size == 80);
+        REQUIRE(restored.frames[1].checksum == 0x9abcdef0);
+
+        REQUIRE(restored.entries.size() == 2);
+        REQUIRE(restored.entries[0].path == "dir1/文件.txt");
+        REQUIRE(restored.entries[0].metadata.st_size == 4000);
+        REQUIRE(restored.entries[0].offset == 12);
+        REQUIRE(restored.entries[1].path == "dir1");
+        REQUIRE(S_ISDIR(restored.entries[1].metadata.st_mode));
+        REQUIRE(restored.entries[1].frame == 1);
+        REQUIRE(restored.entries[1].size == 244);
+    }
+
+    SECTION("截断的索引数据") {
+        auto data = index.serialize();
+        REQUIRE_THROWS_AS(ArchiveIndex::deserialize(data.data(), data.size() - 1),
+                          std::runtime_error);
+        REQUIRE_THROWS_AS(ArchiveIndex::deserialize(data.data(), 4), std::runtime_error);
+    }
+}
+
+TEST_CASE("帧编解码测试", "[archive]") {
+    ArchiveInfo info{};
+    std::memcpy(info.magic, ARCHIVE_MAGIC, sizeof(info.magic));
+    info.version = ARCHIVE_VERSION;
+    info.info_size = sizeof(ArchiveInfo);
+    info.frame_size = 4096;
+    std::string data(3000, 'x');
+    data += "tail";
+
+    SECTION("压缩并加密") {
+        AESModule aes("password");
+        info.codec = CODEC_LZW;
+        info.cipher = CIPHER_AES_CBC;
+        FrameCodec codec(info, &aes);
+        auto stored = codec.encode(data.data(), data.size(), 0);
+        auto raw = codec.decode(stored.data(), stored.size(), data.size(), 0);
+        REQUIRE(std::string(raw.begin(), raw.end()) == data);
+        REQUIRE_THROWS_AS(codec.decode(stored.data(), stored.size(), data.size() + 1, 0),
+                          std::runtime_error);
+    }
+
+    SECTION("认证加密的帧") {
+        AESModule aes("password");
+        info.codec = CODEC_LZ;
+        info.cipher = CIPHER_AES_GCM;
+        FrameCodec codec(info, &aes);
+        auto stored = codec.encode(data.data(), data.size(), 0);
+        auto raw = codec.decode(stored.data(), stored.size(), data.size(), 0);
+        REQUIRE(std::string(raw.begin(), raw.end()) == data);
+
+        // 篡改任意一帧都会被单独发现
+        stored[stored.size() / 2] ^= 0x10;
+        REQUIRE_THROWS_AS(codec.decode(stored.data(), stored.size(), data.size(), 0),
+                          std::runtime_error);
+    }
+
+    SECTION("帧绑定编号和归档信息") {
+        AESModule aes("password");
+        info.codec = CODEC_LZ;
+        info.cipher = CIPHER_AES_GCM_AAD;
+        std::memset(info.salt, 0x5a, sizeof(info.salt));
+        FrameCodec codec(info, &aes);
+        REQUIRE(codec.bound());
+        const std::string other = data + "other";
+        auto first = codec.encode(data.data(), data.size(), 0);
+        auto second = codec.encode(other.data(), other.size(), 1);
+        auto raw = codec.decode(second.data(), second.size(), other.size(), 1);
+        REQUIRE(std::string(raw.begin(), raw.end()) == other);
+
+        // 交换两帧的位置后无法解密
+        REQUIRE_THROWS_AS(codec.decode(second.data(), second.size(), other.size(), 0),
+                          std::runtime_error);
+        REQUIRE_THROWS_AS(codec.decode(first.data(), first.size(), data.size(), 1),
+                          std::runtime_error);
+        REQUIRE_THROWS_AS(codec.decode(first.data(), first.size(), data.size(), INDEX_FRAME | 1),
+                          std::runtime_error);
+
+        // 来自另一个归档的帧也无法解密
+        info.salt[0] ^= 1;
+        FrameCodec foreign(info, &aes);
+        REQUIRE_THROWS_AS(foreign.decode(first.data(), first.size(), data.size(), 0),
+                          std::runtime_error);
+    }
+
+    SECTION("每个备份使用各自的密钥") {
+        // 使用不带附加认证数据的GCM，只比较密钥
+        AESModule aes("password");
+        info.cipher = CIPHER_AES_GCM;
+        info.key_nonce[0] = 1;
+        FrameCodec first(info, &aes);
+        auto stored = first.encode(data.data(), data.size(), 0);
+        auto raw = FrameCodec(info, &aes).decode(stored.data(), stored.size(), data.size(), 0);
+        REQUIRE(std::string(raw.begin(), raw.end()) == data);
+
+        // 只改变随机数、盐值不变时密钥也不同
+        info.key_nonce[0] = 2;
+        FrameCodec second(info, &aes);
+        REQUIRE_THROWS_AS(second.decode(stored.data(), stored.size(), data.size(), 0),
+                          std::runtime_error);
+    }
+
+    SECTION("读取旧版CBC加密的帧") {
+        AESModule aes("password");
+        info.cipher = CIPHER_AES_CBC;
+        FrameCodec codec(info, &aes);
+        auto stored = codec.encode(data.data(), data.size(), 0);
+        REQUIRE(stored == aes.encrypt(data));
+        auto raw = codec.decode(stored.data(), stored.size(), data.size(), 0);
+        REQUIRE(std::string(raw.begin(), raw.end()) == data);
+    }
+
+    SECTION("加密帧缺少密钥") {
+        info.cipher = CIPHER_AES_CBC;
+        REQUIRE_THROWS_AS(FrameCodec(info, nullptr), std::runtime_error);
+    }
+
+    SECTION("未知的编码方式") {
+        info.codec = 200;
+        REQUIRE_THROWS_AS(FrameCodec(info, nullptr), std::runtime_error);
+    }
+}
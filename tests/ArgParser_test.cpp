@@ -55,6 +55,21 @@ TEST_CASE("参数解析基础功能测试", "[argparser]") {
         REQUIRE(parser.get<std::string>("size") == ">1m");
         REQUIRE(parser.get<std::string>("path") == "^/home/.*");
     }
+
+    SECTION("窗口大小测试") {
+        const char* args[] = {
+            "program",
+            "-b",
+            "-i", "/input/path",
+            "-o", "/output/path",
+            "--window", "1024"
+        };
+        cmdline::parser parser;
+        ParserConfig::configure_parser(parser);
+        REQUIRE(parser.parse(sizeof(args)/sizeof(args[0]), const_cast<char**>(args)));
+        REQUIRE(parser.get<int>("window") == 1024);
+        REQUIRE_NOTHROW(ParserConfig::check_conflicts(parser));
+    }
 }
 
 TEST_CASE("参数解析错误处理", "[argparser][error]") {
@@ -96,4 +111,98 @@ TEST_CASE("参数解析错误处理", "[argparser][error]") {
         REQUIRE_THROWS(ParserConfig::check_conflicts(parser));
     }
 
-} 
\ No newline at end of file
+    SECTION("提取模式缺少输出路径") {
+        const char* args[] = {
+            "program",
+            "-x", "*.conf",
+            "-i", "/input/path"  // 缺少-o
+        };
+        cmdline::parser parser;
+        ParserConfig::configure_parser(parser);
+        parser.parse(sizeof(args)/sizeof(args[0]), const_cast<char**>(args));
+        REQUIRE_THROWS(ParserConfig::check_conflicts(parser));
+    }
+
+    SECTION("线程数为负数") {
+        const char* args[] = {
+            "program",
+            "-b",
+            "-i", "/input/path",
+            "-o", "/output/path",
+            "--threads", "-1"
+        };
+        cmdline::parser parser;
+        ParserConfig::configure_parser(parser);
+        REQUIRE_FALSE(parser.parse(sizeof(args)/sizeof(args[0]), const_cast<char**>(args)));
+    }
+
+    SECTION("窗口大小超出范围") {
+        const char* args[] = {
+            "program",
+            "-b",
+            "-i", "/input/path",
+            "-o", "/output/path",
+            "--window", "0"
+        };
+        cmdline::parser parser;
+        ParserConfig::configure_parser(parser);
+        REQUIRE_FALSE(parser.parse(sizeof(args)/sizeof(args[0]), const_cast<char**>(args)));
+    }
+
+    SECTION("压缩级别缺少压缩算法") {
+        const char* args[] = {
+            "program",
+            "-b",
+            "-i", "/input/path",
+            "-o", "/output/path",
+            "--level", "9"  // 缺少--codec
+        };
+        cmdline::parser parser;
+        ParserConfig::configure_parser(parser);
+        parser.parse(sizeof(args)/sizeof(args[0]), const_cast<char**>(args));
+        REQUIRE_THROWS(ParserConfig::check_conflicts(parser));
+    }
+
+    SECTION("密钥派生参数缺少加密选项") {
+        const char* args[] = {
+            "program",
+            "-b",
+            "-i", "/input/path",
+            "-o", "/output/path",
+            "--kdf", "scrypt"  // 缺少-e
+        };
+        cmdline::parser parser;
+        ParserConfig::configure_parser(parser);
+        parser.parse(sizeof(args)/sizeof(args[0]), const_cast<char**>(args));
+        REQUIRE_THROWS(ParserConfig::check_conflicts(parser));
+    }
+
+    SECTION("增量备份缺少基础清单") {
+        const char* args[] = {
+            "program",
+            "-b",
+            "-i", "/input/path",
+            "-o", "/output/path",
+            "--incremental"  // 缺少--base
+        };
+        cmdline::parser parser;
+        ParserConfig::configure_parser(parser);
+        parser.parse(sizeof(args)/sizeof(args[0]), const_cast<char**>(args));
+        REQUIRE_THROWS(ParserConfig::check_conflicts(parser));
+    }
+
+    SECTION("数据块存储与加密同时使用") {
+        const char* args[] = {
+            "program",
+            "-b",
+            "-i", "/input/path",
+            "-o", "/output/path",
+            "-e", "-p", "password",
+            "--store", "/store/path"  // 存储不加密
+        };
+        cmdline::parser parser;
+        ParserConfig::configure_parser(parser);
+        parser.parse(sizeof(args)/sizeof(args[0]), const_cast<char**>(args));
+        REQUIRE_THROWS(ParserConfig::check_conflicts(parser));
+    }
+}
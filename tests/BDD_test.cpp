@@ -1,7 +1,16 @@
 #include <catch2/catch_test_macros.hpp>
+#include <algorithm>
 #include <filesystem>
+#include <fstream>
+#include <map>
+#include <random>
 #include <vector>
 #include "Packer.h"
+#include "ArchiveIO.h"
+#include "ChunkStore.h"
+#include "Chunker.h"
+#include "Manifest.h"
+#include "Codec.h"
 #include "ArgParser.h"
 
 namespace fs = std::filesystem;
@@ -85,9 +94,10 @@ protected:
     }
 
     // 执行备份和恢复测试
-    void test_backup_and_restore() {
+    void test_backup_and_restore(unsigned threads = 1) {
         {
             Packer packer;
+            packer.set_threads(threads);
             fs::path backup_path = backup_dir / (test_dir.filename().string() + ".backup");
             REQUIRE(packer.Pack(test_dir, backup_path) == true);
             REQUIRE(fs::exists(backup_path));
@@ -105,6 +115,7 @@ protected:
             fs::path backup_file = backup_dir / (test_dir.filename().string() + ".backup");
             
             Packer packer;
+            packer.set_threads(threads);
             REQUIRE(packer.Unpack(backup_file, restore_dir) == true);
             fs::path project_dir = restore_dir / test_dir.filename();
             // 验证恢复的文件
@@ -279,6 +290,231 @@ SCENARIO_METHOD(TestFixture, "备份和恢复管道文件",
     }
 }
 
+SCENARIO_METHOD(TestFixture, "多线程备份和恢复混合结构",
+                "[backup][restore][parallel]") {
+    GIVEN("一个包含硬链接、符号链接和管道的目录") {
+        std::vector<TestFile> files = {
+            {"data.txt", TestFileType::Regular, "源文件"},
+            {"dir1", TestFileType::Directory},
+            {"dir1/file1.txt", TestFileType::Regular, "文件1"},
+            {"dir1/hardlink1", TestFileType::Regular, "", "../data.txt", true},
+            {"dir1/link1", TestFileType::Symlink, "", "../data.txt"},
+            {"dir2", TestFileType::Directory},
+            {"dir2/file2.txt", TestFileType::Regular, "文件2"},
+            {"dir2/hardlink2", TestFileType::Regular, "", "../data.txt", true},
+            {"dir2/pipe1", TestFileType::FIFO},
+            {"file3.txt", TestFileType::Regular, "文件3"}
+        };
+        create_test_structure(files);
+        test_backup_and_restore(4);
+    }
+}
+
+SCENARIO_METHOD(TestFixture, "使用直接I/O备份",
+                "[backup][restore]") {
+    GIVEN("一个包含跨越多个写出缓冲区的大文件和小文件的目录") {
+        std::string large_text(ArchiveWriter::DIRECT_BUFFER_SIZE + 12345, '\0');
+        for (size_t i = 0; i < large_text.size(); ++i) {
+            large_text[i] = static_cast<char>('a' + i % 23);
+        }
+        std::vector<TestFile> files = {
+            {"large.txt", TestFileType::Regular, large_text},
+            {"dir1", TestFileType::Directory},
+            {"dir1/small.txt", TestFileType::Regular, "small"}
+        };
+        create_test_structure(files);
+
+        WHEN("以直接I/O压缩备份") {
+            Packer packer;
+            packer.set_direct_io(true);
+            packer.set_compress(true);
+
+            fs::path backup_path = backup_dir / (test_dir.filename().string() + ".backup");
+            REQUIRE(packer.Pack(test_dir, backup_path) == true);
+
+            THEN("备份验证通过，文件按原样还原") {
+                REQUIRE(packer.Verify(backup_path) == true);
+                fs::path restore_path = backup_dir / "restored";
+                REQUIRE(packer.Unpack(backup_path, restore_path) == true);
+
+                fs::path restored_dir = restore_path / test_dir.filename();
+                std::ifstream large_file(restored_dir / "large.txt", std::ios::binary);
+                std::string large_content((std::istreambuf_iterator<char>(large_file)), {});
+                REQUIRE(large_content == large_text);
+                std::ifstream small_file(restored_dir / "dir1/small.txt");
+                std::string small_content((std::istreambuf_iterator<char>(small_file)), {});
+                REQUIRE(small_content == "small");
+
+                fs::remove_all(restore_path);
+            }
+        }
+    }
+}
+
+SCENARIO_METHOD(TestFixture, "备份文件关闭后出错时删除备份",
+                "[backup]") {
+    GIVEN("一个普通目录") {
+        std::vector<TestFile> files = {
+            {"data.txt", TestFileType::Regular, "data"}
+        };
+        create_test_structure(files);
+
+        WHEN("备份文件写完关闭后写入清单失败") {
+            THEN("报告失败且不留下备份文件") {
+                for (bool direct : {false, true}) {
+                    INFO(direct);
+                    Packer packer;
+                    packer.set_direct_io(direct);
+                    packer.set_manifest(backup_dir / "missing" / "full.manifest");
+                    const fs::path backup_path = backup_dir / "closed.backup";
+                    REQUIRE(packer.Pack(test_dir, backup_path) == false);
+                    REQUIRE_FALSE(fs::exists(backup_path));
+                }
+            }
+        }
+    }
+}
+
+SCENARIO_METHOD(TestFixture, "多线程备份超过窗口大小的文件",
+                "[backup][restore][parallel]") {
+    GIVEN("一个包含超过窗口大小文件的目录") {
+        std::string large_text(5000, 'L');
+        std::vector<TestFile> files = {
+            {"small1.txt", TestFileType::Regular, "small1"},
+            {"large.txt", TestFileType::Regular, large_text},
+            {"small2.txt", TestFileType::Regular, "small2"}
+        };
+        create_test_structure(files);
+
+        WHEN("以4个线程和1KB窗口压缩备份") {
+            Packer packer;
+            packer.set_threads(4);
+            packer.set_window_size(1024);
+            packer.set_compress(true);
+
+            fs::path backup_path = backup_dir / (test_dir.filename().string() + ".backup");
+            REQUIRE(packer.Pack(test_dir, backup_path) == true);
+
+            THEN("文件按原样还原") {
+                fs::path restore_path = backup_dir / "restored";
+                REQUIRE(packer.Unpack(backup_path, restore_path) == true);
+
+                fs::path restored_dir = restore_path / test_dir.filename();
+                std::ifstream large_file(restored_dir / "large.txt");
+                std::string large_content((std::istreambuf_iterator<char>(large_file)), {});
+                REQUIRE(large_content == large_text);
+                std::ifstream small_file(restored_dir / "small2.txt");
+                std::string small_content((std::istreambuf_iterator<char>(small_file)), {});
+                REQUIRE(small_content == "small2");
+
+                fs::remove_all(restore_path);
+            }
+        }
+    }
+}
+
+SCENARIO_METHOD(TestFixture, "多线程并行压缩数据帧",
+                "[backup][restore][parallel][compression]") {
+    GIVEN("一个数据量远大于窗口的目录") {
+        std::string text;
+        for (int i = 0; i < 20000; ++i) {
+            text += "frame " + std::to_string(i % 313) + " payload\n";
+        }
+        std::vector<TestFile> files = {
+            {"text.txt", TestFileType::Regular, text},
+            {"dir1", TestFileType::Directory},
+            {"dir1/copy.txt", TestFileType::Regular, text.substr(1000, 50000)}
+        };
+        create_test_structure(files);
+
+        WHEN("分别以单线程和4个线程压缩加密备份") {
+            fs::path single_path = backup_dir / "single.backup";
+            fs::path parallel_path = backup_dir / (test_dir.filename().string() + ".backup");
+            for (unsigned threads : {1u, 4u}) {
+                Packer packer;
+                packer.set_threads(threads);
+                packer.set_window_size(8 * 1024);
+                packer.set_codec(CODEC_LZH);
+                packer.set_encrypt(true, "test_password");
+                REQUIRE(packer.Pack(test_dir, threads == 1 ? single_path : parallel_path) == true);
+            }
+
+            THEN("两份备份的压缩效果相当且可以多线程还原") {
+                // 帧按顺序写出，数据帧与单线程时相同，只有索引中的访问时间可能不同
+                const auto single_size = fs::file_size(single_path);
+                const auto parallel_size = fs::file_size(parallel_path);
+                REQUIRE(parallel_size < text.size() / 4);
+                REQUIRE(parallel_size + 256 > single_size);
+                REQUIRE(single_size + 256 > parallel_size);
+
+                Packer packer;
+                packer.set_threads(4);
+                packer.set_encrypt(true, "test_password");
+                REQUIRE(packer.Verify(parallel_path) == true);
+                fs::path restore_path = backup_dir / "restored";
+                REQUIRE(packer.Unpack(parallel_path, restore_path) == true);
+
+                fs::path restored_dir = restore_path / test_dir.filename();
+                std::ifstream text_file(restored_dir / "text.txt");
+                std::string text_content((std::istreambuf_iterator<char>(text_file)), {});
+                REQUIRE(text_content == text);
+                std::ifstream copy_file(restored_dir / "dir1/copy.txt");
+                std::string copy_content((std::istreambuf_iterator<char>(copy_file)), {});
+                REQUIRE(copy_content == text.substr(1000, 50000));
+
+                fs::remove_all(restore_path);
+            }
+        }
+    }
+}
+
+SCENARIO_METHOD(TestFixture, "多线程恢复目录元数据",
+                "[restore][parallel][metadata]") {
+    GIVEN("一个修改时间早于其内容的目录") {
+        std::vector<TestFile> files = {
+            {"dir1", TestFileType::Directory},
+            {"dir1/file1.txt", TestFileType::Regular, "文件1"},
+            {"dir1/sub", TestFileType::Directory},
+            {"dir1/sub/file2.txt", TestFileType::Regular, "文件2"}
+        };
+        create_test_structure(files);
+
+        // 将目录时间设置为2020-01-01
+        struct timespec times[2];
+        times[0].tv_sec = times[1].tv_sec = 1577836800;
+        times[0].tv_nsec = times[1].tv_nsec = 0;
+        utimensat(AT_FDCWD, (test_dir / "dir1/sub").c_str(), times, 0);
+        utimensat(AT_FDCWD, (test_dir / "dir1").c_str(), times, 0);
+
+        WHEN("多线程备份并恢复元数据") {
+            Packer packer;
+            packer.set_threads(4);
+            packer.set_restore_metadata(true);
+
+            fs::path backup_path = backup_dir / (test_dir.filename().string() + ".backup");
+            REQUIRE(packer.Pack(test_dir, backup_path) == true);
+
+            fs::path restore_path = backup_dir / "restored";
+            REQUIRE(packer.Unpack(backup_path, restore_path) == true);
+
+            THEN("目录的修改时间不会被子项的写入覆盖") {
+                fs::path restored_dir = restore_path / test_dir.filename();
+                struct stat st;
+                REQUIRE(stat((restored_dir / "dir1").c_str(), &st) == 0);
+                REQUIRE(st.st_mtim.tv_sec == 1577836800);
+                REQUIRE(stat((restored_dir / "dir1/sub").c_str(), &st) == 0);
+                REQUIRE(st.st_mtim.tv_sec == 1577836800);
+
+                std::ifstream file2(restored_dir / "dir1/sub/file2.txt");
+                std::string content((std::istreambuf_iterator<char>(file2)), {});
+                REQUIRE(content == "文件2");
+
+                fs::remove_all(restore_path);
+            }
+        }
+    }
+}
+
 SCENARIO_METHOD(TestFixture, "备份时的文件过滤功能",
                 "[backup][filter]") {
     GIVEN("一个包含多种类型文件的目录") {
@@ -844,6 +1080,64 @@ SCENARIO_METHOD(TestFixture, "测试压缩功能的有效性",
     }
 }
 
+SCENARIO_METHOD(TestFixture, "使用不同压缩算法备份和恢复",
+                "[backup][compression][codec]") {
+    GIVEN("一个包含文本和二进制内容的测试目录") {
+        std::string text;
+        for (int i = 0; i < 3000; ++i) {
+            text += "record " + std::to_string(i % 97) + " of the backup\n";
+        }
+        std::string binary(20000, '\0');
+        for (size_t i = 0; i < binary.size(); ++i) {
+            binary[i] = static_cast<char>((i * 2654435761u) >> 13);
+        }
+
+        std::vector<TestFile> files = {
+            {"text.txt", TestFileType::Regular, text},
+            {"dir1", TestFileType::Directory},
+            {"dir1/binary.bin", TestFileType::Regular, binary},
+            {"dir1/empty.txt", TestFileType::Regular, ""}
+        };
+        create_test_structure(files);
+
+        WHEN("分别使用lz和lzh算法以小窗口备份") {
+            std::map<std::string, uintmax_t> sizes;
+            for (const std::string name : {"lz", "lzh"}) {
+                Packer packer;
+                packer.set_window_size(16 * 1024);
+                packer.set_codec(Codec::IdFromName(name), name == "lzh" ? 9 : 0);
+                fs::path backup_path = backup_dir / (name + ".backup");
+                REQUIRE(packer.Pack(test_dir, backup_path) == true);
+                REQUIRE(packer.Verify(backup_path) == true);
+                sizes[name] = fs::file_size(backup_path);
+            }
+
+            THEN("备份被压缩且可以完整还原") {
+                REQUIRE(sizes["lzh"] < text.size() / 4 + binary.size());
+                REQUIRE(sizes["lzh"] <= sizes["lz"]);
+
+                for (const std::string name : {"lz", "lzh"}) {
+                    Packer packer;
+                    fs::path restore_path = backup_dir / ("restored_" + name);
+                    REQUIRE(packer.Unpack(backup_dir / (name + ".backup"), restore_path) == true);
+
+                    fs::path restored_dir = restore_path / name;
+                    std::ifstream text_file(restored_dir / "text.txt");
+                    std::string text_content((std::istreambuf_iterator<char>(text_file)), {});
+                    REQUIRE(text_content == text);
+
+                    std::ifstream binary_file(restored_dir / "dir1/binary.bin", std::ios::binary);
+                    std::string binary_content((std::istreambuf_iterator<char>(binary_file)), {});
+                    REQUIRE(binary_content == binary);
+                    REQUIRE(fs::file_size(restored_dir / "dir1/empty.txt") == 0);
+
+                    fs::remove_all(restore_path);
+                }
+            }
+        }
+    }
+}
+
 SCENARIO_METHOD(TestFixture, "测试加密功能的有效性",
                 "[backup][encryption]") {
     GIVEN("一个包含敏感数据的测试目录") {
@@ -967,6 +1261,1059 @@ SCENARIO_METHOD(TestFixture, "测试加密和压缩的组合功能",
     }
 }
 
+SCENARIO_METHOD(TestFixture, "批量任务共享密钥句柄",
+                "[backup][encryption]") {
+    GIVEN("两个包含敏感数据的测试目录") {
+        std::vector<TestFile> files = {
+            {"secret.txt", TestFileType::Regular, "这是一些敏感数据"},
+            {"other", TestFileType::Directory},
+            {"other/key.txt", TestFileType::Regular, "another_secret"}
+        };
+        create_test_structure(files);
+        const fs::path other_dir = test_dir / "other";
+
+        WHEN("多个Packer使用同一个密钥句柄备份") {
+            auto read_file = [](const fs::path& path) {
+                std::ifstream file(path);
+                return std::string((std::istreambuf_iterator<char>(file)), {});
+            };
+            auto key = std::make_shared<KeyHandle>("batch_password", KDF_PBKDF2, 20000);
+            fs::path first_backup = backup_dir / "first.backup";
+            fs::path second_backup = backup_dir / "second.backup";
+            {
+                Packer packer;
+                packer.set_key(key);
+                REQUIRE(packer.Pack(test_dir, first_backup) == true);
+            }
+            {
+                Packer packer;
+                packer.set_key(key);
+                packer.set_codec(CODEC_LZ);
+                REQUIRE(packer.Pack(other_dir, second_backup) == true);
+            }
+
+            THEN("同一个句柄和只知道密码的Packer都能恢复") {
+                Packer restore_packer;
+                restore_packer.set_key(key);
+                REQUIRE(restore_packer.Unpack(first_backup, backup_dir / "restored1") == true);
+                REQUIRE(restore_packer.Unpack(second_backup, backup_dir / "restored2") == true);
+                REQUIRE(read_file(backup_dir / "restored1/first/secret.txt") == "这是一些敏感数据");
+                REQUIRE(read_file(backup_dir / "restored2/second/key.txt") == "another_secret");
+
+                // 派生参数从备份中读取，与恢复端的设置无关
+                Packer password_packer;
+                password_packer.set_kdf(KDF_SCRYPT);
+                password_packer.set_encrypt(true, "batch_password");
+                std::vector<IndexEntry> entries;
+                REQUIRE(password_packer.List(second_backup, entries) == true);
+                REQUIRE(entries.size() == 1);
+
+                Packer wrong_packer;
+                wrong_packer.set_encrypt(true, "wrong_password");
+                REQUIRE(wrong_packer.List(second_backup, entries) == false);
+            }
+        }
+    }
+}
+
+SCENARIO_METHOD(TestFixture, "使用scrypt派生密钥备份和恢复",
+                "[backup][encryption]") {
+    GIVEN("一个包含敏感数据的测试目录") {
+        std::vector<TestFile> files = {
+            {"secret.txt", TestFileType::Regular, "scrypt保护的数据"}
+        };
+        create_test_structure(files);
+
+        WHEN("使用scrypt派生密钥加密备份") {
+            Packer packer;
+            auto read_file = [](const fs::path& path) {
+                std::ifstream file(path);
+                return std::string((std::istreambuf_iterator<char>(file)), {});
+            };
+            packer.set_kdf(KDF_SCRYPT, 12);
+            packer.set_encrypt(true, "scrypt_password");
+            fs::path backup_path = backup_dir / (test_dir.filename().string() + ".backup");
+            REQUIRE(packer.Pack(test_dir, backup_path) == true);
+
+            THEN("只用密码就能恢复") {
+                Packer restore_packer;
+                restore_packer.set_encrypt(true, "scrypt_password");
+                fs::path restore_path = backup_dir / "restored";
+                REQUIRE(restore_packer.Unpack(backup_path, restore_path) == true);
+                REQUIRE(read_file(restore_path / test_dir.filename() / "secret.txt") ==
+                        "scrypt保护的数据");
+            }
+        }
+    }
+}
+
+SCENARIO_METHOD(TestFixture, "验证时定位损坏的数据帧",
+                "[verify]") {
+    GIVEN("一个按小窗口分帧的备份") {
+        std::vector<TestFile> files = {
+            {"a.txt", TestFileType::Regular, std::string(6000, 'a')},
+            {"b.txt", TestFileType::Regular, std::string(6000, 'b')},
+            {"c.txt", TestFileType::Regular, std::string(6000, 'c')}
+        };
+        create_test_structure(files);
+
+        Packer packer;
+        packer.set_window_size(4096);
+        fs::path backup_path = backup_dir / "damaged.backup";
+        fs::path intact_path = backup_dir / "intact.backup";
+        REQUIRE(packer.Pack(test_dir, backup_path) == true);
+        fs::copy_file(backup_path, intact_path);
+
+        WHEN("b.txt中间的一个字节被改写") {
+            std::fstream backup(backup_path, std::ios::in | std::ios::out | std::ios::binary);
+            std::string content((std::istreambuf_iterator<char>(backup)), {});
+            // 记录跨越多个帧，取帧内一段连续的数据
+            const size_t pos = content.find(std::string(1000, 'b')) + 500;
+            REQUIRE(pos != std::string::npos + 500);
+            backup.seekp(pos);
+            backup.put('x');
+            backup.close();
+
+            THEN("单线程和多线程验证都报告同一个损坏的帧和受影响的文件") {
+                for (unsigned threads : {1u, 4u}) {
+                    INFO(threads);
+                    Packer verifier;
+                    verifier.set_threads(threads);
+                    VerifyReport report;
+                    REQUIRE(verifier.Verify(backup_path, report) == false);
+                    REQUIRE_FALSE(report.checksum_ok);
+                    REQUIRE(report.damaged.size() == 1);
+                    const auto& damage = report.damaged[0];
+                    REQUIRE(damage.offset <= pos);
+                    REQUIRE(pos < damage.offset + damage.size);
+                    REQUIRE(std::any_of(damage.files.begin(), damage.files.end(),
+                                        [](const std::string& file) {
+                                            return fs::path(file).filename() == "b.txt";
+                                        }));
+                    // 一帧小于一条记录，最多涉及相邻的两个文件
+                    REQUIRE(damage.files.size() <= 2);
+
+                    REQUIRE(verifier.Verify(intact_path, report) == true);
+                    REQUIRE(report.checksum_ok);
+                    REQUIRE(report.damaged.empty());
+                }
+            }
+        }
+    }
+}
+
+SCENARIO_METHOD(TestFixture, "深度验证检查每个文件",
+                "[verify][deep]") {
+    GIVEN("一个包含各种文件类型的加密压缩备份") {
+        std::vector<TestFile> files = {
+            {"data.txt", TestFileType::Regular, std::string(3000, 'd')},
+            {"dir1", TestFileType::Directory},
+            {"dir1/hardlink1", TestFileType::Regular, "", "../data.txt", true},
+            {"dir1/link1", TestFileType::Symlink, "", "../data.txt"},
+            {"dir2", TestFileType::Directory},
+            {"dir2/pipe1", TestFileType::FIFO},
+            {"dir2/empty.txt", TestFileType::Regular, ""}
+        };
+        create_test_structure(files);
+        Packer packer;
+        packer.set_window_size(1024);
+        packer.set_codec(CODEC_LZ);
+        packer.set_encrypt(true, "deep_password");
+        fs::path backup_path = backup_dir / "deep.backup";
+        REQUIRE(packer.Pack(test_dir, backup_path) == true);
+        std::vector<IndexEntry> entries;
+        REQUIRE(packer.List(backup_path, entries) == true);
+
+        WHEN("单线程和多线程深度验证") {
+            THEN("所有文件都通过检查且不写入任何文件") {
+                const auto before = std::distance(fs::directory_iterator(backup_dir),
+                                                  fs::directory_iterator());
+                for (unsigned threads : {1u, 4u}) {
+                    INFO(threads);
+                    Packer verifier;
+                    verifier.set_threads(threads);
+                    verifier.set_deep_verify(true);
+                    verifier.set_encrypt(true, "deep_password");
+                    VerifyReport report;
+                    REQUIRE(verifier.Verify(backup_path, report) == true);
+                    REQUIRE(report.files_checked == entries.size());
+                    REQUIRE(report.file_errors.empty());
+                }
+                REQUIRE(std::distance(fs::directory_iterator(backup_dir),
+                                      fs::directory_iterator()) == before);
+
+                // 没有密码无法深度验证
+                Packer no_key;
+                no_key.set_deep_verify(true);
+                REQUIRE(no_key.Verify(backup_path) == false);
+            }
+        }
+    }
+}
+
+SCENARIO_METHOD(TestFixture, "深度验证跳过损坏的数据帧继续检查",
+                "[verify][deep]") {
+    GIVEN("一个按小窗口分帧的备份") {
+        std::vector<TestFile> files = {
+            {"a.txt", TestFileType::Regular, std::string(6000, 'a')},
+            {"b.txt", TestFileType::Regular, std::string(6000, 'b')},
+            {"c.txt", TestFileType::Regular, std::string(6000, 'c')}
+        };
+        create_test_structure(files);
+
+        Packer packer;
+        packer.set_window_size(4096);
+        fs::path backup_path = backup_dir / "damaged.backup";
+        REQUIRE(packer.Pack(test_dir, backup_path) == true);
+
+        WHEN("b.txt所在的一个数据帧被改写") {
+            std::fstream backup(backup_path, std::ios::in | std::ios::out | std::ios::binary);
+            std::string content((std::istreambuf_iterator<char>(backup)), {});
+            const size_t pos = content.find(std::string(1000, 'b')) + 500;
+            REQUIRE(pos != std::string::npos + 500);
+            backup.seekp(pos);
+            backup.put('x');
+            backup.close();
+
+            THEN("报告b.txt损坏，其余文件仍被检查") {
+                for (unsigned threads : {1u, 4u}) {
+                    INFO(threads);
+                    Packer verifier;
+                    verifier.set_threads(threads);
+                    verifier.set_deep_verify(true);
+                    VerifyReport report;
+                    REQUIRE(verifier.Verify(backup_path, report) == false);
+                    REQUIRE(std::any_of(report.file_errors.begin(), report.file_errors.end(),
+                                        [](const VerifyReport::FileError& error) {
+                                            return fs::path(error.path).filename() == "b.txt";
+                                        }));
+                    REQUIRE(report.file_errors.size() <= 2);
+                    REQUIRE(report.files_checked + report.file_errors.size() == 3);
+                    REQUIRE(report.files_checked >= 1);
+                }
+            }
+        }
+    }
+}
+
+SCENARIO_METHOD(TestFixture, "增量备份只打包改变的文件并记录删除",
+                "[incremental]") {
+    GIVEN("一个写出清单的完整备份，之后源目录发生了变化") {
+        std::vector<TestFile> files = {
+            {"keep.txt", TestFileType::Regular, "unchanged"},
+            {"change.txt", TestFileType::Regular, "old"},
+            {"remove.txt", TestFileType::Regular, "removed later"},
+            {"dir1", TestFileType::Directory},
+            {"dir1/old.txt", TestFileType::Regular, "in removed dir"},
+            {"swap", TestFileType::Regular, "file becomes dir"},
+            {"link1", TestFileType::Symlink, "", "keep.txt"}
+        };
+        create_test_structure(files);
+
+        const fs::path full_backup = backup_dir / "full.backup";
+        const fs::path full_manifest = backup_dir / "full.manifest";
+        {
+            Packer packer;
+            packer.set_manifest(full_manifest);
+            REQUIRE(packer.Pack(test_dir, full_backup) == true);
+            REQUIRE(fs::exists(full_manifest));
+        }
+
+        std::ofstream(test_dir / "change.txt") << "changed content";
+        std::ofstream(test_dir / "new.txt") << "new file";
+        fs::remove(test_dir / "remove.txt");
+        fs::remove_all(test_dir / "dir1");
+        fs::remove(test_dir / "swap");
+        fs::create_directory(test_dir / "swap");
+        std::ofstream(test_dir / "swap" / "inner.txt") << "inside";
+
+        WHEN("单线程和多线程增量备份后按顺序恢复") {
+            THEN("增量备份只包含变化，恢复结果与当前目录一致") {
+                auto read_file = [](const fs::path& path) {
+                    std::ifstream file(path);
+                    return std::string((std::istreambuf_iterator<char>(file)), {});
+                };
+                for (unsigned threads : {1u, 4u}) {
+                    INFO(threads);
+                    const std::string name = "inc" + std::to_string(threads);
+                    const fs::path inc_backup = backup_dir / (name + ".backup");
+                    Packer packer;
+                    packer.set_threads(threads);
+                    packer.set_incremental(full_manifest);
+                    packer.set_manifest(backup_dir / (name + ".manifest"));
+                    REQUIRE(packer.Pack(test_dir, inc_backup) == true);
+
+                    std::vector<IndexEntry> entries;
+                    REQUIRE(packer.List(inc_backup, entries) == true);
+                    std::map<std::string, std::vector<mode_t>> types;
+                    for (const auto& entry : entries) {
+                        types[entry.path].push_back(entry.metadata.st_mode & S_IFMT);
+                    }
+                    REQUIRE(types.count("keep.txt") == 0);
+                    REQUIRE(types.count("link1") == 0);
+                    REQUIRE(types["change.txt"] == std::vector<mode_t>{S_IFREG});
+                    REQUIRE(types["new.txt"] == std::vector<mode_t>{S_IFREG});
+                    REQUIRE(types["remove.txt"] == std::vector<mode_t>{MODE_WHITEOUT});
+                    REQUIRE(types["dir1"] == std::vector<mode_t>{MODE_WHITEOUT});
+                    REQUIRE(types["swap"] == std::vector<mode_t>{MODE_WHITEOUT, S_IFDIR});
+                    REQUIRE(types["swap/inner.txt"] == std::vector<mode_t>{S_IFREG});
+
+                    // 新清单包含当前所有文件，不含已删除的
+                    Manifest manifest = Manifest::Load(backup_dir / (name + ".manifest"));
+                    REQUIRE(manifest.find("keep.txt") != nullptr);
+                    REQUIRE(manifest.find("swap/inner.txt") != nullptr);
+                    REQUIRE(manifest.find("remove.txt") == nullptr);
+                    REQUIRE(manifest.find("dir1/old.txt") == nullptr);
+
+                    Packer verifier;
+                    verifier.set_deep_verify(true);
+                    REQUIRE(verifier.Verify(inc_backup) == true);
+
+                    fs::path restore_dir = fs::absolute("restored_" + name);
+                    fs::remove_all(restore_dir);
+                    Packer restorer;
+                    restorer.set_threads(threads);
+                    REQUIRE(restorer.Unpack({full_backup, inc_backup}, restore_dir) == true);
+                    fs::path project_dir = restore_dir / "full";
+                    REQUIRE(read_file(project_dir / "keep.txt") == "unchanged");
+                    REQUIRE(read_file(project_dir / "change.txt") == "changed content");
+                    REQUIRE(read_file(project_dir / "new.txt") == "new file");
+                    REQUIRE(read_file(project_dir / "swap" / "inner.txt") == "inside");
+                    REQUIRE(fs::is_symlink(project_dir / "link1"));
+                    REQUIRE_FALSE(fs::exists(project_dir / "remove.txt"));
+                    REQUIRE_FALSE(fs::exists(project_dir / "dir1"));
+                    fs::remove_all(restore_dir);
+                }
+            }
+        }
+    }
+}
+
+SCENARIO_METHOD(TestFixture, "增量备份链按顺序恢复",
+                "[incremental]") {
+    GIVEN("完整备份之后的两次增量备份") {
+        std::vector<TestFile> files = {
+            {"a.txt", TestFileType::Regular, "a1"},
+            {"b.txt", TestFileType::Regular, "b1"}
+        };
+        create_test_structure(files);
+
+        std::vector<fs::path> chain;
+        auto pack = [&](const std::string& name, const fs::path& base) {
+            Packer packer;
+            packer.set_codec(CODEC_LZ);
+            packer.set_encrypt(true, "chain_password");
+            if (!base.empty()) {
+                packer.set_incremental(base);
+            }
+            packer.set_manifest(backup_dir / (name + ".manifest"));
+            chain.push_back(backup_dir / (name + ".backup"));
+            REQUIRE(packer.Pack(test_dir, chain.back()) == true);
+            return backup_dir / (name + ".manifest");
+        };
+        fs::path manifest = pack("chain", {});
+        // 第一次增量：删除b.txt，修改a.txt
+        fs::remove(test_dir / "b.txt");
+        std::ofstream(test_dir / "a.txt") << "a2 longer";
+        manifest = pack("chain.inc1", manifest);
+        // 第二次增量：重新创建b.txt
+        std::ofstream(test_dir / "b.txt") << "b3";
+        manifest = pack("chain.inc2", manifest);
+
+        WHEN("依次恢复完整备份和各增量备份") {
+            THEN("每一步都得到对应时刻的目录状态") {
+                auto read_file = [](const fs::path& path) {
+                    std::ifstream file(path);
+                    return std::string((std::istreambuf_iterator<char>(file)), {});
+                };
+                fs::path restore_dir = fs::absolute("restored_chain");
+                fs::remove_all(restore_dir);
+                Packer restorer;
+                restorer.set_encrypt(true, "chain_password");
+
+                REQUIRE(restorer.Unpack({chain[0], chain[1]}, restore_dir) == true);
+                REQUIRE(read_file(restore_dir / "chain" / "a.txt") == "a2 longer");
+                REQUIRE_FALSE(fs::exists(restore_dir / "chain" / "b.txt"));
+
+                fs::remove_all(restore_dir);
+                REQUIRE(restorer.Unpack(chain, restore_dir) == true);
+                REQUIRE(read_file(restore_dir / "chain" / "a.txt") == "a2 longer");
+                REQUIRE(read_file(restore_dir / "chain" / "b.txt") == "b3");
+                fs::remove_all(restore_dir);
+            }
+        }
+    }
+}
+
+SCENARIO_METHOD(TestFixture, "增量备份用内容哈希识别被替换的文件",
+                "[incremental]") {
+    GIVEN("一个写出清单的完整备份") {
+        std::vector<TestFile> files = {
+            {"same.txt", TestFileType::Regular, "same content"},
+            {"other.txt", TestFileType::Regular, "old content!"}
+        };
+        create_test_structure(files);
+        const fs::path manifest = backup_dir / "full.manifest";
+        {
+            Packer packer;
+            packer.set_manifest(manifest);
+            REQUIRE(packer.Pack(test_dir, backup_dir / "full.backup") == true);
+        }
+
+        WHEN("两个文件被替换为新inode且保留大小和修改时间，其中一个内容改变") {
+            auto replace = [&](const std::string& name, const std::string& content) {
+                const fs::path path = test_dir / name;
+                const auto mtime = fs::last_write_time(path);
+                const fs::path temp = test_dir / (name + ".tmp");
+                std::ofstream(temp) << content;
+                fs::rename(temp, path);
+                fs::last_write_time(path, mtime);
+            };
+            replace("same.txt", "same content");
+            replace("other.txt", "new content!");
+
+            Packer packer;
+            packer.set_incremental(manifest);
+            const fs::path inc_backup = backup_dir / "full.inc1.backup";
+            REQUIRE(packer.Pack(test_dir, inc_backup) == true);
+
+            THEN("只有内容改变的文件被打包") {
+                std::vector<IndexEntry> entries;
+                REQUIRE(packer.List(inc_backup, entries) == true);
+                std::vector<std::string> paths;
+                for (const auto& entry : entries) {
+                    paths.push_back(entry.path);
+                }
+                REQUIRE(paths == std::vector<std::string>{"other.txt"});
+            }
+        }
+    }
+}
+
+SCENARIO_METHOD(TestFixture, "清单记录的内容哈希在打包时计算",
+                "[incremental]") {
+    GIVEN("一个包含大小文件、硬链接和重复文件的目录") {
+        std::vector<TestFile> files = {
+            {"small.txt", TestFileType::Regular, std::string(1000, 's')},
+            {"empty.txt", TestFileType::Regular, ""},
+            {"large.txt", TestFileType::Regular, std::string(20000, 'l')},
+            {"dir1", TestFileType::Directory},
+            {"dir1/copy.txt", TestFileType::Regular, std::string(1000, 's')},
+            {"dir1/hardlink1", TestFileType::Regular, "", "../large.txt", true}
+        };
+        create_test_structure(files);
+
+        WHEN("以不同方式打包并写出清单") {
+            struct Mode {
+                const char* name;
+                unsigned threads;
+                bool dedup;
+                bool store;
+            };
+            const Mode modes[] = {
+                {"sequential", 1, true, false},
+                {"parallel", 4, true, false},
+                {"store", 4, false, true},
+            };
+
+            THEN("每个普通文件的哈希与文件内容一致") {
+                for (const Mode& mode : modes) {
+                    INFO(mode.name);
+                    const fs::path manifest = backup_dir / (std::string(mode.name) + ".manifest");
+                    Packer packer;
+                    packer.set_window_size(4096);
+                    packer.set_threads(mode.threads);
+                    packer.set_dedup_files(mode.dedup);
+                    if (mode.store) {
+                        packer.set_chunk_store(backup_dir / "store");
+                    }
+                    packer.set_manifest(manifest);
+                    REQUIRE(packer.Pack(test_dir, backup_dir / (std::string(mode.name) + ".backup")));
+
+                    const Manifest loaded = Manifest::Load(manifest);
+                    size_t regular = 0;
+                    for (const auto& [path, entry] : loaded.entries()) {
+                        INFO(path);
+                        if (S_ISREG(entry.mode)) {
+                            REQUIRE(entry.hash == Manifest::HashFile(test_dir / path));
+                            regular++;
+                        }
+                    }
+                    REQUIRE(regular == 5);
+                }
+            }
+        }
+    }
+}
+
+SCENARIO_METHOD(TestFixture, "数据块存储在备份之间去重",
+                "[store]") {
+    GIVEN("一个包含大文件及其副本的目录，以及一个数据块存储") {
+        std::mt19937 rng(7);
+        std::string large(300 * 1024, '\0');
+        for (auto& c : large) {
+            c = static_cast<char>(rng());
+        }
+        std::vector<TestFile> files = {
+            {"large.bin", TestFileType::Regular, large},
+            {"dir1", TestFileType::Directory},
+            {"dir1/copy.bin", TestFileType::Regular, large},
+            {"dir1/hardlink1", TestFileType::Regular, "", "../large.bin", true},
+            {"dir1/link1", TestFileType::Symlink, "", "../large.bin"},
+            {"empty.txt", TestFileType::Regular, ""}
+        };
+        create_test_structure(files);
+        const fs::path store_dir = backup_dir / "store";
+        const fs::path first = backup_dir / "first.backup";
+        const fs::path second = backup_dir / "second.backup";
+
+        WHEN("备份后修改大文件中间的一段再次备份") {
+            {
+                Packer packer;
+                packer.set_codec(CODEC_LZ);
+                packer.set_chunk_store(store_dir);
+                REQUIRE(packer.Pack(test_dir, first) == true);
+            }
+            const size_t chunks_before = ChunkStore(store_dir).size();
+            std::string modified = large;
+            modified.insert(150 * 1024, "插入的数据");
+            std::ofstream(test_dir / "large.bin", std::ios::trunc) << modified;
+            {
+                Packer packer;
+                packer.set_threads(4);
+                packer.set_chunk_store(store_dir);
+                REQUIRE(packer.Pack(test_dir, second) == true);
+            }
+
+            THEN("备份只含数据块列表，第二次只新增少量数据块，两个备份都能完整恢复") {
+                // 副本和硬链接不重复保存，修改只影响插入位置附近的块
+                REQUIRE(fs::file_size(first) < large.size() / 10);
+                REQUIRE(chunks_before <= large.size() / Chunker::MIN_SIZE);
+                REQUIRE(ChunkStore(store_dir).size() - chunks_before <= 3);
+
+                auto read_file = [](const fs::path& path) {
+                    std::ifstream file(path, std::ios::binary);
+                    return std::string((std::istreambuf_iterator<char>(file)), {});
+                };
+                for (unsigned threads : {1u, 4u}) {
+                    INFO(threads);
+                    const fs::path restore_dir = backup_dir / ("restored" + std::to_string(threads));
+                    Packer restorer;
+                    restorer.set_threads(threads);
+                    restorer.set_chunk_store(store_dir);
+                    REQUIRE(restorer.Unpack(first, restore_dir) == true);
+                    REQUIRE(restorer.Unpack(second, restore_dir) == true);
+                    REQUIRE(read_file(restore_dir / "first" / "large.bin") == large);
+                    REQUIRE(read_file(restore_dir / "first" / "dir1" / "copy.bin") == large);
+                    REQUIRE(fs::equivalent(restore_dir / "first" / "large.bin",
+                                           restore_dir / "first" / "dir1" / "hardlink1"));
+                    REQUIRE(fs::is_symlink(restore_dir / "first" / "dir1" / "link1"));
+                    REQUIRE(fs::file_size(restore_dir / "first" / "empty.txt") == 0);
+                    REQUIRE(read_file(restore_dir / "second" / "large.bin") == modified);
+                    REQUIRE(read_file(restore_dir / "second" / "dir1" / "copy.bin") == large);
+
+                    Packer verifier;
+                    verifier.set_threads(threads);
+                    verifier.set_deep_verify(true);
+                    verifier.set_chunk_store(store_dir);
+                    VerifyReport report;
+                    REQUIRE(verifier.Verify(second, report) == true);
+                    REQUIRE(report.files_checked == files.size());
+                }
+
+                const fs::path extract_dir = backup_dir / "extracted";
+                Packer extractor;
+                extractor.set_chunk_store(store_dir);
+                REQUIRE(extractor.Extract(second, {"dir1/copy.bin"}, extract_dir) == true);
+                REQUIRE(read_file(extract_dir / "second" / "dir1" / "copy.bin") == large);
+            }
+        }
+    }
+}
+
+SCENARIO_METHOD(TestFixture, "缺少数据块存储时无法恢复",
+                "[store]") {
+    GIVEN("一个使用数据块存储的备份") {
+        std::vector<TestFile> files = {
+            {"data.txt", TestFileType::Regular, std::string(20000, 'd')}
+        };
+        create_test_structure(files);
+        const fs::path store_dir = backup_dir / "store";
+        const fs::path backup_path = backup_dir / "stored.backup";
+        {
+            Packer packer;
+            packer.set_chunk_store(store_dir);
+            REQUIRE(packer.Pack(test_dir, backup_path) == true);
+        }
+
+        WHEN("不指定存储或指定了另一个存储") {
+            const fs::path other_store = backup_dir / "other";
+            { ChunkStore other(other_store, true); }
+            const fs::path restore_dir = backup_dir / "restored";
+
+            THEN("恢复和深度验证失败，校验和验证与列出文件不受影响") {
+                Packer no_store;
+                REQUIRE(no_store.Unpack(backup_path, restore_dir) == false);
+                Packer wrong_store;
+                wrong_store.set_chunk_store(other_store);
+                REQUIRE(wrong_store.Unpack(backup_path, restore_dir) == false);
+                REQUIRE_FALSE(fs::exists(restore_dir / "stored" / "data.txt"));
+
+                Packer verifier;
+                REQUIRE(verifier.Verify(backup_path) == true);
+                verifier.set_deep_verify(true);
+                REQUIRE(verifier.Verify(backup_path) == false);
+                std::vector<IndexEntry> entries;
+                REQUIRE(verifier.List(backup_path, entries) == true);
+                REQUIRE(entries.size() == 1);
+
+                // 存储不加密，不能用于加密的备份
+                Packer encrypted;
+                encrypted.set_chunk_store(store_dir);
+                encrypted.set_encrypt(true, "password");
+                REQUIRE(encrypted.Pack(test_dir, backup_dir / "encrypted.backup") == false);
+            }
+        }
+    }
+}
+
+SCENARIO_METHOD(TestFixture, "内容相同的文件只保存一次",
+                "[backup][dedup]") {
+    GIVEN("一个包含多份相同内容文件的目录") {
+        const std::string content(5000, 'c');
+        std::vector<TestFile> files = {
+            {"a.txt", TestFileType::Regular, content},
+            {"dir1", TestFileType::Directory},
+            {"dir1/b.txt", TestFileType::Regular, content},
+            {"dir1/c.txt", TestFileType::Regular, std::string(5000, 'd')},
+            {"dir1/hardlink1", TestFileType::Regular, "", "b.txt", true},
+            {"dir2", TestFileType::Directory},
+            {"dir2/d.txt", TestFileType::Regular, content}
+        };
+        create_test_structure(files);
+
+        WHEN("单线程和多线程合并重复文件打包后恢复") {
+            const fs::path plain = backup_dir / "plain.backup";
+            {
+                Packer packer;
+                REQUIRE(packer.Pack(test_dir, plain) == true);
+            }
+
+            THEN("备份变小，恢复出的重复文件是独立的副本") {
+                auto read_file = [](const fs::path& path) {
+                    std::ifstream file(path, std::ios::binary);
+                    return std::string((std::istreambuf_iterator<char>(file)), {});
+                };
+                for (unsigned threads : {1u, 4u}) {
+                    INFO(threads);
+                    const std::string name = "dedup" + std::to_string(threads);
+                    const fs::path backup_path = backup_dir / (name + ".backup");
+                    Packer packer;
+                    packer.set_threads(threads);
+                    packer.set_dedup_files(true);
+                    REQUIRE(packer.Pack(test_dir, backup_path) == true);
+                    // 两个副本只保存路径
+                    REQUIRE(fs::file_size(backup_path) + 2 * content.size() <= fs::file_size(plain) + 100);
+
+                    Packer verifier;
+                    verifier.set_deep_verify(true);
+                    VerifyReport report;
+                    REQUIRE(verifier.Verify(backup_path, report) == true);
+                    REQUIRE(report.files_checked == files.size());
+
+                    const fs::path restore_dir = backup_dir / ("restored" + std::to_string(threads));
+                    Packer restorer;
+                    restorer.set_threads(threads);
+                    restorer.set_restore_metadata(true);
+                    REQUIRE(restorer.Unpack(backup_path, restore_dir) == true);
+                    const fs::path project_dir = restore_dir / name;
+                    for (const char* path : {"a.txt", "dir1/b.txt", "dir2/d.txt"}) {
+                        REQUIRE(read_file(project_dir / path) == content);
+                    }
+                    REQUIRE(read_file(project_dir / "dir1" / "c.txt") == std::string(5000, 'd'));
+                    REQUIRE_FALSE(fs::equivalent(project_dir / "a.txt", project_dir / "dir1" / "b.txt"));
+                    REQUIRE(fs::equivalent(project_dir / "dir1" / "b.txt",
+                                           project_dir / "dir1" / "hardlink1"));
+
+                    // 只提取副本时一并提取原文件
+                    const fs::path extract_dir = backup_dir / ("extracted" + std::to_string(threads));
+                    Packer extractor;
+                    REQUIRE(extractor.Extract(backup_path, {"dir2/d.txt"}, extract_dir) == true);
+                    REQUIRE(read_file(extract_dir / name / "dir2" / "d.txt") == content);
+                }
+            }
+        }
+    }
+}
+
+SCENARIO_METHOD(TestFixture, "测试小窗口下的流式打包",
+                "[backup][stream]") {
+    GIVEN("一个数据量远大于窗口的测试目录") {
+        std::string large_text;
+        large_text.reserve(20000);
+        for (int i = 0; i < 2000; ++i) {
+            large_text += "line_" + std::to_string(i) + "\n";
+        }
+
+        std::vector<TestFile> files = {
+            {"large.txt", TestFileType::Regular, large_text},
+            {"dir1", TestFileType::Directory},
+            {"dir1/small.txt", TestFileType::Regular, "small"}
+        };
+        create_test_structure(files);
+
+        WHEN("以1KB窗口压缩并加密备份") {
+            Packer packer;
+            packer.set_window_size(1024);
+            packer.set_compress(true);
+            packer.set_encrypt(true, "test_password");
+
+            fs::path backup_path = backup_dir / (test_dir.filename().string() + ".backup");
+            REQUIRE(packer.Pack(test_dir, backup_path) == true);
+
+            THEN("备份文件可以验证并完整还原") {
+                REQUIRE(packer.Verify(backup_path) == true);
+
+                fs::path restore_path = backup_dir / "restored";
+                REQUIRE(packer.Unpack(backup_path, restore_path) == true);
+                // 解包过程不应在备份旁留下临时文件
+                REQUIRE_FALSE(fs::exists(backup_dir / (test_dir.filename().string() + ".tmp")));
+
+                fs::path restored_dir = restore_path / test_dir.filename();
+                std::ifstream large_file(restored_dir / "large.txt");
+                std::string large_content((std::istreambuf_iterator<char>(large_file)), {});
+                REQUIRE(large_content == large_text);
+
+                std::ifstream small_file(restored_dir / "dir1/small.txt");
+                std::string small_content((std::istreambuf_iterator<char>(small_file)), {});
+                REQUIRE(small_content == "small");
+
+                fs::remove_all(restore_path);
+            }
+        }
+    }
+}
+
+SCENARIO_METHOD(TestFixture, "从映射的未压缩备份恢复",
+                "[restore][stream]") {
+    GIVEN("一个以1KB窗口未压缩备份的目录，文件头和文件内容跨越帧边界") {
+        std::string large_text;
+        for (int i = 0; i < 2000; ++i) {
+            large_text += "line_" + std::to_string(i) + "\n";
+        }
+        std::vector<TestFile> files = {
+            {"large.txt", TestFileType::Regular, large_text},
+            {"dir1", TestFileType::Directory},
+            {"dir1/small.txt", TestFileType::Regular, "small"},
+            {"dir1/link1", TestFileType::Symlink, "", "../large.txt"}
+        };
+        create_test_structure(files);
+
+        Packer packer;
+        packer.set_window_size(1024);
+        fs::path backup_path = backup_dir / (test_dir.filename().string() + ".backup");
+        REQUIRE(packer.Pack(test_dir, backup_path) == true);
+        fs::path restore_path = backup_dir / "restored";
+
+        WHEN("恢复备份") {
+            REQUIRE(packer.Unpack(backup_path, restore_path) == true);
+
+            THEN("文件内容直接从映射写出，与原文件相同；数据帧损坏时恢复报告错误") {
+                fs::path restored_dir = restore_path / test_dir.filename();
+                std::ifstream large_file(restored_dir / "large.txt");
+                std::string large_content((std::istreambuf_iterator<char>(large_file)), {});
+                REQUIRE(large_content == large_text);
+                std::ifstream small_file(restored_dir / "dir1/small.txt");
+                std::string small_content((std::istreambuf_iterator<char>(small_file)), {});
+                REQUIRE(small_content == "small");
+                REQUIRE(fs::read_symlink(restored_dir / "dir1/link1") == "../large.txt");
+
+                std::fstream backup(backup_path, std::ios::in | std::ios::out | std::ios::binary);
+                std::string content((std::istreambuf_iterator<char>(backup)), {});
+                const size_t pos = content.find("line_1000");
+                REQUIRE(pos != std::string::npos);
+                backup.seekp(pos);
+                backup.put('x');
+                backup.close();
+                REQUIRE(packer.Unpack(backup_path, restore_path) == false);
+
+                fs::remove_all(restore_path);
+            }
+        }
+    }
+}
+
+SCENARIO_METHOD(TestFixture, "v2分帧格式的布局",
+                "[backup][format]") {
+    GIVEN("一个跨越多个帧的测试目录") {
+        std::vector<TestFile> files = {
+            {"a.txt", TestFileType::Regular, std::string(3000, 'a')},
+            {"dir1", TestFileType::Directory},
+            {"dir1/b.txt", TestFileType::Regular, "bbb"}
+        };
+        create_test_structure(files);
+
+        WHEN("以1KB窗口压缩备份") {
+            Packer packer;
+            packer.set_window_size(1024);
+            packer.set_compress(true);
+            fs::path backup_path = backup_dir / (test_dir.filename().string() + ".backup");
+            REQUIRE(packer.Pack(test_dir, backup_path) == true);
+
+            THEN("文件带有格式标识和索引文件尾，且可以还原") {
+                std::ifstream backup_file(backup_path, std::ios::binary);
+                std::string content((std::istreambuf_iterator<char>(backup_file)), {});
+                REQUIRE(content.find(std::string(ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC))) !=
+                        std::string::npos);
+                REQUIRE(content.substr(content.size() - sizeof(TRAILER_MAGIC)) ==
+                        std::string(TRAILER_MAGIC, sizeof(TRAILER_MAGIC)));
+
+                ArchiveTrailer trailer;
+                std::memcpy(&trailer, content.data() + content.size() - sizeof(trailer),
+                            sizeof(trailer));
+                REQUIRE(trailer.frame_count > 1);
+                REQUIRE(trailer.index_offset < content.size());
+
+                fs::path restore_path = backup_dir / "restored";
+                REQUIRE(packer.Unpack(backup_path, restore_path) == true);
+                std::ifstream restored(restore_path / test_dir.filename() / "a.txt");
+                std::string restored_content((std::istreambuf_iterator<char>(restored)), {});
+                REQUIRE(restored_content == std::string(3000, 'a'));
+                fs::remove_all(restore_path);
+            }
+        }
+    }
+}
+
+SCENARIO_METHOD(TestFixture, "恢复旧格式(v1)的备份",
+                "[restore][format]") {
+    GIVEN("手工构造的旧格式备份") {
+        // 与Packer内部的BackupHeader布局一致
+        struct LegacyHeader {
+            time_t timestamp;
+            uint32_t checksum;
+            char comment[256];
+            unsigned char mod;
+        };
+        fs::create_directories(backup_dir);
+        fs::path source = backup_dir / "source.txt";
+        std::ofstream{source} << "legacy content";
+
+        FileHeader record{};
+        std::strncpy(record.path, "old.txt", sizeof(record.path) - 1);
+        REQUIRE(lstat(source.c_str(), &record.metadata) == 0);
+        std::string stream(reinterpret_cast<const char*>(&record), sizeof(record));
+        stream += "legacy content";
+
+        auto write_legacy = [&](const fs::path& path, unsigned char mod, const std::string& body) {
+            LegacyHeader header{};
+            header.timestamp = std::time(nullptr);
+            header.mod = mod;
+            std::ofstream out(path, std::ios::binary);
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.write(body.data(), body.size());
+        };
+        fs::path plain_backup = backup_dir / "plain.backup";
+        write_legacy(plain_backup, 0, stream);
+        fs::path compressed_backup = backup_dir / "compressed.backup";
+        // 旧版LZW格式：size_t码字数量，随后每个码字按int存储。
+        // 全部使用单字节码字也是合法的编码
+        std::string compressed;
+        size_t code_count = stream.size();
+        compressed.append(reinterpret_cast<const char*>(&code_count), sizeof(code_count));
+        for (unsigned char c : stream) {
+            int code = c;
+            compressed.append(reinterpret_cast<const char*>(&code), sizeof(code));
+        }
+        write_legacy(compressed_backup, 0x01, compressed);
+        fs::path encrypted_backup = backup_dir / "encrypted.backup";
+        auto encrypted = AESModule("legacy_password").encrypt(stream);
+        write_legacy(encrypted_backup, 0x02, std::string(encrypted.begin(), encrypted.end()));
+
+        WHEN("还原旧格式备份") {
+            Packer packer;
+            fs::path restore_path = backup_dir / "restored";
+            REQUIRE(packer.Unpack(plain_backup, restore_path) == true);
+            REQUIRE(packer.Unpack(compressed_backup, restore_path) == true);
+            // 只加密的旧格式按窗口分段流式解密
+            Packer decrypting_packer;
+            decrypting_packer.set_window_size(64);
+            decrypting_packer.set_encrypt(true, "legacy_password");
+            REQUIRE(decrypting_packer.Unpack(encrypted_backup, restore_path) == true);
+            fs::path extract_path = backup_dir / "extracted";
+            REQUIRE(packer.Extract(plain_backup, {"old.txt"}, extract_path) == true);
+            REQUIRE(packer.Extract(compressed_backup, {"*.txt"}, extract_path) == true);
+            std::vector<IndexEntry> entries;
+            REQUIRE(packer.List(plain_backup, entries) == true);
+            REQUIRE(entries.size() == 1);
+            REQUIRE(entries[0].path == "old.txt");
+            REQUIRE(entries[0].metadata.st_size == 14);
+
+            THEN("文件内容正确") {
+                for (const fs::path& dir : {restore_path, extract_path}) {
+                    for (const char* name : {"plain", "compressed"}) {
+                        std::ifstream restored(dir / name / "old.txt");
+                        std::string content((std::istreambuf_iterator<char>(restored)), {});
+                        REQUIRE(content == "legacy content");
+                    }
+                }
+                std::ifstream decrypted(restore_path / "encrypted" / "old.txt");
+                std::string content((std::istreambuf_iterator<char>(decrypted)), {});
+                REQUIRE(content == "legacy content");
+                fs::remove_all(restore_path);
+            }
+        }
+    }
+}
+
+SCENARIO_METHOD(TestFixture, "列出备份中的文件",
+                "[list]") {
+    GIVEN("一个包含多种类型文件的目录") {
+        std::vector<TestFile> files = {
+            {"big.txt", TestFileType::Regular, std::string(3000, 'b')},
+            {"dir1", TestFileType::Directory},
+            {"dir1/small.txt", TestFileType::Regular, "small"},
+            {"link1", TestFileType::Symlink, "", "big.txt"},
+            {"pipe1", TestFileType::FIFO}
+        };
+        create_test_structure(files);
+
+        WHEN("压缩并加密备份后列出内容") {
+            Packer packer;
+            packer.set_window_size(1024);
+            packer.set_compress(true);
+            packer.set_encrypt(true, "test_password");
+            fs::path backup_path = backup_dir / (test_dir.filename().string() + ".backup");
+            REQUIRE(packer.Pack(test_dir, backup_path) == true);
+
+            std::vector<IndexEntry> entries;
+            REQUIRE(packer.List(backup_path, entries) == true);
+
+            THEN("每个文件的路径、类型和大小都正确") {
+                REQUIRE(entries.size() == files.size());
+                std::map<std::string, struct stat> listed;
+                for (const auto& entry : entries) {
+                    listed[entry.path] = entry.metadata;
+                }
+                REQUIRE(S_ISREG(listed.at("big.txt").st_mode));
+                REQUIRE(listed.at("big.txt").st_size == 3000);
+                REQUIRE(S_ISDIR(listed.at("dir1").st_mode));
+                REQUIRE(listed.at("dir1/small.txt").st_size == 5);
+                REQUIRE(S_ISLNK(listed.at("link1").st_mode));
+                REQUIRE(S_ISFIFO(listed.at("pipe1").st_mode));
+
+                // 没有密码时无法读取加密的索引
+                Packer no_key;
+                REQUIRE(no_key.List(backup_path, entries) == false);
+            }
+        }
+    }
+}
+
+SCENARIO_METHOD(TestFixture, "列出数据块存储和重复文件的记录",
+                "[list]") {
+    GIVEN("一个包含重复文件的目录") {
+        std::vector<TestFile> files = {
+            {"big.txt", TestFileType::Regular, std::string(3000, 'b')},
+            {"copy.txt", TestFileType::Regular, std::string(3000, 'b')},
+            {"dir1", TestFileType::Directory},
+            {"dir1/small.txt", TestFileType::Regular, "small"},
+            {"link1", TestFileType::Symlink, "", "big.txt"},
+            {"pipe1", TestFileType::FIFO}
+        };
+        create_test_structure(files);
+
+        WHEN("使用数据块存储和合并重复文件备份后列出内容") {
+            const fs::path store_backup = backup_dir / "store.backup";
+            const fs::path dedup_backup = backup_dir / "dedup.backup";
+            {
+                Packer packer;
+                packer.set_chunk_store(backup_dir / "store");
+                REQUIRE(packer.Pack(test_dir, store_backup) == true);
+            }
+            {
+                Packer packer;
+                packer.set_dedup_files(true);
+                REQUIRE(packer.Pack(test_dir, dedup_backup) == true);
+            }
+
+            THEN("普通文件仍显示为普通文件") {
+                for (const fs::path& path : {store_backup, dedup_backup}) {
+                    INFO(path.string());
+                    Packer packer;
+                    packer.set_chunk_store(backup_dir / "store");
+                    std::vector<IndexEntry> entries;
+                    REQUIRE(packer.List(path, entries) == true);
+                    std::map<std::string, char> types;
+                    for (const auto& entry : entries) {
+                        types[entry.path] = FileHandler::TypeChar(entry.metadata.st_mode);
+                    }
+                    REQUIRE(types.at("big.txt") == '-');
+                    REQUIRE(types.at("copy.txt") == '-');
+                    REQUIRE(types.at("dir1/small.txt") == '-');
+                    REQUIRE(types.at("dir1") == 'd');
+                    REQUIRE(types.at("link1") == 'l');
+                    REQUIRE(types.at("pipe1") == 'p');
+                }
+                REQUIRE(FileHandler::TypeChar(MODE_WHITEOUT) == 'w');
+            }
+        }
+    }
+}
+
+SCENARIO_METHOD(TestFixture, "从备份中提取部分文件",
+                "[restore][extract]") {
+    GIVEN("一个跨越多个帧、包含硬链接的目录") {
+        std::vector<TestFile> files = {
+            {"big.txt", TestFileType::Regular, std::string(3000, 'b')},
+            {"dir1", TestFileType::Directory},
+            {"dir1/a.conf", TestFileType::Regular, "a=1"},
+            {"dir1/notes.txt", TestFileType::Regular, "notes"},
+            {"dir2", TestFileType::Directory},
+            {"dir2/c.conf", TestFileType::Regular, "c=3"},
+            {"dir2/big_link", TestFileType::Regular, "", "../big.txt", true}
+        };
+        create_test_structure(files);
+
+        WHEN("以1KB窗口压缩备份后按模式提取") {
+            Packer packer;
+            packer.set_window_size(1024);
+            packer.set_compress(true);
+            fs::path backup_path = backup_dir / (test_dir.filename().string() + ".backup");
+            REQUIRE(packer.Pack(test_dir, backup_path) == true);
+
+            fs::path by_name = backup_dir / "by_name";
+            fs::path by_dir = backup_dir / "by_dir";
+            fs::path by_link = backup_dir / "by_link";
+            REQUIRE(packer.Extract(backup_path, {"*.conf"}, by_name) == true);
+            REQUIRE(packer.Extract(backup_path, {"dir1"}, by_dir) == true);
+            REQUIRE(packer.Extract(backup_path, {"dir2/big_link"}, by_link) == true);
+
+            auto read_file = [](const fs::path& path) {
+                std::ifstream file(path);
+                return std::string((std::istreambuf_iterator<char>(file)), {});
+            };
+            const fs::path name = test_dir.filename();
+
+            THEN("只还原匹配的文件") {
+                REQUIRE(read_file(by_name / name / "dir1/a.conf") == "a=1");
+                REQUIRE(read_file(by_name / name / "dir2/c.conf") == "c=3");
+                REQUIRE_FALSE(fs::exists(by_name / name / "dir1/notes.txt"));
+                REQUIRE_FALSE(fs::exists(by_name / name / "big.txt"));
+
+                // 匹配目录时还原目录下的所有文件
+                REQUIRE(read_file(by_dir / name / "dir1/notes.txt") == "notes");
+                REQUIRE_FALSE(fs::exists(by_dir / name / "dir2"));
+
+                // 无论数据保存在哪个路径下，提取的硬链接内容都完整
+                REQUIRE(read_file(by_link / name / "dir2/big_link") == std::string(3000, 'b'));
+
+                REQUIRE(packer.Extract(backup_path, {"missing*"}, backup_dir / "none") == false);
+            }
+        }
+    }
+}
+
 SCENARIO_METHOD(TestFixture, "测试验证功能在不同模式下的表现",
                 "[backup][verify]") {
     GIVEN("一个包含各种类型文件的测试目录") {
@@ -0,0 +1,67 @@
+#include <catch2/catch_test_macros.hpp>
+#include "Checksum.h"
+#include <algorithm>
+#include <random>
+#include <string>
+
+namespace {
+// 逐位计算的参考实现，与最初的查表实现结果相同
+uint32_t reference_crc(const std::string& data, uint32_t crc = CRC32::INIT) {
+    crc = ~crc;
+    for (unsigned char byte : data) {
+        crc ^= byte;
+        for (int i = 0; i < 8; ++i) {
+            crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320 : 0);
+        }
+    }
+    return ~crc;
+}
+
+std::string random_bytes(size_t size, unsigned seed) {
+    std::mt19937 gen(seed);
+    std::string data(size, '\0');
+    for (auto& c : data) {
+        c = static_cast<char>(gen());
+    }
+    return data;
+}
+} // namespace
+
+TEST_CASE("CRC32计算测试", "[checksum]") {
+    const std::string data = random_bytes(100000, 1);
+
+    SECTION("与参考实现一致") {
+        // 覆盖各种长度和不对齐的起始位置
+        for (size_t length = 0; length < 300; ++length) {
+            for (size_t offset = 0; offset < 4; ++offset) {
+                const std::string piece = data.substr(offset, length);
+                const uint32_t expected = reference_crc(piece);
+                REQUIRE(CRC32::update(piece.data(), piece.size()) == expected);
+                REQUIRE(CRC32::update_portable(piece.data(), piece.size()) == expected);
+            }
+        }
+        REQUIRE(CRC32::update(data.data(), data.size()) == reference_crc(data));
+        REQUIRE(CRC32::update_portable(data.data(), data.size()) == reference_crc(data));
+    }
+
+    SECTION("分段计算") {
+        const uint32_t whole = CRC32::update(data.data(), data.size());
+        uint32_t crc = CRC32::INIT;
+        for (size_t pos = 0; pos < data.size(); pos += 777) {
+            const size_t length = std::min<size_t>(777, data.size() - pos);
+            crc = CRC32::update(data.data() + pos, length, crc);
+        }
+        REQUIRE(crc == whole);
+    }
+
+    SECTION("合并校验和") {
+        const size_t splits[] = {0, 1, 15, 64, 1000, 65536, data.size()};
+        const uint32_t whole = CRC32::update(data.data(), data.size());
+        for (size_t split : splits) {
+            INFO(split);
+            const uint32_t first = CRC32::update(data.data(), split);
+            const uint32_t second = CRC32::update(data.data() + split, data.size() - split);
+            REQUIRE(CRC32::combine(first, second, data.size() - split) == whole);
+        }
+    }
+}
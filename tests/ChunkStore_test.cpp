@@ -0,0 +1,81 @@
+#include <catch2/catch_test_macros.hpp>
+#include "ChunkStore.h"
+#include "Archive.h"
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+std::string read_chunk(const ChunkStore& store, const ChunkStore::ChunkId& id) {
+    std::vector<char> data;
+    store.get(id, data);
+    return std::string(data.begin(), data.end());
+}
+} // namespace
+
+TEST_CASE("数据块存储读写测试", "[chunkstore]") {
+    const fs::path dir = fs::absolute("chunk_store_test");
+    fs::remove_all(dir);
+    const std::string first(10000, 'a');
+    const std::string second = "第二个数据块";
+
+    SECTION("保存后可以读取，相同的数据只保存一次") {
+        ChunkStore store(dir, true, CODEC_LZ);
+        const ChunkStore::ChunkId id1 = store.put(first.data(), first.size());
+        const ChunkStore::ChunkId id2 = store.put(second.data(), second.size());
+        REQUIRE(id1 != id2);
+        REQUIRE(store.put(first.data(), first.size()) == id1);
+        REQUIRE(store.size() == 2);
+        REQUIRE(store.stats().chunks_added == 2);
+        REQUIRE(store.stats().chunks_reused == 1);
+        REQUIRE(store.stats().bytes_reused == first.size());
+        REQUIRE(read_chunk(store, id1) == first);
+        REQUIRE(read_chunk(store, id2) == second);
+
+        ChunkStore::ChunkId missing{};
+        std::vector<char> data;
+        REQUIRE_THROWS_AS(store.get(missing, data), std::runtime_error);
+    }
+
+    SECTION("写入索引后重新打开仍然可用") {
+        ChunkStore::ChunkId id;
+        ChunkStore::StoreId store_id;
+        {
+            ChunkStore store(dir, true, CODEC_LZ);
+            id = store.put(first.data(), first.size());
+            store_id = store.id();
+            store.flush();
+            // 未写入索引的数据块重新打开后不可见
+            store.put(second.data(), second.size());
+        }
+        ChunkStore store(dir);
+        REQUIRE(store.id() == store_id);
+        REQUIRE(store.size() == 1);
+        REQUIRE(read_chunk(store, id) == first);
+        REQUIRE_THROWS_AS(store.put(second.data(), second.size()), std::runtime_error);
+    }
+
+    SECTION("损坏的数据块") {
+        ChunkStore::ChunkId id;
+        {
+            ChunkStore store(dir, true);
+            id = store.put(first.data(), first.size());
+            store.flush();
+        }
+        std::fstream file(dir / "chunks.dat", std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(100);
+        file.put('b');
+        file.close();
+        ChunkStore store(dir);
+        std::vector<char> data;
+        REQUIRE_THROWS_AS(store.get(id, data), std::runtime_error);
+    }
+
+    SECTION("只读打开不存在的存储") {
+        REQUIRE_THROWS_AS(ChunkStore(dir), std::runtime_error);
+        REQUIRE_FALSE(fs::exists(dir));
+    }
+
+    fs::remove_all(dir);
+}
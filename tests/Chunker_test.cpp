@@ -0,0 +1,75 @@
+#include <catch2/catch_test_macros.hpp>
+#include "Chunker.h"
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace {
+std::string make_data(size_t size, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::string data(size, '\0');
+    for (auto& c : data) {
+        c = static_cast<char>(rng());
+    }
+    return data;
+}
+
+// 把数据完整切分成块
+std::vector<std::string> split(const std::string& data) {
+    std::vector<std::string> chunks;
+    for (size_t offset = 0; offset < data.size();) {
+        size_t length = Chunker::next_boundary(data.data() + offset, data.size() - offset);
+        chunks.push_back(data.substr(offset, length));
+        offset += length;
+    }
+    return chunks;
+}
+} // namespace
+
+TEST_CASE("分块长度范围测试", "[chunker]") {
+    const std::string data = make_data(2 * 1024 * 1024, 1);
+    const std::vector<std::string> chunks = split(data);
+
+    size_t total = 0;
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        total += chunks[i].size();
+        REQUIRE(chunks[i].size() <= Chunker::MAX_SIZE);
+        if (i + 1 < chunks.size()) {
+            REQUIRE(chunks[i].size() >= Chunker::MIN_SIZE);
+        }
+    }
+    REQUIRE(total == data.size());
+    // 平均块长应接近AVG_SIZE
+    const size_t average = data.size() / chunks.size();
+    REQUIRE(average > Chunker::AVG_SIZE / 2);
+    REQUIRE(average < Chunker::AVG_SIZE * 2);
+
+    SECTION("短数据整体作为一块") {
+        REQUIRE(Chunker::next_boundary(data.data(), 100) == 100);
+        REQUIRE(Chunker::next_boundary(data.data(), 0) == 0);
+    }
+
+    SECTION("重复的数据在最大块长处切分") {
+        const std::string zeros(3 * Chunker::MAX_SIZE, '\0');
+        REQUIRE(Chunker::next_boundary(zeros.data(), zeros.size()) <= Chunker::MAX_SIZE);
+    }
+}
+
+TEST_CASE("分块结果由内容决定", "[chunker]") {
+    const std::string data = make_data(1024 * 1024, 2);
+    REQUIRE(split(data) == split(data));
+
+    SECTION("插入数据后其余的块不变") {
+        std::string shifted = data;
+        shifted.insert(1000, "插入的一段数据");
+        const std::vector<std::string> original = split(data);
+        const std::set<std::string> chunks(original.begin(), original.end());
+        size_t shared = 0;
+        for (const auto& chunk : split(shifted)) {
+            shared += chunks.count(chunk);
+        }
+        // 只有插入位置附近的块改变
+        REQUIRE(shared + 2 >= original.size());
+    }
+}
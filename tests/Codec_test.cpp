@@ -0,0 +1,158 @@
+#include <catch2/catch_test_macros.hpp>
+#include "Archive.h"
+#include "Codec.h"
+#include <random>
+#include <stdexcept>
+#include <string>
+
+namespace {
+std::string round_trip(const Codec& codec, const std::string& data) {
+    std::vector<char> encoded;
+    codec.encode(data.data(), data.size(), encoded);
+    std::vector<char> decoded;
+    codec.decode(encoded.data(), encoded.size(), data.size(), decoded);
+    return std::string(decoded.begin(), decoded.end());
+}
+
+std::string random_bytes(size_t size, unsigned seed) {
+    std::mt19937 gen(seed);
+    std::uniform_int_distribution<> dis(0, 255);
+    std::string data(size, '\0');
+    for (auto& c : data) {
+        c = static_cast<char>(dis(gen));
+    }
+    return data;
+}
+
+// 由少量单词随机组成的文本，近似真实文件的可压缩程度
+std::string random_text(size_t size, unsigned seed) {
+    static const char* words[] = {"backup ", "restore ", "archive ", "frame ", "index ",
+                                  "文件 ", "目录\n", "packer ", "codec ", "0123456789 "};
+    std::mt19937 gen(seed);
+    std::uniform_int_distribution<> dis(0, 9);
+    std::string data;
+    while (data.size() < size) {
+        data += words[dis(gen)];
+    }
+    data.resize(size);
+    return data;
+}
+
+const uint8_t ALL_CODECS[] = {CODEC_LZW, CODEC_LZ, CODEC_LZH};
+const uint8_t LZ_CODECS[] = {CODEC_LZ, CODEC_LZH};
+} // namespace
+
+TEST_CASE("编码器往返测试", "[codec]") {
+    SECTION("空数据和短数据") {
+        for (uint8_t id : ALL_CODECS) {
+            auto codec = Codec::Create(id);
+            INFO(codec->name());
+            REQUIRE(codec->id() == id);
+            REQUIRE(round_trip(*codec, "").empty());
+            REQUIRE(round_trip(*codec, "a") == "a");
+            REQUIRE(round_trip(*codec, "abcabcabc") == "abcabcabc");
+        }
+    }
+
+    SECTION("随机数据") {
+        const std::string data = random_bytes(100000, 1);
+        for (uint8_t id : ALL_CODECS) {
+            auto codec = Codec::Create(id);
+            INFO(codec->name());
+            REQUIRE(round_trip(*codec, data) == data);
+        }
+    }
+
+    SECTION("高度重复数据") {
+        const std::string data = std::string(300000, 'A') + std::string(70000, 'B');
+        for (uint8_t id : ALL_CODECS) {
+            auto codec = Codec::Create(id);
+            INFO(codec->name());
+            std::vector<char> encoded;
+            codec->encode(data.data(), data.size(), encoded);
+            REQUIRE(encoded.size() < data.size() / 50);
+            REQUIRE(round_trip(*codec, data) == data);
+        }
+    }
+
+    SECTION("较大的文本数据") {
+        // 超过LZ的最大偏移和LZH的单块记号数
+        const std::string data = random_text(1 << 20, 2);
+        for (uint8_t id : ALL_CODECS) {
+            auto codec = Codec::Create(id);
+            INFO(codec->name());
+            std::vector<char> encoded;
+            codec->encode(data.data(), data.size(), encoded);
+            REQUIRE(encoded.size() < data.size() / 2);
+            REQUIRE(round_trip(*codec, data) == data);
+        }
+    }
+}
+
+TEST_CASE("压缩级别测试", "[codec]") {
+    const std::string data = random_text(200000, 3);
+
+    for (uint8_t id : LZ_CODECS) {
+        INFO(static_cast<int>(id));
+        // 所有级别都能正确往返
+        for (int level = 1; level <= 9; ++level) {
+            auto codec = Codec::Create(id, level);
+            REQUIRE(round_trip(*codec, data) == data);
+        }
+
+        // 高级别的压缩率不低于低级别
+        std::vector<char> low, high;
+        Codec::Create(id, 1)->encode(data.data(), data.size(), low);
+        Codec::Create(id, 9)->encode(data.data(), data.size(), high);
+        REQUIRE(high.size() <= low.size());
+
+        REQUIRE_THROWS_AS(Codec::Create(id, 10), std::runtime_error);
+        REQUIRE_THROWS_AS(Codec::Create(id, -1), std::runtime_error);
+    }
+}
+
+TEST_CASE("编码器损坏数据测试", "[codec]") {
+    const std::string data = random_text(50000, 4);
+
+    for (uint8_t id : LZ_CODECS) {
+        auto codec = Codec::Create(id);
+        INFO(codec->name());
+        std::vector<char> encoded;
+        codec->encode(data.data(), data.size(), encoded);
+        std::vector<char> out;
+
+        // 截断的数据
+        REQUIRE_THROWS_AS(codec->decode(encoded.data(), encoded.size() / 2, data.size(), out),
+                          std::runtime_error);
+        REQUIRE_THROWS_AS(codec->decode(encoded.data(), 0, data.size(), out),
+                          std::runtime_error);
+
+        // 原始长度不符
+        REQUIRE_THROWS_AS(codec->decode(encoded.data(), encoded.size(), data.size() - 1, out),
+                          std::runtime_error);
+
+        // 随机篡改只会抛出异常或得到长度正确的结果，不会越界访问
+        std::mt19937 gen(5);
+        for (int i = 0; i < 200; ++i) {
+            std::vector<char> damaged = encoded;
+            for (int j = 0; j < 4; ++j) {
+                damaged[gen() % damaged.size()] ^= static_cast<char>(1 + gen() % 255);
+            }
+            out.clear();
+            try {
+                codec->decode(damaged.data(), damaged.size(), data.size(), out);
+                REQUIRE(out.size() == data.size());
+            } catch (const std::runtime_error&) {
+            }
+        }
+    }
+}
+
+TEST_CASE("编码器名称查找", "[codec]") {
+    REQUIRE(Codec::IdFromName("lzw") == CODEC_LZW);
+    REQUIRE(Codec::IdFromName("lz") == CODEC_LZ);
+    REQUIRE(Codec::IdFromName("lzh") == CODEC_LZH);
+    REQUIRE_THROWS_AS(Codec::IdFromName("zip"), std::runtime_error);
+    REQUIRE_THROWS_AS(Codec::Create(CODEC_NONE), std::runtime_error);
+    REQUIRE_THROWS_AS(Codec::Create(200), std::runtime_error);
+}
@@ -0,0 +1,39 @@
+#include <catch2/catch_test_macros.hpp>
+#include "DuplicateFinder.h"
+#include <fstream>
+#include <string>
+
+TEST_CASE("重复文件查找测试", "[duplicates]") {
+    const fs::path dir = fs::absolute("duplicate_finder_test");
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    auto write = [&](const std::string& name, const std::string& content) {
+        std::ofstream(dir / name, std::ios::binary) << content;
+        return (dir / name).string();
+    };
+
+    // 中间一个字节不同，开头和结尾的部分哈希相同，只有完整哈希能区分
+    const std::string content(20000, 'x');
+    std::string middle = content;
+    middle[10000] = 'y';
+    const std::string first = write("first.bin", content);
+    const std::string other = write("other.bin", middle);
+    const std::string copy = write("copy.bin", content);
+    const std::string small = write("small.txt", "small");
+    const std::string small_copy = write("small_copy.txt", "small");
+
+    DuplicateFinder finder;
+    REQUIRE_FALSE(finder.find_or_add(first, content.size()).has_value());
+    REQUIRE_FALSE(finder.find_or_add(other, middle.size()).has_value());
+    REQUIRE(finder.find_or_add(copy, content.size()) == first);
+    REQUIRE(finder.duplicates() == 1);
+    REQUIRE(finder.duplicate_bytes() == content.size());
+
+    SECTION("过小的文件不参与比较") {
+        REQUIRE_FALSE(finder.find_or_add(small, 5).has_value());
+        REQUIRE_FALSE(finder.find_or_add(small_copy, 5).has_value());
+        REQUIRE(finder.duplicates() == 1);
+    }
+
+    fs::remove_all(dir);
+}
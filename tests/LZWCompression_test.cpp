@@ -2,12 +2,14 @@
 #include "Compression.h"
 #include <string>
 #include <random>
+#include <algorithm>
+#include <stdexcept>
 TEST_CASE("LZW压缩基础功能测试", "[lzw]") {
     SECTION("高度可压缩数据") {
         // 重复文本
         std::string repeated = std::string(1000, 'A');
         auto compressed = LZWCompression::compress(repeated);
-        auto decompressed = LZWCompression::decompress(compressed.data());
+        auto decompressed = LZWCompression::decompress(compressed);
         std::string decompressed_str(decompressed.begin(), decompressed.end());
         REQUIRE(decompressed_str == repeated);
         REQUIRE(compressed.size() < repeated.length());
@@ -25,7 +27,7 @@ TEST_CASE("LZW压缩基础功能测试", "[lzw]") {
         }
         
         auto compressed = LZWCompression::compress(random_data);
-        auto decompressed = LZWCompression::decompress(compressed.data());
+        auto decompressed = LZWCompression::decompress(compressed);
         std::string decompressed_str(decompressed.begin(), decompressed.end());
         REQUIRE(decompressed_str == random_data);
     }
@@ -35,7 +37,7 @@ TEST_CASE("LZW压缩基础功能测试", "[lzw]") {
                                "这是中文行\n"
                                "Special chars: !@#$%^&*()\n";
         auto compressed = LZWCompression::compress(multiline);
-        auto decompressed = LZWCompression::decompress(compressed.data());
+        auto decompressed = LZWCompression::decompress(compressed);
         std::string decompressed_str(decompressed.begin(), decompressed.end());
         REQUIRE(decompressed_str == multiline);
     }
@@ -44,14 +46,14 @@ TEST_CASE("LZW压缩基础功能测试", "[lzw]") {
         // UTF-8编码的中文文本
         std::string chinese = "测试中文压缩效果";
         auto compressed = LZWCompression::compress(chinese);
-        auto decompressed = LZWCompression::decompress(compressed.data());
+        auto decompressed = LZWCompression::decompress(compressed);
         std::string decompressed_str(decompressed.begin(), decompressed.end());
         REQUIRE(decompressed_str == chinese);
 
         // 包含emoji的文本
         std::string emoji = "Hello 👋 World 🌍";
         compressed = LZWCompression::compress(emoji);
-        decompressed = LZWCompression::decompress(compressed.data());
+        decompressed = LZWCompression::decompress(compressed);
         decompressed_str = std::string(decompressed.begin(), decompressed.end());
         REQUIRE(decompressed_str == emoji);
     }
@@ -62,21 +64,21 @@ TEST_CASE("LZW压缩边界情况测试", "[lzw]") {
         std::string empty = "";
         auto compressed = LZWCompression::compress(empty);
 
-        auto decompressed = LZWCompression::decompress(compressed.data());
+        auto decompressed = LZWCompression::decompress(compressed);
         // std::string decompressed_str(decompressed.begin(), decompressed.end());
         // REQUIRE(decompressed_str == empty);
     }
     SECTION("只有一个字符") {
         std::string single_char = "X";
         auto compressed = LZWCompression::compress(single_char);
-        auto decompressed = LZWCompression::decompress(compressed.data());
+        auto decompressed = LZWCompression::decompress(compressed);
         std::string decompressed_str(decompressed.begin(), decompressed.end());
         REQUIRE(decompressed_str == single_char);
     }
     SECTION("单字符重复") {
         std::string single_char(10000, 'X');
         auto compressed = LZWCompression::compress(single_char);
-        auto decompressed = LZWCompression::decompress(compressed.data());
+        auto decompressed = LZWCompression::decompress(compressed);
         std::string decompressed_str(decompressed.begin(), decompressed.end());
         REQUIRE(decompressed_str == single_char);
     }
@@ -88,8 +90,102 @@ TEST_CASE("LZW压缩边界情况测试", "[lzw]") {
             binary_data += static_cast<char>(i);
         }
         auto compressed = LZWCompression::compress(binary_data);
-        auto decompressed = LZWCompression::decompress(compressed.data());
+        auto decompressed = LZWCompression::decompress(compressed);
         std::string decompressed_str(decompressed.begin(), decompressed.end());
         REQUIRE(decompressed_str == binary_data);
     }
-} 
\ No newline at end of file
+} 
+TEST_CASE("LZW字典重置与压缩率测试", "[lzw]") {
+    SECTION("超过字典容量的数据") {
+        // 足够多的不同短语，使字典多次写满并重置
+        std::mt19937 gen(42);
+        std::uniform_int_distribution<> dis(0, 63);
+        std::string data;
+        data.reserve(1 << 20);
+        while (data.size() < (1 << 20)) {
+            data += static_cast<char>('A' + dis(gen));
+        }
+        auto compressed = LZWCompression::compress(data);
+        auto decompressed = LZWCompression::decompress(compressed);
+        REQUIRE(std::string(decompressed.begin(), decompressed.end()) == data);
+    }
+
+    SECTION("文本数据的压缩率") {
+        std::string text;
+        for (int i = 0; i < 5000; i++) {
+            text += "record " + std::to_string(i) + ": status=ok\n";
+        }
+        auto compressed = LZWCompression::compress(text);
+        REQUIRE(compressed.size() < text.size() / 2);
+        auto decompressed = LZWCompression::decompress(compressed);
+        REQUIRE(std::string(decompressed.begin(), decompressed.end()) == text);
+    }
+}
+
+TEST_CASE("LZW流式解压测试", "[lzw]") {
+    std::string text;
+    for (int i = 0; i < 20000; i++) {
+        text += "line " + std::to_string(i % 1000) + "\n";
+    }
+    const auto compressed = LZWCompression::compress(text);
+
+    SECTION("分段输入") {
+        for (size_t step : {size_t{1}, size_t{7}, size_t{4096}}) {
+            std::string output;
+            size_t largest_chunk = 0;
+            LZWCompression::Decoder decoder([&](const char* data, size_t size) {
+                output.append(data, size);
+                largest_chunk = std::max(largest_chunk, size);
+            });
+            for (size_t pos = 0; pos < compressed.size(); pos += step) {
+                decoder.feed(compressed.data() + pos, std::min(step, compressed.size() - pos));
+            }
+            REQUIRE(decoder.done());
+            decoder.finish();
+            REQUIRE(output == text);
+            // 输出分段交给回调，不会一次性缓存全部结果
+            REQUIRE(largest_chunk < 256 * 1024);
+        }
+    }
+
+    SECTION("截断的数据") {
+        REQUIRE_THROWS(LZWCompression::decompress(std::span<const char>()));
+        REQUIRE_THROWS(LZWCompression::decompress({compressed.data(), 5}));
+        REQUIRE_THROWS(LZWCompression::decompress({compressed.data(), compressed.size() - 1}));
+    }
+
+    SECTION("末尾多余的数据") {
+        std::vector<char> extended = compressed;
+        extended.push_back('\0');
+        REQUIRE_THROWS(LZWCompression::decompress(extended));
+    }
+
+    SECTION("随机篡改不会越界") {
+        std::mt19937 gen(7);
+        for (int i = 0; i < 200; i++) {
+            std::vector<char> damaged = compressed;
+            // 不篡改长度头，避免巨大的原始长度使测试变慢
+            damaged[8 + gen() % (damaged.size() - 8)] ^= static_cast<char>(1 + gen() % 255);
+            try {
+                auto decompressed = LZWCompression::decompress(damaged);
+                REQUIRE(decompressed.size() == text.size());
+            } catch (const std::runtime_error&) {
+            }
+        }
+    }
+}
+
+TEST_CASE("旧版LZW数据解压测试", "[lzw]") {
+    // "ABABABA" 的旧版编码：A B AB ABA
+    std::vector<int> codes = {'A', 'B', 256, 258};
+    std::string data;
+    size_t count = codes.size();
+    data.append(reinterpret_cast<const char*>(&count), sizeof(count));
+    for (int code : codes) {
+        data.append(reinterpret_cast<const char*>(&code), sizeof(code));
+    }
+
+    auto decompressed = LZWCompression::decompress_legacy(data.data(), data.size());
+    REQUIRE(std::string(decompressed.begin(), decompressed.end()) == "ABABABA");
+    REQUIRE_THROWS(LZWCompression::decompress_legacy(data.data(), data.size() - 1));
+}
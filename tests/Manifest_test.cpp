@@ -0,0 +1,96 @@
+#include <catch2/catch_test_macros.hpp>
+#include "Manifest.h"
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+namespace {
+std::string to_hex(const ManifestEntry::Hash& hash) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex;
+    for (unsigned char byte : hash) {
+        hex += digits[byte >> 4];
+        hex += digits[byte & 0x0F];
+    }
+    return hex;
+}
+} // namespace
+
+TEST_CASE("清单读写测试", "[manifest]") {
+    const fs::path path = fs::absolute("manifest_test.manifest");
+    fs::remove(path);
+
+    Manifest manifest;
+    ManifestEntry entry;
+    entry.path = "dir1/文件.txt";
+    entry.mode = S_IFREG | 0644;
+    entry.inode = 123456;
+    entry.size = 4000;
+    entry.mtime_ns = 1700000000123456789;
+    entry.hash.fill(0xAB);
+    manifest.add(entry);
+    entry.path = "dir1";
+    entry.mode = S_IFDIR | 0755;
+    entry.hash.fill(0);
+    manifest.add(entry);
+
+    SECTION("保存后可以完整读取") {
+        manifest.Save(path);
+        Manifest loaded = Manifest::Load(path);
+        REQUIRE(loaded.entries().size() == 2);
+        const ManifestEntry* file = loaded.find("dir1/文件.txt");
+        REQUIRE(file != nullptr);
+        REQUIRE(file->mode == (S_IFREG | 0644));
+        REQUIRE(file->inode == 123456);
+        REQUIRE(file->size == 4000);
+        REQUIRE(file->mtime_ns == 1700000000123456789);
+        REQUIRE(file->hash == manifest.find("dir1/文件.txt")->hash);
+        REQUIRE(S_ISDIR(loaded.find("dir1")->mode));
+        REQUIRE(loaded.find("missing") == nullptr);
+    }
+
+    SECTION("损坏的清单") {
+        manifest.Save(path);
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(20);
+        file.put('x');
+        file.close();
+        REQUIRE_THROWS_AS(Manifest::Load(path), std::runtime_error);
+        REQUIRE_THROWS_AS(Manifest::Load(path.string() + ".missing"), std::runtime_error);
+    }
+
+    fs::remove(path);
+}
+
+TEST_CASE("清单条目比较测试", "[manifest]") {
+    struct stat metadata{};
+    metadata.st_mode = S_IFREG | 0644;
+    metadata.st_ino = 42;
+    metadata.st_size = 100;
+    metadata.st_mtim.tv_sec = 1700000000;
+    metadata.st_mtim.tv_nsec = 5;
+    const ManifestEntry entry = ManifestEntry::FromStat("a.txt", metadata);
+    REQUIRE(entry.mtime_ns == 1700000000000000005);
+    REQUIRE(entry.same_metadata(ManifestEntry::FromStat("a.txt", metadata)));
+
+    metadata.st_mtim.tv_nsec = 6;
+    REQUIRE_FALSE(entry.same_metadata(ManifestEntry::FromStat("a.txt", metadata)));
+    metadata.st_mtim.tv_nsec = 5;
+    metadata.st_mode = S_IFREG | 0600;
+    REQUIRE_FALSE(entry.same_metadata(ManifestEntry::FromStat("a.txt", metadata)));
+    metadata.st_mode = S_IFREG | 0644;
+    metadata.st_ino = 43;
+    REQUIRE_FALSE(entry.same_metadata(ManifestEntry::FromStat("a.txt", metadata)));
+}
+
+TEST_CASE("文件内容哈希测试", "[manifest]") {
+    const fs::path path = fs::absolute("manifest_hash_test.txt");
+    std::ofstream(path) << "abc";
+    REQUIRE(to_hex(Manifest::HashFile(path)) ==
+            "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+
+    std::ofstream(path, std::ios::trunc).close();
+    REQUIRE(to_hex(Manifest::HashFile(path)) ==
+            "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    fs::remove(path);
+}